@@ -0,0 +1,598 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "batch.h"
+#include "rig.h"
+#include "timing.h"
+#include "update.h"
+#include "waveform.h"
+
+typedef int (*batch_cmd)(batch *b, int argc, char *argv[]);
+
+void init_batch(batch *b, effect_slots *slots, effect_mask supported_effects){
+	memset(b, 0, sizeof(*b));
+	b->haptic = slots->haptic;
+	b->slots = slots;
+	b->supported_effects = supported_effects;
+	b->file = "<input>";
+}
+
+haptic_elem *find_named_elem(batch *b, const char *name){
+	return find_slot_by_name(b->slots, name);
+}
+
+static haptic_elem *get_named_elem(batch *b, const char *name){
+	haptic_elem *elem = find_named_elem(b, name);
+	if(!elem)
+		SDL_SetError("No effect named '%s'.", name);
+
+	return elem;
+}
+
+static int get_mixed_id(batch *b, const char *name){
+	int id = mixer_find(b->mixer, name);
+	if(id < 0)
+		SDL_SetError("No effect named '%s'.", name);
+
+	return id;
+}
+
+static int parse_number(const char *s, long long min, long long max, long long *v){
+	char *end;
+
+	if(!strcmp(s, "inf") && max == SDL_HAPTIC_INFINITY){
+		*v = SDL_HAPTIC_INFINITY;
+		return 0;
+	}
+
+	*v = strtoll(s, &end, 0);
+	if(end == s || *end)
+		return SDL_SetError("Expected a number, got '%s'.", s);
+
+	if(*v < min || *v > max)
+		return SDL_SetError("%lli out of range [%lli - %lli].", *v, min, max);
+
+	return 0;
+}
+
+static int apply_fields(SDL_HapticEffect *effect, int argc, char *argv[]){
+	for(int i = 0; i < argc; ++i){
+		if(parse_effect_field(effect, argv[i]))
+			return -1;
+	}
+
+	return 0;
+}
+
+int parse_effect_args(int argc, char *argv[], SDL_HapticEffect *effect){
+	uint16_t type = get_haptic_type(argv[0]);
+	if(!type)
+		return SDL_SetError("Unknown effect type '%s'.", argv[0]);
+
+	init_effect(effect, type);
+	return apply_fields(effect, argc - 1, argv + 1);
+}
+
+int parse_create_args(int argc, char *argv[], SDL_HapticEffect *effect, int *priority){
+	if(strlen(argv[1]) >= EFFECT_NAME_LEN)
+		return SDL_SetError("Effect name '%s' is too long.", argv[1]);
+
+	// priority isn't part of the effect, so take it out before parsing
+	long long p = 0;
+	int n = 3;
+	for(int i = 3; i < argc; ++i){
+		if(strncmp(argv[i], "priority=", 9))
+			argv[n++] = argv[i];
+		else if(parse_number(argv[i] + 9, INT_MIN, SLOT_PRIORITY_MAX - 1, &p))
+			return -1;
+	}
+
+	*priority = p;
+	return parse_effect_args(n - 2, argv + 2, effect);
+}
+
+// create <name> <type> [priority=n] [param=value ...]
+static int cmd_create(batch *b, int argc, char *argv[]){
+	SDL_HapticEffect effect;
+	int priority;
+	if(parse_create_args(argc, argv, &effect, &priority))
+		return -1;
+
+	if(find_named_elem(b, argv[1]))
+		return SDL_SetError("Effect '%s' already exists.", argv[1]);
+
+	if(b->mixer){
+		if(mixer_find(b->mixer, argv[1]) >= 0)
+			return SDL_SetError("Effect '%s' already exists.", argv[1]);
+
+		return mixer_add(b->mixer, argv[1], &effect) < 0 ? -1 : 0;
+	}
+
+	if(!(effect.type & b->supported_effects))
+		return SDL_SetError("%s is not supported by the device.",
+				get_haptic_type_name(effect.type));
+
+	return create_slot_effect(b->slots, &effect, argv[1], priority) ? 0 : -1;
+}
+
+// preset <preset> [name], creates an effect from the preset library
+static int cmd_preset(batch *b, int argc, char *argv[]){
+	if(!b->presets)
+		return SDL_SetError("No preset library, load one with -b.");
+
+	const preset_record *r = find_preset(b->presets, argv[1]);
+	if(!r)
+		return SDL_SetError("No preset named '%s'.", argv[1]);
+
+	const char *name = argc > 2 ? argv[2] : r->name;
+	if(strlen(name) >= EFFECT_NAME_LEN)
+		return SDL_SetError("Effect name '%s' is too long.", name);
+
+	if(b->mixer){
+		if(mixer_find(b->mixer, name) >= 0)
+			return SDL_SetError("Effect '%s' already exists.", name);
+
+		return mixer_add(b->mixer, name, &r->effect) < 0 ? -1 : 0;
+	}
+
+	if(find_named_elem(b, name))
+		return SDL_SetError("Effect '%s' already exists.", name);
+
+	if(!(r->effect.type & b->supported_effects))
+		return SDL_SetError("%s is not supported by the device.",
+				get_haptic_type_name(r->effect.type));
+
+	return create_slot_effect(b->slots, &r->effect, name, r->priority) ? 0 : -1;
+}
+
+// the effects a waveform is split into after the first are named
+// name#1, name#2 and so on
+static haptic_elem *find_chunk(batch *b, const char *name, int i){
+	char chunk[EFFECT_NAME_LEN + 16];
+	snprintf(chunk, sizeof(chunk), "%s#%i", name, i);
+	return find_named_elem(b, chunk);
+}
+
+static void destroy_chunks(batch *b, const char *name, int n){
+	haptic_elem *elem = find_named_elem(b, name);
+	if(elem)
+		destroy_slot_effect(b->slots, elem);
+
+	for(int i = 1; i < n; ++i){
+		if((elem = find_chunk(b, name, i)))
+			destroy_slot_effect(b->slots, elem);
+	}
+}
+
+// waveform <name> <file> [rate=hz] [channels=n] [axes=n] [bits=n]
+//          [dither=0|1] [chunk=n] [priority=n] [param=value ...]
+static int cmd_waveform(batch *b, int argc, char *argv[]){
+	const char *name = argv[1], *file = argv[2];
+	if(strlen(name) + 6 >= EFFECT_NAME_LEN)
+		return SDL_SetError("Effect name '%s' is too long.", name);
+
+	if(b->mixer)
+		return SDL_SetError("Waveforms can't be mixed in software.");
+
+	if(!(b->supported_effects & SDL_HAPTIC_CUSTOM))
+		return SDL_SetError("CUSTOM is not supported by the device.");
+
+	if(find_named_elem(b, name))
+		return SDL_SetError("Effect '%s' already exists.", name);
+
+	waveform_options opts = default_waveform_options();
+	long long rate = 1000, channels = 1, priority = 0, v;
+	int n = 0;
+
+	// what isn't about the waveform is a parameter of the effects
+	for(int i = 3; i < argc; ++i){
+		char *arg = argv[i];
+		if(!strncmp(arg, "rate=", 5)){
+			if(parse_number(arg + 5, 1, 1000000, &rate))
+				return -1;
+		} else if(!strncmp(arg, "channels=", 9)){
+			if(parse_number(arg + 9, 1, 16, &channels))
+				return -1;
+		} else if(!strncmp(arg, "axes=", 5)){
+			if(parse_number(arg + 5, 1, 3, &v))
+				return -1;
+			opts.axes = v;
+		} else if(!strncmp(arg, "bits=", 5)){
+			if(parse_number(arg + 5, 1, 16, &v))
+				return -1;
+			opts.bits = v;
+		} else if(!strncmp(arg, "dither=", 7)){
+			if(parse_number(arg + 7, 0, 1, &v))
+				return -1;
+			opts.dither = v;
+		} else if(!strncmp(arg, "chunk=", 6)){
+			if(parse_number(arg + 6, 1, USHRT_MAX, &v))
+				return -1;
+			opts.chunk = v;
+		} else if(!strncmp(arg, "priority=", 9)){
+			if(parse_number(arg + 9, INT_MIN, SLOT_PRIORITY_MAX - 1, &priority))
+				return -1;
+		} else {
+			argv[n++] = arg;
+		}
+	}
+
+	int axes = haptic_num_axes(b->haptic);
+	if(axes > 0 && (int)opts.axes > axes)
+		return SDL_SetError("The device only has %i axes.", axes);
+
+	SDL_HapticEffect base;
+	init_effect(&base, SDL_HAPTIC_CUSTOM);
+	if(apply_fields(&base, n, argv))
+		return -1;
+
+	waveform w;
+	if(load_waveform(&w, file, rate, channels))
+		return -1;
+
+	SDL_HapticEffect *effects;
+	int num = build_custom_effects(&w, &opts, &base, &effects);
+	free_waveform(&w);
+	if(num < 0)
+		return -1;
+
+	int ret = 0;
+	for(int i = 0; i < num && !ret; ++i){
+		char chunk[EFFECT_NAME_LEN];
+		if(i)
+			snprintf(chunk, sizeof(chunk), "%s#%i", name, i);
+		else
+			strcpy(chunk, name);
+
+		if(!create_slot_effect(b->slots, &effects[i], chunk, priority))
+			ret = -1;
+	}
+
+	free_custom_effects(effects);
+
+	// with the slots running short later chunks can evict earlier ones,
+	// and half a waveform is no use to anyone
+	for(int i = 0; i < num && !ret; ++i){
+		if(!(i ? find_chunk(b, name, i) : find_named_elem(b, name)))
+			ret = SDL_SetError("Not enough effect slots for %i chunks.", num);
+	}
+
+	if(ret){
+		char error[256];
+		snprintf(error, sizeof(error), "%s", SDL_GetError());
+		destroy_chunks(b, name, num);
+		return SDL_SetError("%s", error);
+	}
+
+	return 0;
+}
+
+// modify <name> param=value ...
+static int cmd_modify(batch *b, int argc, char *argv[]){
+	if(b->mixer){
+		SDL_HapticEffect effect;
+		int id = get_mixed_id(b, argv[1]);
+		if(id < 0 || mixer_get(b->mixer, id, &effect))
+			return -1;
+
+		if(apply_fields(&effect, argc - 2, argv + 2))
+			return -1;
+
+		return mixer_update(b->mixer, id, &effect);
+	}
+
+	haptic_elem *elem = get_named_elem(b, argv[1]);
+	if(!elem)
+		return -1;
+
+	if(b->morph)
+		cancel_morph(b->morph, elem);
+
+	// the effect is read by -O and the morph thread under the lock, so it
+	// changes in one go
+	SDL_LockMutex(b->slots->lock);
+	SDL_HapticEffect old = elem->effect;
+	SDL_HapticEffect effect = old;
+	int ret = apply_fields(&effect, argc - 2, argv + 2);
+	if(!ret){
+		elem->effect = effect;
+		ret = upload_effect(b->haptic, elem);
+		if(ret)
+			elem->effect = old;
+	}
+
+	SDL_UnlockMutex(b->slots->lock);
+	return ret ? -1 : 0;
+}
+
+// morph <name> <ms> [preset] [param=value ...], moves an effect smoothly to
+// the parameters of a preset, the ones given, or both
+static int cmd_morph(batch *b, int argc, char *argv[]){
+	if(b->mixer)
+		return SDL_SetError("Mixed effects can't be morphed.");
+
+	if(!b->morph)
+		return SDL_SetError("Morphing isn't available here.");
+
+	haptic_elem *elem = get_named_elem(b, argv[1]);
+	if(!elem)
+		return -1;
+
+	long long ms;
+	if(parse_number(argv[2], 0, UINT32_MAX, &ms))
+		return -1;
+
+	// the morph thread doesn't touch it once cancelled, so the effect can
+	// be read safely and a morph already under way stops where it is
+	cancel_morph(b->morph, elem);
+	SDL_HapticEffect target = elem->effect;
+
+	int first = 3;
+	if(argc > 3 && !strchr(argv[3], '=')){
+		if(!b->presets)
+			return SDL_SetError("No preset library, load one with -b.");
+
+		const preset_record *r = find_preset(b->presets, argv[3]);
+		if(!r)
+			return SDL_SetError("No preset named '%s'.", argv[3]);
+
+		if(r->effect.type != target.type)
+			return SDL_SetError("Preset '%s' is %s, not %s.", argv[3],
+					get_haptic_type_name(r->effect.type), get_haptic_type_name(target.type));
+
+		target = r->effect;
+		first = 4;
+	}
+
+	if(apply_fields(&target, argc - first, argv + first))
+		return -1;
+
+	return morph_effect(b->morph, elem, &target, ms);
+}
+
+// play <name> [iterations]
+static int cmd_play(batch *b, int argc, char *argv[]){
+	long long iterations = 1;
+	if(argc > 2 && parse_number(argv[2], 0, SDL_HAPTIC_INFINITY, &iterations))
+		return -1;
+
+	if(b->mixer){
+		int id = get_mixed_id(b, argv[1]);
+		return id < 0 ? -1 : mixer_play(b->mixer, id, iterations, now_ns());
+	}
+
+	haptic_elem *elem = get_named_elem(b, argv[1]);
+	if(!elem)
+		return -1;
+
+	// the rest of a waveform is delayed to follow on, so all of it starts
+	// together
+	haptic_elem *chunk = find_chunk(b, argv[1], 1);
+	if(chunk && iterations != 1)
+		return SDL_SetError("Waveforms split into chunks only play once.");
+
+	if(play_slot_effect(b->slots, elem, iterations))
+		return -1;
+
+	for(int i = 2; chunk; chunk = find_chunk(b, argv[1], i++)){
+		if(play_slot_effect(b->slots, chunk, 1))
+			return -1;
+	}
+
+	return 0;
+}
+
+// stop <name>
+static int cmd_stop(batch *b, int argc, char *argv[]){
+	if(b->mixer){
+		int id = get_mixed_id(b, argv[1]);
+		return id < 0 ? -1 : mixer_stop(b->mixer, id);
+	}
+
+	haptic_elem *elem = get_named_elem(b, argv[1]);
+	if(!elem || stop_slot_effect(b->slots, elem))
+		return -1;
+
+	for(int i = 1; (elem = find_chunk(b, argv[1], i)); ++i){
+		if(stop_slot_effect(b->slots, elem))
+			return -1;
+	}
+
+	return 0;
+}
+
+// destroy <name>
+static int cmd_destroy(batch *b, int argc, char *argv[]){
+	if(b->mixer){
+		int id = get_mixed_id(b, argv[1]);
+		return id < 0 ? -1 : mixer_remove(b->mixer, id);
+	}
+
+	haptic_elem *elem = get_named_elem(b, argv[1]);
+	if(!elem)
+		return -1;
+
+	if(b->morph)
+		cancel_morph(b->morph, elem);
+
+	destroy_slot_effect(b->slots, elem);
+	for(int i = 1; (elem = find_chunk(b, argv[1], i)); ++i)
+		destroy_slot_effect(b->slots, elem);
+
+	return 0;
+}
+
+// gain <0-100>
+static int cmd_gain(batch *b, int argc, char *argv[]){
+	long long gain;
+	if(parse_number(argv[1], 0, 100, &gain))
+		return -1;
+
+	return haptic_set_gain(b->haptic, gain);
+}
+
+// autocenter <0-100>
+static int cmd_autocenter(batch *b, int argc, char *argv[]){
+	long long autocenter;
+	if(parse_number(argv[1], 0, 100, &autocenter))
+		return -1;
+
+	return haptic_set_autocenter(b->haptic, autocenter);
+}
+
+// device <all|n[,n...]>, which devices of a rig the following creates,
+// gains and autocenters go to
+static int cmd_device(batch *b, int argc, char *argv[]){
+	if(!b->rig)
+		return SDL_SetError("Only one device, open more with -D.");
+
+	return rig_select(b->rig, argv[1]);
+}
+
+// sleep <ms>, mostly useful for letting effects play out before the
+// script continues
+static int cmd_sleep(batch *b, int argc, char *argv[]){
+	long long ms;
+	if(parse_number(argv[1], 0, UINT32_MAX, &ms))
+		return -1;
+
+	SDL_Delay(ms);
+	return 0;
+}
+
+static const struct {
+	const char *name;
+	batch_cmd cmd;
+	int min_args;
+	int max_args;
+} commands[] = {
+	{"create", cmd_create, 3, BATCH_MAX_ARGS},
+	{"waveform", cmd_waveform, 3, BATCH_MAX_ARGS},
+	{"preset", cmd_preset, 2, 3},
+	{"modify", cmd_modify, 2, BATCH_MAX_ARGS},
+	{"morph", cmd_morph, 3, BATCH_MAX_ARGS},
+	{"play", cmd_play, 2, 3},
+	{"stop", cmd_stop, 2, 2},
+	{"destroy", cmd_destroy, 2, 2},
+	{"gain", cmd_gain, 2, 2},
+	{"autocenter", cmd_autocenter, 2, 2},
+	{"device", cmd_device, 2, 2},
+	{"sleep", cmd_sleep, 2, 2},
+};
+
+int split_args(char *line, char *argv[]){
+	int argc = 0;
+	char *p = line;
+
+	for(;;){
+		while(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+			++p;
+
+		if(!*p || *p == '#')
+			break;
+
+		if(argc == BATCH_MAX_ARGS)
+			return SDL_SetError("Too many arguments.");
+
+		argv[argc++] = p;
+		while(*p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+			++p;
+
+		if(!*p)
+			break;
+
+		*p++ = '\0';
+	}
+
+	return argc;
+}
+
+static int find_command(int argc, char *argv[]){
+	for(size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); ++i){
+		if(strcmp(commands[i].name, argv[0]))
+			continue;
+
+		if(argc < commands[i].min_args || argc > commands[i].max_args)
+			return SDL_SetError("Wrong number of arguments to %s.", argv[0]);
+
+		return i;
+	}
+
+	return SDL_SetError("Unknown command '%s'.", argv[0]);
+}
+
+int check_batch_args(int argc, char *argv[]){
+	return find_command(argc, argv) < 0 ? -1 : 0;
+}
+
+int run_batch_args(batch *b, int argc, char *argv[]){
+	int ret = find_command(argc, argv);
+
+	// commands hold on to elems, so -A waits for them, except for sleep
+	// which touches none and would hold reclaiming off for as long
+	if(ret >= 0){
+		batch_cmd cmd = commands[ret].cmd;
+		bool hold = cmd != cmd_sleep;
+		if(hold)
+			poller_hold(b->poller);
+
+		ret = cmd(b, argc, argv);
+		if(hold)
+			poller_release(b->poller);
+	}
+
+	b->commands++;
+	if(ret < 0){
+		b->errors++;
+		fprintf(stderr, "%s:%zu: %s\n", b->file, b->line, SDL_GetError());
+	}
+
+	return ret;
+}
+
+int run_batch_line(batch *b, char *line){
+	if(b->poller)
+		poller_dispatch(b->poller);
+
+	char *argv[BATCH_MAX_ARGS];
+	int argc = split_args(line, argv);
+
+	if(argc == 0)
+		return 0;
+
+	if(argc < 0){
+		b->commands++;
+		b->errors++;
+		fprintf(stderr, "%s:%zu: %s\n", b->file, b->line, SDL_GetError());
+		return -1;
+	}
+
+	return run_batch_args(b, argc, argv);
+}
+
+int run_batch_file(batch *b, FILE *f, const char *file){
+	// lines are short, so a big buffer lets stdio pull in many commands
+	// per read() when a harness is piping them in
+	setvbuf(f, NULL, _IOFBF, 1 << 16);
+
+	b->file = file;
+	b->line = 0;
+
+	char line[1024];
+	while(fgets(line, sizeof(line), f)){
+		b->line++;
+
+		if(!strchr(line, '\n') && !feof(f)){
+			fprintf(stderr, "%s:%zu: Line too long.\n", file, b->line);
+			b->errors++;
+
+			int c;
+			while((c = fgetc(f)) != '\n' && c != EOF);
+			continue;
+		}
+
+		run_batch_line(b, line);
+	}
+
+	return b->errors ? -1 : 0;
+}
@@ -0,0 +1,64 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+#include "effect.h"
+#include "device.h"
+#include "mixer.h"
+#include "morph.h"
+#include "slots.h"
+#include "poller.h"
+#include "preset.h"
+
+#define BATCH_MAX_ARGS 64
+
+typedef struct {
+	haptic_device *haptic;
+	effect_slots *slots;
+	effect_mask supported_effects;
+
+	// when set, effects are created in the mixer instead of on the device
+	mixer *mixer;
+
+	// when set, its events are dispatched before each command
+	status_poller *poller;
+
+	// where the preset command looks effects up, can be NULL
+	preset_library *presets;
+
+	// what the device command picks devices from, NULL without a rig
+	haptic_device *rig;
+
+	// what the morph command hands effects to, can be NULL
+	morpher *morph;
+
+	// used for error messages only
+	const char *file;
+	size_t line;
+
+	size_t commands;
+	size_t errors;
+} batch;
+
+void init_batch(batch *b, effect_slots *slots, effect_mask supported_effects);
+
+// splits line in place on whitespace, up to a # comment
+int split_args(char *line, char *argv[]);
+
+// builds an effect from "<type> [param=value ...]"
+int parse_effect_args(int argc, char *argv[], SDL_HapticEffect *effect);
+
+// the same for a whole "create <name> <type> [priority=n] [param=value ...]"
+int parse_create_args(int argc, char *argv[], SDL_HapticEffect *effect, int *priority);
+
+haptic_elem *find_named_elem(batch *b, const char *name);
+
+// checks argv names a command and has the right number of arguments for it
+int check_batch_args(int argc, char *argv[]);
+
+// runs an already split command, argv may be modified
+int run_batch_args(batch *b, int argc, char *argv[]);
+int run_batch_line(batch *b, char *line);
+int run_batch_file(batch *b, FILE *f, const char *file);
+
+#endif /* BATCH_H */
@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "calibrate.h"
+#include "effect.h"
+#include "hist.h"
+#include "timing.h"
+
+enum {
+	METHOD_NEW_RUN,
+	METHOD_UPDATE,
+	NUM_METHODS,
+};
+
+static const char *method_names[NUM_METHODS] = {
+	"new+run",
+	"update",
+};
+
+static const uint16_t step_types[] = {
+	SDL_HAPTIC_CONSTANT,
+	SDL_HAPTIC_RAMP,
+};
+
+#define NUM_TYPES (sizeof(step_types) / sizeof(step_types[0]))
+
+typedef struct {
+	uint16_t type;
+	bool supported;
+
+	// left running at zero for updates to step
+	int idle_id;
+
+	hist latency[NUM_METHODS];
+	uint64_t timeouts[NUM_METHODS];
+	uint64_t errors[NUM_METHODS];
+} step_stats;
+
+void default_calibrate_options(calibrate_options *opts){
+	opts->trials = 0;
+	opts->level = CALIBRATE_DEFAULT_LEVEL;
+	opts->threshold = CALIBRATE_DEFAULT_THRESHOLD;
+	opts->timeout = CALIBRATE_DEFAULT_TIMEOUT;
+	opts->settle = CALIBRATE_DEFAULT_SETTLE;
+}
+
+// a force that comes on fully at once and stays until it's taken off
+static void step_effect(SDL_HapticEffect *effect, uint16_t type, int16_t level){
+	init_effect(effect, type);
+
+	if(type == SDL_HAPTIC_CONSTANT){
+		effect->constant.length = SDL_HAPTIC_INFINITY;
+		effect->constant.level = level;
+	} else {
+		effect->ramp.length = SDL_HAPTIC_INFINITY;
+		effect->ramp.start = level;
+		effect->ramp.end = level;
+	}
+}
+
+static int read_axis(SDL_Joystick *joy){
+	SDL_JoystickUpdate();
+	return SDL_JoystickGetAxis(joy, 0);
+}
+
+// waits out the settle time and then until the wheel stops moving, gives
+// up after a second so a wheel that's being held doesn't stall everything
+static void wait_still(SDL_Joystick *joy, const calibrate_options *opts){
+	SDL_Delay(opts->settle);
+
+	int pos = read_axis(joy);
+	for(int i = 0; i < 100; ++i){
+		SDL_Delay(10);
+
+		int p = read_axis(joy);
+		if(abs(p - pos) <= opts->threshold / 4)
+			return;
+
+		pos = p;
+	}
+}
+
+// nanoseconds from start until the axis is threshold away from rest, 0 if
+// it never gets there
+static uint64_t wait_motion(SDL_Joystick *joy, int rest, uint64_t start,
+		const calibrate_options *opts){
+	uint64_t timeout = start + opts->timeout * 1000000ULL;
+
+	for(;;){
+		int p = read_axis(joy);
+		uint64_t now = mono_ns();
+		if(abs(p - rest) >= opts->threshold)
+			return now - start;
+
+		if(now > timeout)
+			return 0;
+	}
+}
+
+static void run_trial(haptic_device *haptic, SDL_Joystick *joy, step_stats *s,
+		int method, int16_t level, const calibrate_options *opts){
+	SDL_HapticEffect effect;
+	step_effect(&effect, s->type, level);
+
+	// devices are polled on a fixed interval, so start at random points in
+	// it instead of always the same distance from the last poll
+	sleep_until_mono(mono_ns() + rand() % 1000000);
+	int rest = read_axis(joy);
+
+	uint64_t start = mono_ns();
+	int id = -1, ret;
+	if(method == METHOD_NEW_RUN){
+		id = haptic_new_effect(haptic, &effect);
+		ret = id < 0 ? -1 : haptic_run_effect(haptic, id, 1);
+	} else {
+		ret = haptic_update_effect(haptic, s->idle_id, &effect);
+	}
+
+	uint64_t latency = ret ? 0 : wait_motion(joy, rest, start, opts);
+
+	if(ret){
+		fprintf(stderr, "%s %s: %s\n", get_haptic_type_name(s->type),
+				method_names[method], SDL_GetError());
+		s->errors[method]++;
+	} else if(!latency){
+		s->timeouts[method]++;
+	} else {
+		hist_add(&s->latency[method], latency);
+	}
+
+	// and take the force off again
+	if(id >= 0){
+		haptic_stop_effect(haptic, id);
+		haptic_destroy_effect(haptic, id);
+	}
+
+	if(method == METHOD_UPDATE){
+		step_effect(&effect, s->type, 0);
+		haptic_update_effect(haptic, s->idle_id, &effect);
+	}
+}
+
+static void print_results(haptic_device *haptic, step_stats *stats,
+		const calibrate_options *opts){
+	printf("Force latency on %s, %u units of movement:\n", haptic->name, opts->threshold);
+
+	const char *best_type = NULL, *best_method = NULL;
+	uint64_t best = UINT64_MAX;
+
+	for(size_t i = 0; i < NUM_TYPES; ++i){
+		step_stats *s = &stats[i];
+		if(!s->supported)
+			continue;
+
+		for(int m = 0; m < NUM_METHODS; ++m){
+			char name[64];
+			snprintf(name, sizeof(name), "%s %s", get_haptic_type_name(s->type),
+					method_names[m]);
+			hist_print(stdout, name, &s->latency[m]);
+
+			if(s->timeouts[m] || s->errors[m])
+				printf("  %llu timeouts, %llu errors\n",
+						(unsigned long long)s->timeouts[m],
+						(unsigned long long)s->errors[m]);
+
+			if(!s->latency[m].count)
+				continue;
+
+			uint64_t p50 = hist_percentile(&s->latency[m], 50);
+			if(p50 < best){
+				best = p50;
+				best_type = get_haptic_type_name(s->type);
+				best_method = method_names[m];
+			}
+		}
+	}
+
+	if(best_type)
+		printf("Fastest: %s %s, p50 %.1fus\n", best_type, best_method, best / 1000.0);
+	else
+		puts("The wheel never moved, try a lower threshold or a higher level.");
+}
+
+int calibrate_latency(haptic_device *haptic, SDL_Joystick *joy,
+		const calibrate_options *opts){
+	if(!opts->trials)
+		return SDL_SetError("No trials to run.");
+
+	unsigned int supported = haptic_query(haptic);
+	if(!(supported & SDL_HAPTIC_CONSTANT))
+		return SDL_SetError("%s can't play constant effects.", haptic->name);
+
+	step_stats stats[NUM_TYPES] = {0};
+	int ret = 0;
+
+	for(size_t i = 0; i < NUM_TYPES; ++i){
+		step_stats *s = &stats[i];
+		s->type = step_types[i];
+		s->idle_id = -1;
+
+		for(int m = 0; m < NUM_METHODS; ++m)
+			hist_init(&s->latency[m]);
+
+		if(!(supported & s->type))
+			continue;
+
+		SDL_HapticEffect effect;
+		step_effect(&effect, s->type, 0);
+		s->idle_id = haptic_new_effect(haptic, &effect);
+		if(s->idle_id < 0 || haptic_run_effect(haptic, s->idle_id, 1)){
+			ret = -1;
+			goto out;
+		}
+
+		s->supported = true;
+	}
+
+	printf("Calibrating %s, %u trials of %i...\n", haptic->name, opts->trials, opts->level);
+	fflush(stdout);
+
+	// only busy polling in between, but it should get the core to itself
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+	wait_still(joy, opts);
+
+	for(unsigned i = 0; i < opts->trials; ++i){
+		int16_t level = i % 2 ? -opts->level : opts->level;
+
+		for(size_t t = 0; t < NUM_TYPES; ++t){
+			if(!stats[t].supported)
+				continue;
+
+			for(int m = 0; m < NUM_METHODS; ++m){
+				run_trial(haptic, joy, &stats[t], m, level, opts);
+				wait_still(joy, opts);
+			}
+		}
+
+		fprintf(stderr, "\r%u/%u", i + 1, opts->trials);
+	}
+
+	fputs("\n", stderr);
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_NORMAL);
+	print_results(haptic, stats, opts);
+
+out:
+	for(size_t i = 0; i < NUM_TYPES; ++i){
+		if(stats[i].idle_id < 0)
+			continue;
+
+		haptic_stop_effect(haptic, stats[i].idle_id);
+		haptic_destroy_effect(haptic, stats[i].idle_id);
+	}
+
+	return ret;
+}
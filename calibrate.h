@@ -0,0 +1,43 @@
+#ifndef CALIBRATE_H
+#define CALIBRATE_H
+
+#include <stdint.h>
+#include <SDL2/SDL.h>
+#include "device.h"
+
+// Measures how long it really takes from asking for a force to the wheel
+// moving. Each trial steps a force on and busy polls the joystick's first
+// axis until it has moved threshold units from where it was resting, then
+// takes the force off and waits for the wheel to settle again. Steps
+// alternate direction so the wheel doesn't walk off to one end.
+//
+// Every effect type that can make a step, constant and ramp, is timed
+// both ways a force can be put on a device: creating and running a new
+// effect, and updating one that's already running at zero. Trials go
+// round all of them in turn, so anything that drifts over the run hits
+// each the same.
+
+#define CALIBRATE_DEFAULT_LEVEL 16384
+#define CALIBRATE_DEFAULT_THRESHOLD 1000
+#define CALIBRATE_DEFAULT_TIMEOUT 500
+#define CALIBRATE_DEFAULT_SETTLE 300
+
+typedef struct {
+	unsigned trials;
+	// force of the step
+	int16_t level;
+	// axis units the wheel has to move to count
+	uint16_t threshold;
+	// ms to wait for movement before giving up on a trial
+	unsigned timeout;
+	// ms to wait after taking the force off
+	unsigned settle;
+} calibrate_options;
+
+void default_calibrate_options(calibrate_options *opts);
+
+// prints a latency histogram for each effect type and method to stdout
+int calibrate_latency(haptic_device *haptic, SDL_Joystick *joy,
+		const calibrate_options *opts);
+
+#endif /* CALIBRATE_H */
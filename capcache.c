@@ -0,0 +1,366 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "capcache.h"
+
+#define CAPCACHE_MAX_ENTRIES 64
+#define GUID_LEN 33
+
+typedef struct {
+	char guid[GUID_LEN];
+	char name[128];
+	device_caps caps;
+} cache_entry;
+
+typedef struct {
+	int index;
+	char *path;
+	cache_entry entry;
+	bool hit;
+
+	SDL_Thread *thread;
+	// held while caps change and until the device is open
+	SDL_mutex *lock;
+	SDL_cond *opened;
+	bool done;
+	haptic_device *inner;
+	char error[256];
+} cached_device;
+
+char *default_capcache_path(){
+	char *dir = SDL_GetPrefPath("ffbsdl", "ffbsdl");
+	if(!dir)
+		return NULL;
+
+	size_t len = strlen(dir) + sizeof("caps");
+	char *path = malloc(len);
+	if(path)
+		snprintf(path, len, "%scaps", dir);
+
+	SDL_free(dir);
+	return path;
+}
+
+// Each line is "guid query effects playing axes name", tab separated, with
+// the name last so it can hold spaces.
+static int load_entries(const char *path, cache_entry *entries){
+	FILE *f = fopen(path, "r");
+	if(!f)
+		return 0;
+
+	char line[512];
+	int n = 0;
+	while(n < CAPCACHE_MAX_ENTRIES && fgets(line, sizeof(line), f)){
+		cache_entry *e = &entries[n];
+		int name = 0;
+
+		if(line[0] == '#' || sscanf(line, "%32[^\t]\t%x\t%i\t%i\t%i\t%n", e->guid,
+				&e->caps.query, &e->caps.num_effects, &e->caps.num_playing,
+				&e->caps.num_axes, &name) != 5 || !name)
+			continue;
+
+		line[strcspn(line, "\r\n")] = '\0';
+		snprintf(e->name, sizeof(e->name), "%s", line + name);
+		n++;
+	}
+
+	fclose(f);
+	return n;
+}
+
+static bool same_device(const cache_entry *a, const cache_entry *b){
+	return !strcmp(a->guid, b->guid) && !strcmp(a->name, b->name);
+}
+
+// rewrites the whole file through a temporary one, so a crash or a second
+// ffbsdl never leaves half a cache behind
+static int save_entry(const char *path, const cache_entry *entry){
+	cache_entry entries[CAPCACHE_MAX_ENTRIES];
+	int n = load_entries(path, entries);
+
+	int i = 0;
+	while(i < n && !same_device(&entries[i], entry))
+		i++;
+
+	// forget the device seen longest ago to make room
+	if(i == CAPCACHE_MAX_ENTRIES){
+		memmove(entries, entries + 1, (n - 1) * sizeof(*entries));
+		i = --n;
+	}
+
+	entries[i] = *entry;
+	if(i == n)
+		n++;
+
+	char tmp[1024];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	FILE *f = fopen(tmp, "w");
+	if(!f)
+		return SDL_SetError("Couldn't write %s: %s", tmp, strerror(errno));
+
+	fputs("# ffbsdl capability cache: guid query effects playing axes name\n", f);
+	for(i = 0; i < n; ++i){
+		const cache_entry *e = &entries[i];
+		fprintf(f, "%s\t%#x\t%i\t%i\t%i\t%s\n", e->guid, e->caps.query,
+				e->caps.num_effects, e->caps.num_playing, e->caps.num_axes, e->name);
+	}
+
+	if(fclose(f))
+		return SDL_SetError("Couldn't write %s: %s", tmp, strerror(errno));
+
+#ifdef _WIN32
+	// rename() won't replace an existing file on Windows
+	remove(path);
+#endif
+
+	if(rename(tmp, path))
+		return SDL_SetError("Couldn't replace %s: %s", path, strerror(errno));
+
+	return 0;
+}
+
+static void probe(haptic_device *haptic, device_caps *caps){
+	caps->query = haptic_query(haptic);
+	caps->num_effects = haptic_num_effects(haptic);
+	caps->num_playing = haptic_num_playing(haptic);
+	caps->num_axes = haptic_num_axes(haptic);
+}
+
+// haptic devices don't have GUIDs of their own, the joystick of the same
+// name does
+static void get_guid(const char *name, char *guid){
+	strcpy(guid, "-");
+
+	for(int i = 0; i < SDL_NumJoysticks(); ++i){
+		const char *n = SDL_JoystickNameForIndex(i);
+		if(n && !strcmp(n, name)){
+			SDL_JoystickGetGUIDString(SDL_JoystickGetDeviceGUID(i), guid, GUID_LEN);
+			return;
+		}
+	}
+}
+
+static int open_thread(void *data){
+	cached_device *c = data;
+
+	haptic_device *inner = open_sdl_device(c->index);
+	device_caps caps;
+	if(inner)
+		probe(inner, &caps);
+
+	SDL_LockMutex(c->lock);
+	device_caps cached = c->entry.caps;
+	bool changed = inner && memcmp(&caps, &cached, sizeof(caps));
+	if(inner)
+		c->entry.caps = caps;
+	else
+		snprintf(c->error, sizeof(c->error), "%s", SDL_GetError());
+
+	c->inner = inner;
+	c->done = true;
+	SDL_CondBroadcast(c->opened);
+	cache_entry entry = c->entry;
+	SDL_UnlockMutex(c->lock);
+
+	if(!inner)
+		fprintf(stderr, "Couldn't open haptic device: %s\n", c->error);
+
+	if(changed){
+		fprintf(stderr, "%s isn't what the capability cache said, updating it.\n", entry.name);
+		if(caps.num_effects != cached.num_effects)
+			fprintf(stderr, "It has %i effect slots instead of %i, restart to use them.\n",
+					caps.num_effects, cached.num_effects);
+
+		if(save_entry(c->path, &entry))
+			fprintf(stderr, "%s\n", SDL_GetError());
+	}
+
+	return 0;
+}
+
+static haptic_device *wait_open(cached_device *c){
+	SDL_LockMutex(c->lock);
+	while(!c->done)
+		SDL_CondWait(c->opened, c->lock);
+	SDL_UnlockMutex(c->lock);
+
+	if(!c->inner)
+		SDL_SetError("Couldn't open %s: %s", c->entry.name, c->error);
+
+	return c->inner;
+}
+
+static int cached_new_effect(void *dev, SDL_HapticEffect *effect){
+	haptic_device *inner = wait_open(dev);
+	return inner ? haptic_new_effect(inner, effect) : -1;
+}
+
+static int cached_update_effect(void *dev, int id, SDL_HapticEffect *effect){
+	haptic_device *inner = wait_open(dev);
+	return inner ? haptic_update_effect(inner, id, effect) : -1;
+}
+
+static int cached_run_effect(void *dev, int id, Uint32 iterations){
+	haptic_device *inner = wait_open(dev);
+	return inner ? haptic_run_effect(inner, id, iterations) : -1;
+}
+
+static int cached_stop_effect(void *dev, int id){
+	haptic_device *inner = wait_open(dev);
+	return inner ? haptic_stop_effect(inner, id) : -1;
+}
+
+static void cached_destroy_effect(void *dev, int id){
+	haptic_device *inner = wait_open(dev);
+	if(inner)
+		haptic_destroy_effect(inner, id);
+}
+
+static int cached_effect_status(void *dev, int id){
+	haptic_device *inner = wait_open(dev);
+	return inner ? haptic_effect_status(inner, id) : -1;
+}
+
+static int cached_set_gain(void *dev, int gain){
+	haptic_device *inner = wait_open(dev);
+	return inner ? haptic_set_gain(inner, gain) : -1;
+}
+
+static int cached_set_autocenter(void *dev, int autocenter){
+	haptic_device *inner = wait_open(dev);
+	return inner ? haptic_set_autocenter(inner, autocenter) : -1;
+}
+
+#define CAP(field) \
+	cached_device *c = dev; \
+	SDL_LockMutex(c->lock); \
+	int v = c->entry.caps.field; \
+	SDL_UnlockMutex(c->lock); \
+	return v
+
+static unsigned int cached_query(void *dev){
+	CAP(query);
+}
+
+static int cached_num_effects(void *dev){
+	CAP(num_effects);
+}
+
+static int cached_num_playing(void *dev){
+	CAP(num_playing);
+}
+
+static int cached_num_axes(void *dev){
+	CAP(num_axes);
+}
+
+#undef CAP
+
+static void cached_close(void *dev){
+	cached_device *c = dev;
+
+	// can't interrupt an open in progress, wait it out
+	if(c->thread)
+		SDL_WaitThread(c->thread, NULL);
+
+	if(c->inner)
+		close_device(c->inner);
+
+	SDL_DestroyCond(c->opened);
+	SDL_DestroyMutex(c->lock);
+	free(c->path);
+	free(c);
+}
+
+static const haptic_backend cached_backend = {
+	.name = "cached",
+	.new_effect = cached_new_effect,
+	.update_effect = cached_update_effect,
+	.run_effect = cached_run_effect,
+	.stop_effect = cached_stop_effect,
+	.destroy_effect = cached_destroy_effect,
+	.effect_status = cached_effect_status,
+	.set_gain = cached_set_gain,
+	.set_autocenter = cached_set_autocenter,
+	.query = cached_query,
+	.num_effects = cached_num_effects,
+	.num_playing = cached_num_playing,
+	.num_axes = cached_num_axes,
+	.close = cached_close,
+};
+
+haptic_device *open_cached_device(int index, const char *path){
+	const char *name = SDL_HapticName(index);
+	if(!name)
+		return NULL;
+
+	cached_device *c = calloc(1, sizeof(*c));
+	if(!c){
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	c->index = index;
+	c->path = malloc(strlen(path) + 1);
+	if(c->path)
+		strcpy(c->path, path);
+
+	c->lock = SDL_CreateMutex();
+	c->opened = SDL_CreateCond();
+	if(!c->path || !c->lock || !c->opened){
+		SDL_SetError("Out of memory.");
+		goto err;
+	}
+
+	snprintf(c->entry.name, sizeof(c->entry.name), "%s", name);
+	get_guid(name, c->entry.guid);
+
+	cache_entry entries[CAPCACHE_MAX_ENTRIES];
+	int n = load_entries(path, entries);
+	for(int i = 0; i < n && !c->hit; ++i){
+		if(same_device(&entries[i], &c->entry)){
+			c->entry.caps = entries[i].caps;
+			c->hit = true;
+		}
+	}
+
+	if(c->hit){
+		c->thread = SDL_CreateThread(open_thread, "capcache", c);
+		if(!c->thread)
+			goto err;
+	} else {
+		c->inner = open_sdl_device(index);
+		if(!c->inner)
+			goto err;
+
+		probe(c->inner, &c->entry.caps);
+		c->done = true;
+
+		// the device works fine without, just slower to start next time
+		if(save_entry(path, &c->entry))
+			fprintf(stderr, "%s\n", SDL_GetError());
+	}
+
+	haptic_device *haptic = open_device(&cached_backend, c, name);
+	if(!haptic){
+		cached_close(c);
+		return NULL;
+	}
+
+	return haptic;
+
+err:
+	if(c->opened)
+		SDL_DestroyCond(c->opened);
+	if(c->lock)
+		SDL_DestroyMutex(c->lock);
+	free(c->path);
+	free(c);
+	return NULL;
+}
+
+bool from_capcache(haptic_device *haptic){
+	return haptic->backend == &cached_backend && ((cached_device *)haptic->dev)->hit;
+}
@@ -0,0 +1,32 @@
+#ifndef CAPCACHE_H
+#define CAPCACHE_H
+
+#include <stdbool.h>
+#include "device.h"
+
+// Opening a haptic device and finding out what it can do is slow on some
+// devices and gives the same answer every time, so what they could do last
+// time is kept in a small file keyed by device name and joystick GUID.
+
+typedef struct {
+	unsigned int query;
+	int num_effects;
+	int num_playing;
+	int num_axes;
+} device_caps;
+
+// the cache in SDL's per user preferences directory, free with free()
+char *default_capcache_path();
+
+// Opens SDL haptic device index behind a backend that answers capability
+// queries from the cache at path. If the device is in the cache this
+// returns right away and the device is opened and probed on a thread:
+// effect calls wait for it to be open and the cache is rewritten if the
+// device changed. Otherwise the device is opened and probed as usual and
+// added to the cache.
+haptic_device *open_cached_device(int index, const char *path);
+
+// whether haptic is a cached device that started from the cache
+bool from_capcache(haptic_device *haptic);
+
+#endif /* CAPCACHE_H */
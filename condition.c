@@ -0,0 +1,435 @@
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "condition.h"
+#include "effect.h"
+#include "hist.h"
+#include "timing.h"
+#include "update.h"
+
+// time constants of the filters smoothing the velocity and acceleration
+// worked out from axis positions, which are only 16 bits
+#define VELOCITY_TAU 0.005f
+#define ACCEL_TAU 0.010f
+
+typedef struct {
+	SDL_HapticCondition c;
+	uint64_t start;
+	Uint32 iterations;
+	bool used;
+	bool playing;
+} soft_effect;
+
+typedef struct {
+	haptic_device *inner;
+	SDL_Joystick *joy;
+	effect_mask emulated;
+	uint64_t period;
+
+	// the constant effect on inner that plays the sum
+	haptic_elem out;
+
+	// the backend's callers hold the wrapper's lock, but the thread
+	// doesn't, so the effects have their own
+	SDL_mutex *lock;
+	soft_effect effects[CONDITION_MAX_EFFECTS];
+
+	SDL_Thread *thread;
+	atomic_bool stop;
+
+	// written by the thread, read once it has stopped
+	hist periods;
+	hist late;
+	hist ticks;
+	uint64_t missed;
+} cond_engine;
+
+static bool is_soft(cond_engine *e, int id){
+	return id >= CONDITION_ID_BASE && id < CONDITION_ID_BASE + CONDITION_MAX_EFFECTS;
+}
+
+// whether e should be playing at now, stopping it if it's done
+static bool soft_active(soft_effect *e, uint64_t now){
+	if(!e->playing)
+		return false;
+
+	uint64_t delay = e->c.delay * 1000000ULL;
+	if(now < e->start + delay)
+		return false;
+
+	if(e->c.length == SDL_HAPTIC_INFINITY || e->iterations == SDL_HAPTIC_INFINITY)
+		return true;
+
+	if(now < e->start + delay + (uint64_t)e->c.length * e->iterations * 1000000)
+		return true;
+
+	e->playing = false;
+	return false;
+}
+
+static float clampf(float v, float lo, float hi){
+	return v < lo ? lo : v > hi ? hi : v;
+}
+
+// x is position, velocity or acceleration, scaled so the full coefficient
+// applies at 1
+static float condition_force(const SDL_HapticCondition *c, float x, bool friction){
+	float d = x - c->center[0] / 32767.0f;
+	float deadband = c->deadband[0] / 65535.0f;
+	float f;
+
+	if(d > deadband){
+		f = c->right_coeff[0] / 32767.0f;
+		f = friction ? -f : -f * (d - deadband);
+		return clampf(f, -c->right_sat[0] / 65535.0f, c->right_sat[0] / 65535.0f);
+	}
+
+	if(d < -deadband){
+		f = c->left_coeff[0] / 32767.0f;
+		f = friction ? f : -f * (d + deadband);
+		return clampf(f, -c->left_sat[0] / 65535.0f, c->left_sat[0] / 65535.0f);
+	}
+
+	return 0;
+}
+
+static float mix_conditions(cond_engine *e, uint64_t now, float pos, float vel, float accel){
+	float force = 0;
+
+	SDL_LockMutex(e->lock);
+	for(size_t i = 0; i < CONDITION_MAX_EFFECTS; ++i){
+		soft_effect *s = &e->effects[i];
+		if(!s->used || !soft_active(s, now))
+			continue;
+
+		switch(s->c.type){
+		case SDL_HAPTIC_SPRING:
+			force += condition_force(&s->c, pos, false);
+			break;
+
+		case SDL_HAPTIC_DAMPER:
+			force += condition_force(&s->c, vel / CONDITION_VELOCITY_SCALE, false);
+			break;
+
+		case SDL_HAPTIC_FRICTION:
+			force += condition_force(&s->c, vel / CONDITION_VELOCITY_SCALE, true);
+			break;
+
+		case SDL_HAPTIC_INERTIA:
+			force += condition_force(&s->c, accel / CONDITION_ACCEL_SCALE, false);
+			break;
+		}
+	}
+	SDL_UnlockMutex(e->lock);
+
+	return clampf(force, -1, 1);
+}
+
+static int condition_thread(void *data){
+	cond_engine *e = data;
+
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL);
+
+	float pos = 0, vel = 0, accel = 0;
+	bool first = true;
+	uint64_t deadline = mono_ns();
+	uint64_t last = deadline;
+
+	while(!atomic_load(&e->stop)){
+		uint64_t now = mono_ns();
+		hist_add(&e->late, now - deadline);
+		if(!first)
+			hist_add(&e->periods, now - last);
+
+		SDL_JoystickUpdate();
+		float p = SDL_JoystickGetAxis(e->joy, 0) / 32767.0f;
+
+		// in full axis ranges per second, the axis being 2 wide
+		float dt = (now - last) / 1e9f;
+		if(!first && dt > 0){
+			float v = vel + ((p - pos) / 2 / dt - vel) * (1 - expf(-dt / VELOCITY_TAU));
+			float a = (v - vel) / dt;
+			vel = v;
+			accel += (a - accel) * (1 - expf(-dt / ACCEL_TAU));
+		}
+
+		pos = p;
+		last = now;
+		first = false;
+
+		float force = mix_conditions(e, now, pos, vel, accel);
+		e->out.effect.constant.level = lrintf(force * 32767);
+		queue_update(&e->out);
+		flush_updates(e->inner, 1, &e->out);
+		hist_add(&e->ticks, mono_ns() - now);
+
+		deadline += e->period;
+		now = mono_ns();
+		if(deadline < now){
+			e->missed++;
+			deadline = now;
+		}
+
+		sleep_until_mono(deadline);
+	}
+
+	return 0;
+}
+
+static int cond_new_effect(void *dev, SDL_HapticEffect *effect){
+	cond_engine *e = dev;
+	if(!(effect->type & e->emulated))
+		return haptic_new_effect(e->inner, effect);
+
+	SDL_LockMutex(e->lock);
+	for(int i = 0; i < CONDITION_MAX_EFFECTS; ++i){
+		soft_effect *s = &e->effects[i];
+		if(s->used)
+			continue;
+
+		memset(s, 0, sizeof(*s));
+		s->c = effect->condition;
+		s->used = true;
+		SDL_UnlockMutex(e->lock);
+		return CONDITION_ID_BASE + i;
+	}
+	SDL_UnlockMutex(e->lock);
+
+	return SDL_SetError("All %i software condition effects are in use.",
+			CONDITION_MAX_EFFECTS);
+}
+
+static soft_effect *get_soft(cond_engine *e, int id){
+	soft_effect *s = &e->effects[id - CONDITION_ID_BASE];
+	if(!s->used){
+		SDL_SetError("No software effect %i.", id);
+		return NULL;
+	}
+
+	return s;
+}
+
+static int cond_update_effect(void *dev, int id, SDL_HapticEffect *effect){
+	cond_engine *e = dev;
+	if(!is_soft(e, id))
+		return haptic_update_effect(e->inner, id, effect);
+
+	SDL_LockMutex(e->lock);
+	soft_effect *s = get_soft(e, id);
+	int ret = -1;
+	if(s && s->c.type != effect->type)
+		SDL_SetError("Can't change the type of effect %i.", id);
+	else if(s){
+		s->c = effect->condition;
+		ret = 0;
+	}
+	SDL_UnlockMutex(e->lock);
+
+	return ret;
+}
+
+static int cond_run_effect(void *dev, int id, Uint32 iterations){
+	cond_engine *e = dev;
+	if(!is_soft(e, id))
+		return haptic_run_effect(e->inner, id, iterations);
+
+	SDL_LockMutex(e->lock);
+	soft_effect *s = get_soft(e, id);
+	if(s){
+		s->start = mono_ns();
+		s->iterations = iterations;
+		s->playing = true;
+	}
+	SDL_UnlockMutex(e->lock);
+
+	return s ? 0 : -1;
+}
+
+static int cond_stop_effect(void *dev, int id){
+	cond_engine *e = dev;
+	if(!is_soft(e, id))
+		return haptic_stop_effect(e->inner, id);
+
+	SDL_LockMutex(e->lock);
+	soft_effect *s = get_soft(e, id);
+	if(s)
+		s->playing = false;
+	SDL_UnlockMutex(e->lock);
+
+	return s ? 0 : -1;
+}
+
+static void cond_destroy_effect(void *dev, int id){
+	cond_engine *e = dev;
+	if(!is_soft(e, id)){
+		haptic_destroy_effect(e->inner, id);
+		return;
+	}
+
+	SDL_LockMutex(e->lock);
+	e->effects[id - CONDITION_ID_BASE].used = false;
+	SDL_UnlockMutex(e->lock);
+}
+
+static int cond_effect_status(void *dev, int id){
+	cond_engine *e = dev;
+	if(!is_soft(e, id))
+		return haptic_effect_status(e->inner, id);
+
+	SDL_LockMutex(e->lock);
+	soft_effect *s = get_soft(e, id);
+	int ret = s ? soft_active(s, mono_ns()) : -1;
+	SDL_UnlockMutex(e->lock);
+
+	return ret;
+}
+
+static int cond_set_gain(void *dev, int gain){
+	return haptic_set_gain(((cond_engine *)dev)->inner, gain);
+}
+
+static int cond_set_autocenter(void *dev, int autocenter){
+	return haptic_set_autocenter(((cond_engine *)dev)->inner, autocenter);
+}
+
+static unsigned int cond_query(void *dev){
+	cond_engine *e = dev;
+	return haptic_query(e->inner) | e->emulated;
+}
+
+static int cond_num_effects(void *dev){
+	// one of the real ones is busy playing the conditions
+	int n = haptic_num_effects(((cond_engine *)dev)->inner);
+	return n < 0 ? n : n - 1 + CONDITION_MAX_EFFECTS;
+}
+
+static int cond_num_playing(void *dev){
+	cond_engine *e = dev;
+	int n = haptic_num_playing(e->inner);
+	if(n < 0)
+		return n;
+
+	n--;
+
+	uint64_t now = mono_ns();
+	SDL_LockMutex(e->lock);
+	for(size_t i = 0; i < CONDITION_MAX_EFFECTS; ++i)
+		n += e->effects[i].used && soft_active(&e->effects[i], now);
+	SDL_UnlockMutex(e->lock);
+
+	return n;
+}
+
+static int cond_num_axes(void *dev){
+	return haptic_num_axes(((cond_engine *)dev)->inner);
+}
+
+static void cond_close(void *dev){
+	cond_engine *e = dev;
+
+	atomic_store(&e->stop, true);
+	SDL_WaitThread(e->thread, NULL);
+
+	fprintf(stderr, "conditions: %llu late ticks\n", (unsigned long long)e->missed);
+	hist_print(stderr, "condition period", &e->periods);
+	hist_print(stderr, "condition late", &e->late);
+	hist_print(stderr, "condition tick", &e->ticks);
+
+	haptic_destroy_effect(e->inner, e->out.id);
+	close_device(e->inner);
+	SDL_DestroyMutex(e->lock);
+	free(e);
+}
+
+static const haptic_backend cond_backend = {
+	.name = "conditions",
+	.new_effect = cond_new_effect,
+	.update_effect = cond_update_effect,
+	.run_effect = cond_run_effect,
+	.stop_effect = cond_stop_effect,
+	.destroy_effect = cond_destroy_effect,
+	.effect_status = cond_effect_status,
+	.set_gain = cond_set_gain,
+	.set_autocenter = cond_set_autocenter,
+	.query = cond_query,
+	.num_effects = cond_num_effects,
+	.num_playing = cond_num_playing,
+	.num_axes = cond_num_axes,
+	.close = cond_close,
+};
+
+haptic_device *wrap_conditions(haptic_device *inner, SDL_Joystick *joy, unsigned hz){
+	if(!hz){
+		SDL_SetError("Condition rate must be positive.");
+		return NULL;
+	}
+
+	unsigned int supported = haptic_query(inner);
+	if(!(supported & SDL_HAPTIC_CONSTANT)){
+		SDL_SetError("%s can't play constant effects.", inner->name);
+		return NULL;
+	}
+
+	if(!(~supported & CONDITION_EFFECTS)){
+		SDL_SetError("%s already plays condition effects itself.", inner->name);
+		return NULL;
+	}
+
+	cond_engine *e = calloc(1, sizeof(*e));
+	if(!e){
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	e->inner = inner;
+	e->joy = joy;
+	e->emulated = ~supported & CONDITION_EFFECTS;
+	e->period = 1000000000 / hz;
+	hist_init(&e->periods);
+	hist_init(&e->late);
+	hist_init(&e->ticks);
+	atomic_init(&e->stop, false);
+
+	e->lock = SDL_CreateMutex();
+	if(!e->lock){
+		free(e);
+		return NULL;
+	}
+
+	init_effect(&e->out.effect, SDL_HAPTIC_CONSTANT);
+	e->out.effect.constant.length = SDL_HAPTIC_INFINITY;
+	e->out.effect.constant.level = 0;
+
+	e->out.id = haptic_new_effect(inner, &e->out.effect);
+	if(e->out.id < 0)
+		goto err;
+
+	mark_uploaded(&e->out);
+	e->out.active = true;
+
+	if(haptic_run_effect(inner, e->out.id, 1))
+		goto effect_err;
+
+	haptic_device *haptic = open_device(&cond_backend, e, inner->name);
+	if(!haptic)
+		goto effect_err;
+
+	e->thread = SDL_CreateThread(condition_thread, "conditions", e);
+	if(!e->thread){
+		// close_device() would try to stop the thread
+		SDL_DestroyMutex(haptic->lock);
+		free(haptic);
+		goto effect_err;
+	}
+
+	return haptic;
+
+effect_err:
+	haptic_destroy_effect(inner, e->out.id);
+err:
+	SDL_DestroyMutex(e->lock);
+	free(e);
+	return NULL;
+}
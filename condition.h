@@ -0,0 +1,34 @@
+#ifndef CONDITION_H
+#define CONDITION_H
+
+#include <SDL2/SDL.h>
+#include "device.h"
+
+// Plenty of devices can play a constant force but don't do spring, damper,
+// friction or inertia effects themselves. wrap_conditions() puts a device
+// behind a backend that plays those in software instead: a thread reads
+// where the joystick is hz times a second, works out the force every
+// playing condition effect would produce and streams the sum into a
+// constant effect on the real device. Everything else is passed through,
+// so slots, scripts and the menu can't tell the difference.
+//
+// Only the first axis of each condition is used, against the first axis
+// of the joystick, and forces push back towards center.
+
+#define CONDITION_MAX_EFFECTS 16
+
+// software effects get device ids from here up, well above what any real
+// device hands out
+#define CONDITION_ID_BASE 1024
+
+// velocity, in full axis ranges per second, that gets the full coefficient
+// from a damper, and the same for inertia's acceleration
+#define CONDITION_VELOCITY_SCALE 4.0f
+#define CONDITION_ACCEL_SCALE 100.0f
+
+// Closing the returned device closes inner too, joy has to stay open until
+// then. Fails if inner can already play every condition effect or can't
+// play constant ones.
+haptic_device *wrap_conditions(haptic_device *inner, SDL_Joystick *joy, unsigned hz);
+
+#endif /* CONDITION_H */
@@ -0,0 +1,257 @@
+#include <stdlib.h>
+#include <string.h>
+#include "device.h"
+#include "trace.h"
+#include "timing.h"
+
+static int sdl_new_effect(void *dev, SDL_HapticEffect *effect){
+	return SDL_HapticNewEffect(dev, effect);
+}
+
+static int sdl_update_effect(void *dev, int id, SDL_HapticEffect *effect){
+	return SDL_HapticUpdateEffect(dev, id, effect);
+}
+
+static int sdl_run_effect(void *dev, int id, Uint32 iterations){
+	return SDL_HapticRunEffect(dev, id, iterations);
+}
+
+static int sdl_stop_effect(void *dev, int id){
+	return SDL_HapticStopEffect(dev, id);
+}
+
+static void sdl_destroy_effect(void *dev, int id){
+	SDL_HapticDestroyEffect(dev, id);
+}
+
+static int sdl_effect_status(void *dev, int id){
+	return SDL_HapticGetEffectStatus(dev, id);
+}
+
+static int sdl_set_gain(void *dev, int gain){
+	return SDL_HapticSetGain(dev, gain);
+}
+
+static int sdl_set_autocenter(void *dev, int autocenter){
+	return SDL_HapticSetAutocenter(dev, autocenter);
+}
+
+static unsigned int sdl_query(void *dev){
+	return SDL_HapticQuery(dev);
+}
+
+static int sdl_num_effects(void *dev){
+	return SDL_HapticNumEffects(dev);
+}
+
+static int sdl_num_playing(void *dev){
+	return SDL_HapticNumEffectsPlaying(dev);
+}
+
+static int sdl_num_axes(void *dev){
+	return SDL_HapticNumAxes(dev);
+}
+
+static void sdl_close(void *dev){
+	SDL_HapticClose(dev);
+}
+
+static const haptic_backend sdl_backend = {
+	.name = "sdl",
+	.new_effect = sdl_new_effect,
+	.update_effect = sdl_update_effect,
+	.run_effect = sdl_run_effect,
+	.stop_effect = sdl_stop_effect,
+	.destroy_effect = sdl_destroy_effect,
+	.effect_status = sdl_effect_status,
+	.set_gain = sdl_set_gain,
+	.set_autocenter = sdl_set_autocenter,
+	.query = sdl_query,
+	.num_effects = sdl_num_effects,
+	.num_playing = sdl_num_playing,
+	.num_axes = sdl_num_axes,
+	.close = sdl_close,
+};
+
+haptic_device *open_device(const haptic_backend *backend, void *dev, const char *name){
+	haptic_device *haptic = calloc(1, sizeof(*haptic));
+	if(!haptic){
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	haptic->lock = SDL_CreateMutex();
+	if(!haptic->lock){
+		free(haptic);
+		return NULL;
+	}
+
+	haptic->backend = backend;
+	haptic->dev = dev;
+	haptic->gain = -1;
+	haptic->autocenter = -1;
+	strncpy(haptic->name, name ? name : "Unknown", sizeof(haptic->name) - 1);
+	return haptic;
+}
+
+haptic_device *open_sdl_device(int index){
+	SDL_Haptic *dev = SDL_HapticOpen(index);
+	if(!dev)
+		return NULL;
+
+	haptic_device *haptic = open_device(&sdl_backend, dev, SDL_HapticName(index));
+	if(!haptic)
+		SDL_HapticClose(dev);
+
+	return haptic;
+}
+
+void close_device(haptic_device *haptic){
+	stop_trace(haptic->trace);
+	haptic->backend->close(haptic->dev);
+	SDL_DestroyMutex(haptic->lock);
+	destroy_device_stats(haptic->stats);
+	free(haptic);
+}
+
+int enable_device_stats(haptic_device *haptic){
+	if(haptic->stats)
+		return 0;
+
+	device_stats *stats = create_device_stats();
+	if(!stats)
+		return -1;
+
+	SDL_LockMutex(haptic->lock);
+	haptic->stats = stats;
+	SDL_UnlockMutex(haptic->lock);
+	return 0;
+}
+
+int enable_device_trace(haptic_device *haptic, const char *path){
+	if(haptic->trace)
+		return 0;
+
+	trace_writer *trace = start_trace(path, haptic->name);
+	if(!trace)
+		return -1;
+
+	SDL_LockMutex(haptic->lock);
+	haptic->trace = trace;
+	SDL_UnlockMutex(haptic->lock);
+	return 0;
+}
+
+#define CALL(type, x) \
+	SDL_LockMutex(haptic->lock); \
+	type ret = haptic->backend->x; \
+	SDL_UnlockMutex(haptic->lock); \
+	return ret
+
+// without stats or a trace this is just CALL() plus a branch on each
+#define TIMED_CALL(call, x, id, arg, effect) \
+	SDL_LockMutex(haptic->lock); \
+	device_stats *stats = haptic->stats; \
+	trace_writer *trace = haptic->trace; \
+	uint64_t start = stats || trace ? now_ns() : 0; \
+	int ret = haptic->backend->x; \
+	if(stats) \
+		record_call(stats, call, now_ns() - start, ret < 0 ? SDL_GetError() : NULL); \
+	if(trace) \
+		trace_call(trace, call, start, id, arg, effect, ret); \
+	SDL_UnlockMutex(haptic->lock); \
+	return ret
+
+int haptic_new_effect(haptic_device *haptic, SDL_HapticEffect *effect){
+	TIMED_CALL(HCALL_NEW_EFFECT, new_effect(haptic->dev, effect), -1, 0, effect);
+}
+
+int haptic_update_effect(haptic_device *haptic, int id, SDL_HapticEffect *effect){
+	TIMED_CALL(HCALL_UPDATE_EFFECT, update_effect(haptic->dev, id, effect), id, 0, effect);
+}
+
+int haptic_run_effect(haptic_device *haptic, int id, Uint32 iterations){
+	TIMED_CALL(HCALL_RUN_EFFECT, run_effect(haptic->dev, id, iterations), id, iterations, NULL);
+}
+
+int haptic_stop_effect(haptic_device *haptic, int id){
+	TIMED_CALL(HCALL_STOP_EFFECT, stop_effect(haptic->dev, id), id, 0, NULL);
+}
+
+void haptic_destroy_effect(haptic_device *haptic, int id){
+	SDL_LockMutex(haptic->lock);
+	uint64_t start = haptic->stats || haptic->trace ? now_ns() : 0;
+	haptic->backend->destroy_effect(haptic->dev, id);
+	if(haptic->stats)
+		record_call(haptic->stats, HCALL_DESTROY_EFFECT, now_ns() - start, NULL);
+
+	if(haptic->trace)
+		trace_call(haptic->trace, HCALL_DESTROY_EFFECT, start, id, 0, NULL, 0);
+
+	SDL_UnlockMutex(haptic->lock);
+}
+
+int haptic_effect_status(haptic_device *haptic, int id){
+	TIMED_CALL(HCALL_EFFECT_STATUS, effect_status(haptic->dev, id), id, 0, NULL);
+}
+
+static int timed_set_gain(haptic_device *haptic, int gain){
+	TIMED_CALL(HCALL_SET_GAIN, set_gain(haptic->dev, gain), -1, gain, NULL);
+}
+
+static int timed_set_autocenter(haptic_device *haptic, int autocenter){
+	TIMED_CALL(HCALL_SET_AUTOCENTER, set_autocenter(haptic->dev, autocenter), -1, autocenter, NULL);
+}
+
+int haptic_set_gain(haptic_device *haptic, int gain){
+	SDL_LockMutex(haptic->lock);
+	int ret = timed_set_gain(haptic, gain);
+	if(!ret)
+		haptic->gain = gain;
+
+	SDL_UnlockMutex(haptic->lock);
+	return ret;
+}
+
+int haptic_set_autocenter(haptic_device *haptic, int autocenter){
+	SDL_LockMutex(haptic->lock);
+	int ret = timed_set_autocenter(haptic, autocenter);
+	if(!ret)
+		haptic->autocenter = autocenter;
+
+	SDL_UnlockMutex(haptic->lock);
+	return ret;
+}
+
+int haptic_get_gain(haptic_device *haptic){
+	SDL_LockMutex(haptic->lock);
+	int gain = haptic->gain;
+	SDL_UnlockMutex(haptic->lock);
+	return gain;
+}
+
+int haptic_get_autocenter(haptic_device *haptic){
+	SDL_LockMutex(haptic->lock);
+	int autocenter = haptic->autocenter;
+	SDL_UnlockMutex(haptic->lock);
+	return autocenter;
+}
+
+unsigned int haptic_query(haptic_device *haptic){
+	CALL(unsigned int, query(haptic->dev));
+}
+
+int haptic_num_effects(haptic_device *haptic){
+	CALL(int, num_effects(haptic->dev));
+}
+
+int haptic_num_playing(haptic_device *haptic){
+	CALL(int, num_playing(haptic->dev));
+}
+
+int haptic_num_axes(haptic_device *haptic){
+	CALL(int, num_axes(haptic->dev));
+}
+
+#undef TIMED_CALL
+#undef CALL
@@ -0,0 +1,79 @@
+#ifndef DEVICE_H
+#define DEVICE_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_haptic.h>
+#include "instrument.h"
+
+// Everything ffbsdl does to a device goes through a backend, so the same
+// code can drive a real SDL haptic device or the simulator in sim.c.
+typedef struct {
+	const char *name;
+
+	int (*new_effect)(void *dev, SDL_HapticEffect *effect);
+	int (*update_effect)(void *dev, int id, SDL_HapticEffect *effect);
+	int (*run_effect)(void *dev, int id, Uint32 iterations);
+	int (*stop_effect)(void *dev, int id);
+	void (*destroy_effect)(void *dev, int id);
+	int (*effect_status)(void *dev, int id);
+	int (*set_gain)(void *dev, int gain);
+	int (*set_autocenter)(void *dev, int autocenter);
+
+	unsigned int (*query)(void *dev);
+	int (*num_effects)(void *dev);
+	int (*num_playing)(void *dev);
+	int (*num_axes)(void *dev);
+
+	void (*close)(void *dev);
+} haptic_backend;
+
+typedef struct {
+	const haptic_backend *backend;
+	void *dev;
+	char name[128];
+
+	// SDL doesn't promise haptic calls are thread safe and the streaming
+	// and shared memory threads call in alongside the menu
+	SDL_mutex *lock;
+
+	// NULL unless enable_device_stats() was called
+	device_stats *stats;
+
+	// NULL unless enable_device_trace() was called, see trace.h
+	struct trace_writer *trace;
+
+	// last set successfully, devices can't be asked, -1 until then
+	int gain;
+	int autocenter;
+} haptic_device;
+
+haptic_device *open_device(const haptic_backend *backend, void *dev, const char *name);
+haptic_device *open_sdl_device(int index);
+
+// spec is a comma separated list of key=value pairs, see sim.c
+haptic_device *open_sim_device(const char *spec);
+void close_device(haptic_device *haptic);
+
+// starts timing every effect, gain and autocenter call on haptic
+int enable_device_stats(haptic_device *haptic);
+
+// starts recording every effect, gain and autocenter call on haptic to path
+int enable_device_trace(haptic_device *haptic, const char *path);
+
+int haptic_new_effect(haptic_device *haptic, SDL_HapticEffect *effect);
+int haptic_update_effect(haptic_device *haptic, int id, SDL_HapticEffect *effect);
+int haptic_run_effect(haptic_device *haptic, int id, Uint32 iterations);
+int haptic_stop_effect(haptic_device *haptic, int id);
+void haptic_destroy_effect(haptic_device *haptic, int id);
+int haptic_effect_status(haptic_device *haptic, int id);
+int haptic_set_gain(haptic_device *haptic, int gain);
+int haptic_set_autocenter(haptic_device *haptic, int autocenter);
+int haptic_get_gain(haptic_device *haptic);
+int haptic_get_autocenter(haptic_device *haptic);
+
+unsigned int haptic_query(haptic_device *haptic);
+int haptic_num_effects(haptic_device *haptic);
+int haptic_num_playing(haptic_device *haptic);
+int haptic_num_axes(haptic_device *haptic);
+
+#endif /* DEVICE_H */
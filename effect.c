@@ -0,0 +1,272 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include "effect.h"
+
+const char *get_haptic_type_name(uint16_t type){
+#define CASE(x) case SDL_HAPTIC_##x: return #x
+
+	switch(type){
+		CASE(CONSTANT);
+		CASE(SINE);
+		CASE(TRIANGLE);
+		CASE(SAWTOOTHUP);
+		CASE(SAWTOOTHDOWN);
+		CASE(RAMP);
+		CASE(SPRING);
+		CASE(DAMPER);
+		CASE(FRICTION);
+		CASE(INERTIA);
+		CASE(CUSTOM);
+	}
+
+	return "ERR";
+
+#undef CASE
+}
+
+uint16_t get_haptic_type(const char *name){
+	static const uint16_t types[] = {
+		SDL_HAPTIC_CONSTANT,
+		SDL_HAPTIC_SINE,
+		SDL_HAPTIC_TRIANGLE,
+		SDL_HAPTIC_SAWTOOTHUP,
+		SDL_HAPTIC_SAWTOOTHDOWN,
+		SDL_HAPTIC_RAMP,
+		SDL_HAPTIC_SPRING,
+		SDL_HAPTIC_DAMPER,
+		SDL_HAPTIC_FRICTION,
+		SDL_HAPTIC_INERTIA,
+	};
+
+	for(size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i){
+		if(!SDL_strcasecmp(name, get_haptic_type_name(types[i])))
+			return types[i];
+	}
+
+	return 0;
+}
+
+// defaults are the same ones the interactive prompts start from
+bool init_effect(SDL_HapticEffect *effect, uint16_t type){
+	memset(effect, 0, sizeof(*effect));
+
+	switch(type){
+	case SDL_HAPTIC_CONSTANT:
+		effect->constant.type = type;
+		effect->constant.direction.type = SDL_HAPTIC_CARTESIAN;
+		effect->constant.direction.dir[0] = 9000;
+		effect->constant.length = 2000;
+		effect->constant.level = 32767;
+		return true;
+
+	case SDL_HAPTIC_SINE:
+	case SDL_HAPTIC_TRIANGLE:
+	case SDL_HAPTIC_SAWTOOTHUP:
+	case SDL_HAPTIC_SAWTOOTHDOWN:
+		effect->periodic.type = type;
+		effect->periodic.direction.type = SDL_HAPTIC_CARTESIAN;
+		effect->periodic.direction.dir[0] = 9000;
+		effect->periodic.length = 2000;
+		effect->periodic.period = 2000;
+		effect->periodic.magnitude = 32767;
+		return true;
+
+	case SDL_HAPTIC_RAMP:
+		effect->ramp.type = type;
+		effect->ramp.direction.type = SDL_HAPTIC_CARTESIAN;
+		effect->ramp.direction.dir[0] = 9000;
+		effect->ramp.length = 2000;
+		effect->ramp.start = 0;
+		effect->ramp.end = 32767;
+		return true;
+
+	case SDL_HAPTIC_SPRING:
+	case SDL_HAPTIC_DAMPER:
+	case SDL_HAPTIC_INERTIA:
+	case SDL_HAPTIC_FRICTION:
+		effect->condition.type = type;
+		effect->condition.direction.type = SDL_HAPTIC_CARTESIAN;
+		effect->condition.direction.dir[0] = 9000;
+		effect->condition.length = 2000;
+		return true;
+
+	// the samples come from a waveform, see waveform.h
+	case SDL_HAPTIC_CUSTOM:
+		effect->custom.type = type;
+		effect->custom.direction.type = SDL_HAPTIC_CARTESIAN;
+		effect->custom.direction.dir[0] = 9000;
+		effect->custom.period = 1;
+		effect->custom.channels = 1;
+		return true;
+	}
+
+	return false;
+}
+
+void mirror_condition_axes(SDL_HapticEffect *effect){
+#define SET(x) effect->condition.x
+
+	SET(right_sat[2]) 	= SET(right_sat[1]) 	= SET(right_sat[0]);
+	SET(left_sat[2]) 	= SET(left_sat[1]) 	= SET(left_sat[0]);
+	SET(right_coeff[2]) 	= SET(right_coeff[1]) 	= SET(right_coeff[0]);
+	SET(left_coeff[2]) 	= SET(left_coeff[1]) 	= SET(left_coeff[0]);
+	SET(deadband[2]) 	= SET(deadband[1]) 	= SET(deadband[0]);
+	SET(center[2]) 		= SET(center[1]) 	= SET(center[0]);
+
+#undef SET
+}
+
+#define FIELD(n, t, m, k, a, b) \
+	{#n, t, offsetof(SDL_HapticEffect, m.n), FIELD_##k, a, b, false}
+
+#define AXIS_FIELD(n, k, a, b) \
+	{#n, CONDITION_EFFECTS, offsetof(SDL_HapticEffect, condition.n[0]), \
+		FIELD_##k, a, b, true}
+
+// all non-custom effects share the same leading members, so the
+// direction/length/delay offsets are the same whichever member we use
+#define COMMON_EFFECTS (SDL_HAPTIC_CONSTANT | PERIODIC_EFFECTS \
+		| SDL_HAPTIC_RAMP | CONDITION_EFFECTS)
+
+#define ENVELOPE_FIELDS(t, m) \
+	FIELD(attack_length, t, m, U16, 0, USHRT_MAX), \
+	FIELD(attack_level, t, m, U16, 0, USHRT_MAX), \
+	FIELD(fade_length, t, m, U16, 0, USHRT_MAX), \
+	FIELD(fade_level, t, m, U16, 0, USHRT_MAX)
+
+const effect_field effect_fields[] = {
+	{"direction", COMMON_EFFECTS,
+		offsetof(SDL_HapticEffect, constant.direction.dir[0]),
+		FIELD_S32, 0, 36000, false},
+	FIELD(length, COMMON_EFFECTS, constant, U32, 0, UINT_MAX),
+	FIELD(delay, COMMON_EFFECTS, constant, U16, 0, USHRT_MAX),
+
+	FIELD(level, SDL_HAPTIC_CONSTANT, constant, S16, SHRT_MIN, SHRT_MAX),
+	ENVELOPE_FIELDS(SDL_HAPTIC_CONSTANT, constant),
+
+	FIELD(period, PERIODIC_EFFECTS, periodic, U16, 0, USHRT_MAX),
+	FIELD(magnitude, PERIODIC_EFFECTS, periodic, S16, SHRT_MIN, SHRT_MAX),
+	FIELD(offset, PERIODIC_EFFECTS, periodic, S16, SHRT_MIN, SHRT_MAX),
+	FIELD(phase, PERIODIC_EFFECTS, periodic, U16, 0, 35999),
+	ENVELOPE_FIELDS(PERIODIC_EFFECTS, periodic),
+
+	FIELD(start, SDL_HAPTIC_RAMP, ramp, S16, SHRT_MIN, SHRT_MAX),
+	FIELD(end, SDL_HAPTIC_RAMP, ramp, S16, SHRT_MIN, SHRT_MAX),
+	ENVELOPE_FIELDS(SDL_HAPTIC_RAMP, ramp),
+
+	AXIS_FIELD(right_sat, U16, 0, USHRT_MAX),
+	AXIS_FIELD(left_sat, U16, 0, USHRT_MAX),
+	AXIS_FIELD(right_coeff, S16, SHRT_MIN, SHRT_MAX),
+	AXIS_FIELD(left_coeff, S16, SHRT_MIN, SHRT_MAX),
+	AXIS_FIELD(deadband, U16, 0, USHRT_MAX),
+	AXIS_FIELD(center, S16, SHRT_MIN, SHRT_MAX),
+
+	// custom effects lay their members out differently
+	{"direction", SDL_HAPTIC_CUSTOM,
+		offsetof(SDL_HapticEffect, custom.direction.dir[0]),
+		FIELD_S32, 0, 36000, false},
+	FIELD(length, SDL_HAPTIC_CUSTOM, custom, U32, 0, UINT_MAX),
+	FIELD(delay, SDL_HAPTIC_CUSTOM, custom, U16, 0, USHRT_MAX),
+	FIELD(period, SDL_HAPTIC_CUSTOM, custom, U16, 1, USHRT_MAX),
+	ENVELOPE_FIELDS(SDL_HAPTIC_CUSTOM, custom),
+};
+
+const size_t num_effect_fields = sizeof(effect_fields) / sizeof(effect_fields[0]);
+
+#undef ENVELOPE_FIELDS
+#undef COMMON_EFFECTS
+#undef AXIS_FIELD
+#undef FIELD
+
+const effect_field *find_effect_field(uint16_t type, const char *name){
+	for(size_t i = 0; i < num_effect_fields; ++i){
+		if((effect_fields[i].types & type) && !strcmp(effect_fields[i].name, name))
+			return &effect_fields[i];
+	}
+
+	return NULL;
+}
+
+static size_t field_size(const effect_field *f){
+	switch(f->kind){
+	case FIELD_S16:
+	case FIELD_U16:
+		return 2;
+	case FIELD_U32:
+	case FIELD_S32:
+		return 4;
+	}
+
+	return 0;
+}
+
+long long get_effect_axis(const SDL_HapticEffect *effect, const effect_field *f, int axis){
+	const void *p = (const char *)effect + f->offset + (f->axes ? axis * field_size(f) : 0);
+
+	switch(f->kind){
+	case FIELD_S16: return *(const Sint16 *)p;
+	case FIELD_U16: return *(const Uint16 *)p;
+	case FIELD_U32: return *(const Uint32 *)p;
+	case FIELD_S32: return *(const Sint32 *)p;
+	}
+
+	return 0;
+}
+
+void set_effect_axis(SDL_HapticEffect *effect, const effect_field *f, int axis, long long v){
+	void *p = (char *)effect + f->offset + (f->axes ? axis * field_size(f) : 0);
+
+	switch(f->kind){
+	case FIELD_S16: *(Sint16 *)p = v; break;
+	case FIELD_U16: *(Uint16 *)p = v; break;
+	case FIELD_U32: *(Uint32 *)p = v; break;
+	case FIELD_S32: *(Sint32 *)p = v; break;
+	}
+}
+
+long long get_effect_field(const SDL_HapticEffect *effect, const effect_field *f){
+	return get_effect_axis(effect, f, 0);
+}
+
+void set_effect_field(SDL_HapticEffect *effect, const effect_field *f, long long v){
+	int n = f->axes ? 3 : 1;
+	for(int i = 0; i < n; ++i)
+		set_effect_axis(effect, f, i, v);
+}
+
+int parse_effect_field(SDL_HapticEffect *effect, const char *assignment){
+	const char *eq = strchr(assignment, '=');
+	if(!eq)
+		return SDL_SetError("Expected name=value, got '%s'.", assignment);
+
+	char name[EFFECT_NAME_LEN];
+	size_t len = eq - assignment;
+	if(len >= sizeof(name))
+		len = sizeof(name) - 1;
+
+	memcpy(name, assignment, len);
+	name[len] = '\0';
+
+	const effect_field *f = find_effect_field(effect->type, name);
+	if(!f)
+		return SDL_SetError("%s has no parameter '%s'.",
+				get_haptic_type_name(effect->type), name);
+
+	long long v;
+	char *end;
+	if(!strcmp(eq + 1, "inf") && f->kind == FIELD_U32){
+		v = SDL_HAPTIC_INFINITY;
+	} else {
+		v = strtoll(eq + 1, &end, 0);
+		if(end == eq + 1 || *end)
+			return SDL_SetError("Invalid value for %s: '%s'.", name, eq + 1);
+	}
+
+	if(v < f->min || v > f->max)
+		return SDL_SetError("%s out of range [%lli - %lli].",
+				name, f->min, f->max);
+
+	set_effect_field(effect, f, v);
+	return 0;
+}
@@ -0,0 +1,69 @@
+#ifndef EFFECT_H
+#define EFFECT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_haptic.h>
+
+#define PERIODIC_EFFECTS (SDL_HAPTIC_SINE | SDL_HAPTIC_TRIANGLE \
+		| SDL_HAPTIC_SAWTOOTHUP | SDL_HAPTIC_SAWTOOTHDOWN)
+
+#define CONDITION_EFFECTS (SDL_HAPTIC_SPRING | SDL_HAPTIC_DAMPER \
+		| SDL_HAPTIC_INERTIA | SDL_HAPTIC_FRICTION)
+
+#define EFFECT_NAME_LEN 32
+
+typedef uint32_t effect_mask;
+
+typedef struct {
+	SDL_HapticEffect effect;
+	int id;
+	bool active;
+	// only set for effects created from scripts
+	char name[EFFECT_NAME_LEN];
+
+	// what the device currently has, see update.h
+	SDL_HapticEffect uploaded;
+	uint64_t uploaded_at;
+	bool pending;
+} haptic_elem;
+
+typedef enum {
+	FIELD_S16,
+	FIELD_U16,
+	FIELD_U32,
+	FIELD_S32,
+} field_kind;
+
+typedef struct {
+	const char *name;
+	effect_mask types;
+	size_t offset;
+	field_kind kind;
+	long long min;
+	long long max;
+	// condition parameters are given once and copied to all three axes
+	bool axes;
+} effect_field;
+
+extern const effect_field effect_fields[];
+extern const size_t num_effect_fields;
+
+const char *get_haptic_type_name(uint16_t type);
+uint16_t get_haptic_type(const char *name);
+
+bool init_effect(SDL_HapticEffect *effect, uint16_t type);
+void mirror_condition_axes(SDL_HapticEffect *effect);
+
+const effect_field *find_effect_field(uint16_t type, const char *name);
+long long get_effect_field(const SDL_HapticEffect *effect, const effect_field *f);
+void set_effect_field(SDL_HapticEffect *effect, const effect_field *f, long long v);
+int parse_effect_field(SDL_HapticEffect *effect, const char *assignment);
+
+// one axis of a condition parameter, the axis is ignored for other fields
+long long get_effect_axis(const SDL_HapticEffect *effect, const effect_field *f, int axis);
+void set_effect_axis(SDL_HapticEffect *effect, const effect_field *f, int axis, long long v);
+
+#endif /* EFFECT_H */
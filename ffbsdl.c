@@ -2,10 +2,43 @@
 #include <stdint.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_haptic.h>
-
-typedef uint32_t effect_mask;
+#include "effect.h"
+#include "batch.h"
+#include "stream.h"
+#include "shm.h"
+#include "sock.h"
+#include "update.h"
+#include "device.h"
+#include "render.h"
+#include "mixer.h"
+#include "morph.h"
+#include "slots.h"
+#include "reactor.h"
+#include "poller.h"
+#include "timeline.h"
+#include "trace.h"
+#include "preset.h"
+#include "watch.h"
+#include "condition.h"
+#include "calibrate.h"
+#include "rig.h"
+#include "capcache.h"
+#include "monitor.h"
+#include "scheduler.h"
+#include "timing.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#define O_BINARY 0
+#endif
 
 typedef enum {
 	// top-level choices
@@ -16,6 +49,8 @@ typedef enum {
 	DESTROY_EFFECT,
 	SET_AUTOCENTER,
 	SET_GAIN,
+	SHOW_STATS,
+	SELECT_DEVICES,
 	QUIT,
 
 	// effect creation choices
@@ -29,6 +64,7 @@ typedef enum {
 	CREATE_DAMPER,
 	CREATE_INERTIA,
 	CREATE_FRICTION,
+	CREATE_PRESET,
 
 	// effect modification choices
 	MODIFY_CONSTANT,
@@ -50,14 +86,30 @@ typedef struct {
 	char *option_str;
 } effect_choice;
 
-typedef struct {
-	SDL_HapticEffect effect;
-	int id;
-	bool active;
-} haptic_elem;
+// the interactive menu waits for input in this, see read_line()
+static reactor *loop;
+
+// cached effect status, NULL if the device can't tell or polling is off
+static status_poller *poller;
+
+// -b, NULL without one
+static preset_library *presets;
+
+// -l, NULL without one
+static effect_watch *watch;
+
+// -D or more than one -S, NULL with a single device
+static haptic_device *rig;
 
-int init(){
-	int ret = SDL_Init(SDL_INIT_HAPTIC);
+int init(bool sim){
+	// Ctrl-C should still just kill us, not turn into an SDL_QUIT event
+	// that only the menu looks at
+	SDL_SetHint(SDL_HINT_NO_SIGNAL_HANDLERS, "1");
+
+	// the simulator doesn't need the haptic subsystem, which lets it run
+	// on machines where SDL can't find any input devices at all, joysticks
+	// are only opened to hear about devices coming and going
+	int ret = SDL_Init(sim ? 0 : SDL_INIT_HAPTIC | SDL_INIT_JOYSTICK);
 	if(ret){
 		puts(SDL_GetError());
 		return ret;
@@ -70,64 +122,80 @@ void cleanup(){
 	SDL_Quit();
 }
 
-SDL_Haptic *get_haptic(){
-	// open first haptic device, could be a good idea to try and let the
-	// user choose which device to open but for now this is alright
-	SDL_Haptic *haptic = SDL_HapticOpen(0);
+haptic_device *get_haptic(const char *sim, const char *capcache){
+	// the first haptic device, -D opens others, or several as one rig,
+	// through get_rig()
+	haptic_device *haptic = sim ? open_sim_device(sim)
+		: capcache ? open_cached_device(0, capcache) : open_sdl_device(0);
 	if(!haptic){
-		fputs("Couldn't open haptic device.", stderr);
+		fprintf(stderr, "Couldn't open haptic device: %s\n", SDL_GetError());
 	} else {
 		puts("Found haptic device:");
-		puts(SDL_HapticName(0));
+		puts(haptic->name);
 	}
 
 	return haptic;
 }
 
-effect_mask get_supported_effects(SDL_Haptic *haptic){
-	return SDL_HapticQuery(haptic);
-}
-
-void destroy_haptic(SDL_Haptic *haptic){
-	SDL_HapticClose(haptic);
+effect_mask get_supported_effects(haptic_device *haptic){
+	return haptic_query(haptic);
 }
 
-void destroy_joystick(SDL_Joystick *joy){
-	SDL_JoystickClose(joy);
+void destroy_haptic(haptic_device *haptic){
+	close_device(haptic);
 }
 
-const char *get_haptic_type_name(uint16_t type){
-#define CASE(x) case SDL_HAPTIC_##x: return #x
+// the joystick the haptic device belongs to, going by name, or the first
+// one if none match
+SDL_Joystick *get_joystick(haptic_device *haptic){
+	if(SDL_InitSubSystem(SDL_INIT_JOYSTICK)){
+		fprintf(stderr, "Couldn't open joystick: %s\n", SDL_GetError());
+		return NULL;
+	}
 
-	switch(type){
-		CASE(CONSTANT);
-		CASE(SINE);
-		CASE(TRIANGLE);
-		CASE(SAWTOOTHUP);
-		CASE(SAWTOOTHDOWN);
-		CASE(RAMP);
-		CASE(SPRING);
-		CASE(DAMPER);
-		CASE(FRICTION);
-		CASE(INERTIA);
-		CASE(CUSTOM);
+	int n = SDL_NumJoysticks();
+	int index = n > 0 ? 0 : -1;
+	for(int i = 0; i < n; ++i){
+		const char *name = SDL_JoystickNameForIndex(i);
+		if(name && !strcmp(name, haptic->name)){
+			index = i;
+			break;
+		}
 	}
 
-	return "ERR";
+	SDL_Joystick *joy = index < 0 ? NULL : SDL_JoystickOpen(index);
+	if(!joy)
+		fprintf(stderr, "Couldn't open joystick: %s\n",
+				index < 0 ? "No joysticks found." : SDL_GetError());
+
+	return joy;
+}
+
+void destroy_joystick(SDL_Joystick *joy){
+	if(joy)
+		SDL_JoystickClose(joy);
+}
+
+// only goes to the device when the poller hasn't seen elem yet
+int get_effect_status(haptic_device *haptic, haptic_elem *elem){
+	int status = poller ? poller_status(poller, elem) : -1;
+	if(status < 0)
+		status = haptic_effect_status(haptic, elem->id);
 
-#undef CASE
+	return status;
 }
 
-void show_status(SDL_Haptic *haptic, size_t num_elems, haptic_elem elems[]){
+void show_status(haptic_device *haptic, effect_slots *slots){
 	puts("EFFECTS:");
 	puts("ID\tNAME\tSTATUS");
 
-	for(size_t i = 0; i < num_elems; ++i){
-		if(elems[i].active)
+	for(size_t i = 0; i < slots->num_elems; ++i){
+		haptic_elem *elem = &slots->elems[i];
+		if(elem->active)
 			printf("%i\t%s\t%s\n",
-					elems[i].id,
-					get_haptic_type_name(elems[i].effect.type),
-					SDL_HapticGetEffectStatus(haptic, elems[i].id) ? "PLAYING" : "STOPPED"
+					elem->id,
+					get_haptic_type_name(elem->effect.type),
+					get_effect_status(haptic, elem) > 0 ? "PLAYING" : "STOPPED"
 			      );
 	}
 
@@ -142,18 +210,23 @@ void show_choices(){
 	puts("d: Destroy effect");
 	puts("g: Set gain");
 	puts("a: Set autocenter");
+	puts("i: Show call stats");
+	if(rig)
+		puts("v: Choose devices");
 	puts("q: Quit");
 }
 
-void discard_line(){
-	while(getchar() != '\n');
+// reads a line from stdin while the event loop keeps running
+int read_line(char *line, size_t size){
+	return reactor_read_line(loop, 0, line, size);
 }
 
 choice get_choice(){
-	char c = getchar();
-	discard_line();
+	char line[80];
+	if(read_line(line, sizeof(line)) < 0)
+		return QUIT;
 
-	switch(c){
+	switch(line[0]){
 	case 'c': return CREATE_EFFECT;
 	case 'm': return MODIFY_EFFECT;
 	case 'p': return PLAY_EFFECT;
@@ -161,6 +234,8 @@ choice get_choice(){
 	case 'd': return DESTROY_EFFECT;
 	case 'a': return SET_AUTOCENTER;
 	case 'g': return SET_GAIN;
+	case 'i': return SHOW_STATS;
+	case 'v': return rig ? SELECT_DEVICES : TRY_AGAIN;
 	case 'q': return QUIT;
 	}
 
@@ -172,18 +247,11 @@ int get_int(const char *s, long long int min, long long int max, long long int d
 	// attack but I'll let it slide this once
 	printf(s, min, max, d);
 
-	int res;
+	int res = d;
 	char in[80];
-	fgets(in, sizeof(in), stdin);
-
-	if(in[0] == '\n')
-		res = d;
-	else
+	if(read_line(in, sizeof(in)) > 0)
 		sscanf(in, "%i", &res);
 
-	if(strlen(in) >= 79)
-		discard_line();
-
 	if(res < min)
 		res = min;
 
@@ -243,156 +311,40 @@ void get_condition_effect_input(SDL_HapticEffect *effect){
 	COND_ATTR(center[0], SHRT_MIN, SHRT_MAX);
 }
 
-void modify_inertia(SDL_Haptic *haptic, int id, SDL_HapticEffect *effect){
-	get_condition_effect_input(effect);
-	SDL_HapticUpdateEffect(haptic, id, effect);
-}
-
-int create_inertia(SDL_Haptic *haptic, SDL_HapticEffect *effect){
-	effect->type = SDL_HAPTIC_INERTIA;
-
-	effect->condition.type = SDL_HAPTIC_INERTIA;
-
-	effect->condition.direction.type = SDL_HAPTIC_CARTESIAN;
-	effect->condition.direction.dir[0] = 9000;
-	effect->condition.length = 2000;
-	effect->condition.delay = 0;
-
-	effect->condition.right_sat[0] = 0;
-	effect->condition.left_sat[0] = 0;
-	effect->condition.right_coeff[0] = 0;
-	effect->condition.left_coeff[0] = 0;
-	effect->condition.deadband[0] = 0;
-	effect->condition.center[0] = 0;
-
-	get_condition_effect_input(effect);
-
-#define SET(x) effect->condition.x
-
-	SET(right_sat[2]) 	= SET(right_sat[1]) 	= SET(right_sat[0]);
-	SET(left_sat[2]) 	= SET(left_sat[1]) 	= SET(left_sat[0]);
-	SET(right_coeff[2]) 	= SET(right_coeff[1]) 	= SET(right_coeff[0]);
-	SET(left_coeff[2]) 	= SET(left_coeff[1]) 	= SET(left_coeff[0]);
-	SET(deadband[2]) 	= SET(deadband[1]) 	= SET(deadband[0]);
-	SET(center[2]) 		= SET(center[1]) 	= SET(center[0]);
-
-#undef SET
-
-	return SDL_HapticNewEffect(haptic, effect);
-}
+haptic_elem *create_inertia(effect_slots *slots){
+	SDL_HapticEffect effect;
+	init_effect(&effect, SDL_HAPTIC_INERTIA);
+	get_condition_effect_input(&effect);
+	mirror_condition_axes(&effect);
 
-void modify_friction(SDL_Haptic *haptic, int id, SDL_HapticEffect *effect){
-	get_condition_effect_input(effect);
-	SDL_HapticUpdateEffect(haptic, id, effect);
+	return create_slot_effect(slots, &effect, NULL, 0);
 }
 
-int create_friction(SDL_Haptic *haptic, SDL_HapticEffect *effect){
-	effect->type = SDL_HAPTIC_FRICTION;
-
-	effect->condition.type = SDL_HAPTIC_FRICTION;
-
-	effect->condition.direction.type = SDL_HAPTIC_CARTESIAN;
-	effect->condition.direction.dir[0] = 9000;
-	effect->condition.length = 2000;
-	effect->condition.delay = 0;
-
-	effect->condition.right_sat[0] = 0;
-	effect->condition.left_sat[0] = 0;
-	effect->condition.right_coeff[0] = 0;
-	effect->condition.left_coeff[0] = 0;
-	effect->condition.deadband[0] = 0;
-	effect->condition.center[0] = 0;
-
-	get_condition_effect_input(effect);
-
-#define SET(x) effect->condition.x
-
-	SET(right_sat[2]) 	= SET(right_sat[1]) 	= SET(right_sat[0]);
-	SET(left_sat[2]) 	= SET(left_sat[1]) 	= SET(left_sat[0]);
-	SET(right_coeff[2]) 	= SET(right_coeff[1]) 	= SET(right_coeff[0]);
-	SET(left_coeff[2]) 	= SET(left_coeff[1]) 	= SET(left_coeff[0]);
-	SET(deadband[2]) 	= SET(deadband[1]) 	= SET(deadband[0]);
-	SET(center[2]) 		= SET(center[1]) 	= SET(center[0]);
-
-#undef SET
-
-	return SDL_HapticNewEffect(haptic, effect);
-}
+haptic_elem *create_friction(effect_slots *slots){
+	SDL_HapticEffect effect;
+	init_effect(&effect, SDL_HAPTIC_FRICTION);
+	get_condition_effect_input(&effect);
+	mirror_condition_axes(&effect);
 
-void modify_damper(SDL_Haptic *haptic, int id, SDL_HapticEffect *effect){
-	get_condition_effect_input(effect);
-	SDL_HapticUpdateEffect(haptic, id, effect);
+	return create_slot_effect(slots, &effect, NULL, 0);
 }
 
-int create_damper(SDL_Haptic *haptic, SDL_HapticEffect *effect){
-	effect->type = SDL_HAPTIC_DAMPER;
-
-	effect->condition.type = SDL_HAPTIC_DAMPER;
-
-	effect->condition.direction.type = SDL_HAPTIC_CARTESIAN;
-	effect->condition.direction.dir[0] = 9000;
-	effect->condition.length = 2000;
-	effect->condition.delay = 0;
-
-	effect->condition.right_sat[0] = 0;
-	effect->condition.left_sat[0] = 0;
-	effect->condition.right_coeff[0] = 0;
-	effect->condition.left_coeff[0] = 0;
-	effect->condition.deadband[0] = 0;
-	effect->condition.center[0] = 0;
-
-	get_condition_effect_input(effect);
-
-#define SET(x) effect->condition.x
-
-	SET(right_sat[2]) 	= SET(right_sat[1]) 	= SET(right_sat[0]);
-	SET(left_sat[2]) 	= SET(left_sat[1]) 	= SET(left_sat[0]);
-	SET(right_coeff[2]) 	= SET(right_coeff[1]) 	= SET(right_coeff[0]);
-	SET(left_coeff[2]) 	= SET(left_coeff[1]) 	= SET(left_coeff[0]);
-	SET(deadband[2]) 	= SET(deadband[1]) 	= SET(deadband[0]);
-	SET(center[2]) 		= SET(center[1]) 	= SET(center[0]);
-
-#undef SET
-
-	return SDL_HapticNewEffect(haptic, effect);
-}
+haptic_elem *create_damper(effect_slots *slots){
+	SDL_HapticEffect effect;
+	init_effect(&effect, SDL_HAPTIC_DAMPER);
+	get_condition_effect_input(&effect);
+	mirror_condition_axes(&effect);
 
-void modify_spring(SDL_Haptic *haptic, int id, SDL_HapticEffect *effect){
-	get_condition_effect_input(effect);
-	SDL_HapticUpdateEffect(haptic, id, effect);
+	return create_slot_effect(slots, &effect, NULL, 0);
 }
 
-int create_spring(SDL_Haptic *haptic, SDL_HapticEffect *effect){
-	effect->type = SDL_HAPTIC_SPRING;
-
-	effect->condition.type = SDL_HAPTIC_SPRING;
-
-	effect->condition.direction.type = SDL_HAPTIC_CARTESIAN;
-	effect->condition.direction.dir[0] = 9000;
-	effect->condition.length = 2000;
-	effect->condition.delay = 0;
-
-	effect->condition.right_sat[0] = 0;
-	effect->condition.left_sat[0] = 0;
-	effect->condition.right_coeff[0] = 0;
-	effect->condition.left_coeff[0] = 0;
-	effect->condition.deadband[0] = 0;
-	effect->condition.center[0] = 0;
-
-	get_condition_effect_input(effect);
-
-#define SET(x) effect->condition.x
-
-	SET(right_sat[2]) 	= SET(right_sat[1]) 	= SET(right_sat[0]);
-	SET(left_sat[2]) 	= SET(left_sat[1]) 	= SET(left_sat[0]);
-	SET(right_coeff[2]) 	= SET(right_coeff[1]) 	= SET(right_coeff[0]);
-	SET(left_coeff[2]) 	= SET(left_coeff[1]) 	= SET(left_coeff[0]);
-	SET(deadband[2]) 	= SET(deadband[1]) 	= SET(deadband[0]);
-	SET(center[2]) 		= SET(center[1]) 	= SET(center[0]);
-
-#undef SET
+haptic_elem *create_spring(effect_slots *slots){
+	SDL_HapticEffect effect;
+	init_effect(&effect, SDL_HAPTIC_SPRING);
+	get_condition_effect_input(&effect);
+	mirror_condition_axes(&effect);
 
-	return SDL_HapticNewEffect(haptic, effect);
+	return create_slot_effect(slots, &effect, NULL, 0);
 }
 
 void get_ramp_effect_input(SDL_HapticEffect *effect){
@@ -409,31 +361,12 @@ void get_ramp_effect_input(SDL_HapticEffect *effect){
 	SHORT_RAMP_ATTR(fade_level);
 }
 
-void modify_ramp(SDL_Haptic *haptic, int id, SDL_HapticEffect *effect){
-	get_ramp_effect_input(effect);
-	SDL_HapticUpdateEffect(haptic, id, effect);
-}
-
-int create_ramp(SDL_Haptic *haptic, SDL_HapticEffect *effect){
-	effect->type = SDL_HAPTIC_RAMP;
-	effect->ramp.type = SDL_HAPTIC_TRIANGLE;
-
-	effect->ramp.direction.type = SDL_HAPTIC_CARTESIAN;
-	effect->ramp.direction.dir[0] = 9000;
-	effect->ramp.length = 2000;
-	effect->ramp.delay = 0;
-
-	effect->ramp.start = 0;
-	effect->ramp.end = 65535;
-
-	effect->ramp.attack_length = 0;
-	effect->ramp.attack_level = 0;
-	effect->ramp.fade_length = 0;
-	effect->ramp.fade_level = 0;
-
-	get_ramp_effect_input(effect);
+haptic_elem *create_ramp(effect_slots *slots){
+	SDL_HapticEffect effect;
+	init_effect(&effect, SDL_HAPTIC_RAMP);
+	get_ramp_effect_input(&effect);
 
-	return SDL_HapticNewEffect(haptic, effect);
+	return create_slot_effect(slots, &effect, NULL, 0);
 }
 
 void get_periodic_effect_input(SDL_HapticEffect *effect){
@@ -452,119 +385,36 @@ void get_periodic_effect_input(SDL_HapticEffect *effect){
 	SHORT_PERIODIC_ATTR(fade_level);
 }
 
-void modify_triangle(SDL_Haptic *haptic, int id, SDL_HapticEffect *effect){
-	get_periodic_effect_input(effect);
-	SDL_HapticUpdateEffect(haptic, id, effect);
-}
-
-int create_triangle(SDL_Haptic *haptic, SDL_HapticEffect *effect){
-	effect->type = SDL_HAPTIC_TRIANGLE;
-	effect->periodic.type = SDL_HAPTIC_TRIANGLE;
-
-	effect->periodic.direction.type = SDL_HAPTIC_CARTESIAN;
-	effect->periodic.direction.dir[0] = 9000;
-	effect->periodic.length = 2000;
-	effect->periodic.delay = 0;
-
-	effect->periodic.period = 2000;
-	effect->periodic.magnitude = 65535;
-	effect->periodic.offset = 0;
-	effect->periodic.phase = 0;
-
-	effect->periodic.attack_length = 0;
-	effect->periodic.attack_level = 0;
-	effect->periodic.fade_length = 0;
-	effect->periodic.fade_level = 0;
-
-	get_periodic_effect_input(effect);
-
-	return SDL_HapticNewEffect(haptic, effect);
-}
+haptic_elem *create_triangle(effect_slots *slots){
+	SDL_HapticEffect effect;
+	init_effect(&effect, SDL_HAPTIC_TRIANGLE);
+	get_periodic_effect_input(&effect);
 
-void modify_sawtoothdown(SDL_Haptic *haptic, int id, SDL_HapticEffect *effect){
-	get_periodic_effect_input(effect);
-	SDL_HapticUpdateEffect(haptic, id, effect);
+	return create_slot_effect(slots, &effect, NULL, 0);
 }
 
-int create_sawtoothdown(SDL_Haptic *haptic, SDL_HapticEffect *effect){
-	effect->type = SDL_HAPTIC_SAWTOOTHDOWN;
-	effect->periodic.type = SDL_HAPTIC_SAWTOOTHDOWN;
-
-	effect->periodic.direction.type = SDL_HAPTIC_CARTESIAN;
-	effect->periodic.direction.dir[0] = 9000;
-	effect->periodic.length = 2000;
-	effect->periodic.delay = 0;
-
-	effect->periodic.period = 2000;
-	effect->periodic.magnitude = 65535;
-	effect->periodic.offset = 0;
-	effect->periodic.phase = 0;
-
-	effect->periodic.attack_length = 0;
-	effect->periodic.attack_level = 0;
-	effect->periodic.fade_length = 0;
-	effect->periodic.fade_level = 0;
-
-	get_periodic_effect_input(effect);
-
-	return SDL_HapticNewEffect(haptic, effect);
-}
+haptic_elem *create_sawtoothdown(effect_slots *slots){
+	SDL_HapticEffect effect;
+	init_effect(&effect, SDL_HAPTIC_SAWTOOTHDOWN);
+	get_periodic_effect_input(&effect);
 
-void modify_sawtoothup(SDL_Haptic *haptic, int id, SDL_HapticEffect *effect){
-	get_periodic_effect_input(effect);
-	SDL_HapticUpdateEffect(haptic, id, effect);
+	return create_slot_effect(slots, &effect, NULL, 0);
 }
 
-int create_sawtoothup(SDL_Haptic *haptic, SDL_HapticEffect *effect){
-	effect->type = SDL_HAPTIC_SAWTOOTHUP;
-	effect->periodic.type = SDL_HAPTIC_SAWTOOTHUP;
-
-	effect->periodic.direction.type = SDL_HAPTIC_CARTESIAN;
-	effect->periodic.direction.dir[0] = 9000;
-	effect->periodic.length = 2000;
-	effect->periodic.delay = 0;
-
-	effect->periodic.period = 2000;
-	effect->periodic.magnitude = 65535;
-	effect->periodic.offset = 0;
-	effect->periodic.phase = 0;
-
-	effect->periodic.attack_length = 0;
-	effect->periodic.attack_level = 0;
-	effect->periodic.fade_length = 0;
-	effect->periodic.fade_level = 0;
-
-	get_periodic_effect_input(effect);
-
-	return SDL_HapticNewEffect(haptic, effect);
-}
+haptic_elem *create_sawtoothup(effect_slots *slots){
+	SDL_HapticEffect effect;
+	init_effect(&effect, SDL_HAPTIC_SAWTOOTHUP);
+	get_periodic_effect_input(&effect);
 
-void modify_sine(SDL_Haptic *haptic, int id, SDL_HapticEffect *effect){
-	get_periodic_effect_input(effect);
-	SDL_HapticUpdateEffect(haptic, id, effect);
+	return create_slot_effect(slots, &effect, NULL, 0);
 }
 
-int create_sine(SDL_Haptic *haptic, SDL_HapticEffect *effect){
-	effect->type = SDL_HAPTIC_SINE;
-	effect->periodic.type = SDL_HAPTIC_SINE;
-
-	effect->periodic.direction.type = SDL_HAPTIC_CARTESIAN;
-	effect->periodic.direction.dir[0] = 9000;
-	effect->periodic.length = 2000;
-	effect->periodic.delay = 0;
-
-	effect->periodic.period = 2000;
-	effect->periodic.magnitude = 65535;
-	effect->periodic.offset = 0;
-	effect->periodic.phase = 0;
-
-	effect->periodic.attack_length = 0;
-	effect->periodic.attack_level = 0;
-	effect->periodic.fade_length = 0;
-	effect->periodic.fade_level = 0;
+haptic_elem *create_sine(effect_slots *slots){
+	SDL_HapticEffect effect;
+	init_effect(&effect, SDL_HAPTIC_SINE);
+	get_periodic_effect_input(&effect);
 
-	get_periodic_effect_input(effect);
-	return SDL_HapticNewEffect(haptic, effect);
+	return create_slot_effect(slots, &effect, NULL, 0);
 }
 
 void get_constant_effect_input(SDL_HapticEffect *effect){
@@ -580,29 +430,33 @@ void get_constant_effect_input(SDL_HapticEffect *effect){
 	USHORT_CONSTANT_ATTR(fade_level);
 }
 
-void modify_constant(SDL_Haptic *haptic, int id, SDL_HapticEffect *effect){
-	get_constant_effect_input(effect);
-	SDL_HapticUpdateEffect(haptic, id, effect);
-}
+haptic_elem *create_constant(effect_slots *slots){
+	SDL_HapticEffect effect;
+	init_effect(&effect, SDL_HAPTIC_CONSTANT);
+	get_constant_effect_input(&effect);
 
-int create_constant(SDL_Haptic *haptic, SDL_HapticEffect *effect){
-	effect->type = SDL_HAPTIC_CONSTANT;
-	effect->constant.type = SDL_HAPTIC_CONSTANT;
+	return create_slot_effect(slots, &effect, NULL, 0);
+}
 
-	effect->constant.direction.type = SDL_HAPTIC_CARTESIAN;
-	effect->constant.direction.dir[0] = 9000;
-	effect->constant.length = 2000;
-	effect->constant.delay = 0;
-	effect->constant.level = 32767;
+haptic_elem *create_preset(effect_slots *slots){
+	printf("Preset name (%zu in library): ", preset_count(presets));
 
-	effect->constant.attack_length = 0;
-	effect->constant.attack_level = 0;
-	effect->constant.fade_length = 0;
-	effect->constant.fade_level = 0;
+	char name[80];
+	if(read_line(name, sizeof(name)) <= 0){
+		SDL_SetError("No preset given.");
+		return NULL;
+	}
 
-	get_constant_effect_input(effect);
+	name[strcspn(name, "\r")] = '\0';
+	const preset_record *r = find_preset(presets, name);
+	if(!r){
+		SDL_SetError("No preset named '%s'.", name);
+		return NULL;
+	}
 
-	return SDL_HapticNewEffect(haptic, effect);
+	// keep the name if it's free, so scripts and -A can find it
+	return create_slot_effect(slots, &r->effect,
+			find_slot_by_name(slots, r->name) ? NULL : r->name, r->priority);
 }
 
 void show_create_effect_choices(effect_mask supported_effects){
@@ -629,6 +483,9 @@ void show_create_effect_choices(effect_mask supported_effects){
 			puts(options[i].option_str);
 	}
 
+	if(presets)
+		puts("P: PRESET");
+
 #undef OPTION
 }
 
@@ -651,84 +508,78 @@ choice get_create_effect_choice(effect_mask supported_effects){
 		OPTION(FRICTION, 'f'),
 	};
 
-	char option = 0;
-	scanf("%c", &option);
-	discard_line();
+	char line[80];
+	if(read_line(line, sizeof(line)) < 0)
+		return QUIT;
 
+	char option = line[0];
 	for(size_t i = 0; i < sizeof(options) / sizeof(options[0]); ++i){
 		if(options[i].c == option)
 			return options[i].x;
 	}
 
+	if(presets && option == 'P')
+		return CREATE_PRESET;
+
 	return TRY_AGAIN;
 
 #undef OPTION
 }
 
-void run_create_effect_choice(SDL_Haptic *haptic, size_t num_elems, haptic_elem elems[], choice c){
-	haptic_elem *elem = 0;
-	for(size_t i = 0; i < num_elems; ++i){
-		if(!elems[i].active){
-			elem = &elems[i];
-			break;
-		}
-	}
-
-	int id = 0;
-	SDL_HapticEffect *effect = &elem->effect;
+void run_create_effect_choice(haptic_device *haptic, effect_slots *slots, choice c){
+	haptic_elem *elem = NULL;
 
 	switch(c){
 	case CREATE_CONSTANT:
-		id = create_constant(haptic, effect);
+		elem = create_constant(slots);
 		break;
 
 	case CREATE_SINE:
-		id = create_sine(haptic, effect);
+		elem = create_sine(slots);
 		break;
 
 	case CREATE_TRIANGLE:
-		id = create_triangle(haptic, effect);
+		elem = create_triangle(slots);
 		break;
 
 	case CREATE_SAWTOOTHUP:
-		id = create_sawtoothup(haptic, effect);
+		elem = create_sawtoothup(slots);
 		break;
 
 	case CREATE_SAWTOOTHDOWN:
-		id = create_sawtoothdown(haptic, effect);
+		elem = create_sawtoothdown(slots);
 		break;
 
 	case CREATE_RAMP:
-		id = create_ramp(haptic, effect);
+		elem = create_ramp(slots);
 		break;
 
 	case CREATE_SPRING:
-		id = create_spring(haptic, effect);
+		elem = create_spring(slots);
 		break;
 
 	case CREATE_DAMPER:
-		id = create_damper(haptic, effect);
+		elem = create_damper(slots);
 		break;
 
 	case CREATE_INERTIA:
-		id = create_inertia(haptic, effect);
+		elem = create_inertia(slots);
 		break;
 
 	case CREATE_FRICTION:
-		id = create_friction(haptic, effect);
+		elem = create_friction(slots);
 		break;
-	}
 
-	if(id < 0){
-		fputs(SDL_GetError(), stderr);
-		elem->active = false;
-	} else {
-		elem->id = id;
-		elem->active = true;
+	case CREATE_PRESET:
+		elem = create_preset(slots);
+		break;
 	}
+
+	if(!elem)
+		fprintf(stderr, "%s\n", SDL_GetError());
 }
 
-void create_effect(SDL_Haptic *haptic, size_t num_elems, haptic_elem elems[], effect_mask supported_effects){
+void create_effect(haptic_device *haptic, effect_slots *slots, effect_mask supported_effects){
 	show_create_effect_choices(supported_effects);
 
 	choice c;
@@ -741,22 +592,20 @@ void create_effect(SDL_Haptic *haptic, size_t num_elems, haptic_elem elems[], ef
 			puts("Try again.");
 	}
 
-	run_create_effect_choice(haptic, num_elems, elems, c);
+	if(c != QUIT)
+		run_create_effect_choice(haptic, slots, c);
 }
 
-int get_id(size_t num_elems, haptic_elem elems[]){
+haptic_elem *get_elem(effect_slots *slots){
 	static int id = 0;
 	id = get_int("Element ID [%i - %i, current %i]: ",
-			0, num_elems, id);
-
-	for(size_t i = 0; i < num_elems; ++i){
-		if(elems[i].active && elems[i].id == id)
-			return id;
-	}
+			0, INT_MAX, id);
 
-	fprintf(stderr, "Effect with ID %i not found.\n", id);
+	haptic_elem *elem = find_slot_by_id(slots, id);
+	if(!elem)
+		fprintf(stderr, "Effect with ID %i not found.\n", id);
 
-	return -1;
+	return elem;
 }
 
 choice get_modify_choice(uint16_t t){
@@ -780,129 +629,155 @@ choice get_modify_choice(uint16_t t){
 #undef CHOICE
 }
 
-void modify_effect(SDL_Haptic *haptic, size_t num_elems, haptic_elem elems[]){
-	haptic_elem *elem = 0;
-	int id = get_id(num_elems, elems);
-
-	if(id < 0)
+void modify_effect(haptic_device *haptic, effect_slots *slots){
+	haptic_elem *elem = get_elem(slots);
+	if(!elem)
 		return;
 
-	elem = &elems[id];
-
-	SDL_HapticEffect *effect = &elem->effect;
+	// -m and -U change effects on threads of their own, so the prompts fill
+	// in a copy that replaces the effect in one go
+	SDL_LockMutex(slots->lock);
+	SDL_HapticEffect effect = elem->effect;
+	SDL_UnlockMutex(slots->lock);
 
-	choice c = get_modify_choice(effect->type);
-	switch(c){
+	switch(get_modify_choice(effect.type)){
 	case MODIFY_CONSTANT:
-		modify_constant(haptic, id, effect);
+		get_constant_effect_input(&effect);
 		break;
 
 	case MODIFY_SINE:
-		modify_sine(haptic, id, effect);
-		break;
-
 	case MODIFY_TRIANGLE:
-		modify_triangle(haptic, id, effect);
-		break;
-
 	case MODIFY_SAWTOOTHUP:
-		modify_sawtoothup(haptic, id, effect);
-		break;
-
 	case MODIFY_SAWTOOTHDOWN:
-		modify_sawtoothdown(haptic, id, effect);
+		get_periodic_effect_input(&effect);
 		break;
 
 	case MODIFY_RAMP:
-		modify_ramp(haptic, id, effect);
+		get_ramp_effect_input(&effect);
 		break;
 
 	case MODIFY_SPRING:
-		modify_spring(haptic, id, effect);
-		break;
-
 	case MODIFY_DAMPER:
-		modify_damper(haptic, id, effect);
-		break;
-
 	case MODIFY_INERTIA:
-		modify_inertia(haptic, id, effect);
-		break;
-
 	case MODIFY_FRICTION:
-		modify_friction(haptic, id, effect);
+		get_condition_effect_input(&effect);
 		break;
+
+	default:
+		return;
 	}
-}
 
-void play_effect(SDL_Haptic *haptic, size_t num_elems, haptic_elem elems[]){
-	int id = get_id(num_elems, elems);
+	SDL_LockMutex(slots->lock);
+	if(elem->active){
+		elem->effect = effect;
+		upload_effect(haptic, elem);
+	}
+
+	SDL_UnlockMutex(slots->lock);
+}
 
-	if(id < 0)
+void play_effect(haptic_device *haptic, effect_slots *slots){
+	haptic_elem *elem = get_elem(slots);
+	if(!elem)
 		return;
 
 	static uint32_t iterations = 0;
 	iterations = get_int("Iterations [%lli - %lli, current %lli]: ",
 			0, UINT_MAX, iterations);
 
-	SDL_HapticRunEffect(haptic, id, iterations);
+	if(play_slot_effect(slots, elem, iterations))
+		fprintf(stderr, "%s\n", SDL_GetError());
 }
 
-void stop_effect(SDL_Haptic *haptic, size_t num_elems, haptic_elem elems[]){
-	int id = get_id(num_elems, elems);
-
-	if(id < 0)
+void stop_effect(haptic_device *haptic, effect_slots *slots){
+	haptic_elem *elem = get_elem(slots);
+	if(!elem)
 		return;
 
-	SDL_HapticStopEffect(haptic, id);
+	if(stop_slot_effect(slots, elem))
+		fprintf(stderr, "%s\n", SDL_GetError());
 }
 
-void destroy_effect(SDL_Haptic *haptic, size_t num_elems, haptic_elem elems[]){
-	int id = get_id(num_elems, elems);
-
-	if(id < 0)
+void destroy_effect(haptic_device *haptic, effect_slots *slots){
+	haptic_elem *elem = get_elem(slots);
+	if(!elem)
 		return;
 
-	SDL_HapticDestroyEffect(haptic, id);
-	elems[id].active = false;
+	destroy_slot_effect(slots, elem);
 }
 
-void set_autocenter(SDL_Haptic *haptic){
+void set_autocenter(haptic_device *haptic){
 	static int autocenter = 0;
 	autocenter = get_int("Autocenter [%i - %i, current %i]: ",
 			0, 100, autocenter);
 
-	SDL_HapticSetAutocenter(haptic, autocenter);
+	haptic_set_autocenter(haptic, autocenter);
 }
 
-void set_gain(SDL_Haptic *haptic){
+void set_gain(haptic_device *haptic){
 	static int gain = 100;
 	gain = get_int("Gain [%i - %i, current %i]: ",
 			0, 100, gain);
 
-	SDL_HapticSetGain(haptic, gain);
+	haptic_set_gain(haptic, gain);
+}
+
+void show_stats(haptic_device *haptic){
+	if(rig){
+		print_rig_stats(stdout, rig);
+		puts("");
+	}
+
+	if(!haptic->stats){
+		puts("Call stats are off, run with -I to turn them on.");
+		return;
+	}
+
+	print_device_stats(stdout, haptic->name, haptic->stats);
+	puts("");
+
+	for(size_t i = 0; rig && i < rig_size(rig); ++i){
+		haptic_device *dev = rig_device(rig, i);
+		print_device_stats(stdout, dev->name, dev->stats);
+		puts("");
+	}
+}
+
+void select_devices(){
+	for(size_t i = 0; i < rig_size(rig); ++i)
+		printf("%zu%s\t%s\n", i, rig_selected(rig, i) ? "*" : "", rig_device(rig, i)->name);
+
+	printf("Devices for new effects, gain and autocenter [all or e.g. 0,2]: ");
+
+	char line[80];
+	if(read_line(line, sizeof(line)) <= 0)
+		return;
+
+	line[strcspn(line, "\r")] = '\0';
+	if(rig_select(rig, line))
+		fprintf(stderr, "%s\n", SDL_GetError());
 }
 
-void run_choice(SDL_Haptic *haptic, size_t num_elems, haptic_elem elems[], effect_mask supported_effects, choice c){
+void run_choice(haptic_device *haptic, effect_slots *slots, effect_mask supported_effects, choice c){
 	switch(c){
 	case CREATE_EFFECT:
-		create_effect(haptic, num_elems, elems, supported_effects);
+		create_effect(haptic, slots, supported_effects);
 		break;
 
 	case MODIFY_EFFECT:
-		modify_effect(haptic, num_elems, elems);
+		modify_effect(haptic, slots);
 		break;
 
 	case PLAY_EFFECT:
-		play_effect(haptic, num_elems, elems);
+		play_effect(haptic, slots);
 		break;
 
 	case STOP_EFFECT:
-		stop_effect(haptic, num_elems, elems);
+		stop_effect(haptic, slots);
 		break;
 
 	case DESTROY_EFFECT:
-		destroy_effect(haptic, num_elems, elems);
+		destroy_effect(haptic, slots);
 		break;
 
 	case SET_AUTOCENTER:
@@ -912,22 +787,174 @@ void run_choice(SDL_Haptic *haptic, size_t num_elems, haptic_elem elems[], effec
 	case SET_GAIN:
 		set_gain(haptic);
 		break;
+
+	case SHOW_STATS:
+		show_stats(haptic);
+		break;
+
+	case SELECT_DEVICES:
+		select_devices();
+		break;
+	}
+}
+
+typedef struct {
+	haptic_device *haptic;
+	effect_slots *slots;
+	bool can_query;
+
+	// what show_status() printed last, 0 for no effect, 1 stopped and 2
+	// playing, and whether it's still up on screen
+	char *shown;
+	bool at_menu;
+
+	// the watched file changed while a prompt was up
+	bool reload_pending;
+} menu;
+
+static void get_status(menu *m, char *status){
+	for(size_t i = 0; i < m->slots->num_elems; ++i){
+		haptic_elem *elem = &m->slots->elems[i];
+		status[i] = elem->active
+			? 1 + (m->can_query && get_effect_status(m->haptic, elem) > 0)
+			: 0;
 	}
 }
 
-void run(SDL_Haptic *haptic, effect_mask supported_effects){
+static void show_menu(menu *m){
+	show_status(m->haptic, m->slots);
+	show_choices();
+
+	if(m->shown)
+		get_status(m, m->shown);
+}
+
+// redraws the menu when effects start or stop while waiting for a choice
+static void refresh_status(void *data){
+	menu *m = data;
+	if(!m->at_menu || !m->shown)
+		return;
+
+	char status[m->slots->num_elems + 1];
+	get_status(m, status);
+	if(!memcmp(status, m->shown, m->slots->num_elems))
+		return;
+
+	puts("");
+	show_menu(m);
+	fflush(stdout);
+}
+
+static void on_status_event(const status_event *e, void *data){
+	refresh_status(data);
+}
+
+static void dispatch_status(void *data){
+	poller_dispatch(data);
+}
+
+static void reload(menu *m){
+	m->reload_pending = false;
+
+	reload_stats stats;
+	poller_hold(poller);
+	int ret = reload_effects(watch, &stats);
+	poller_release(poller);
+
+	if(ret)
+		fprintf(stderr, "%s\n", SDL_GetError());
+	else
+		print_reload_stats(watch, &stats);
+}
+
+// prompts hold on to elems, so reloads wait until we're back at the menu
+static void on_watch(void *data){
+	menu *m = data;
+	if(!watch_changed(watch))
+		return;
+
+	m->reload_pending = true;
+	if(!m->at_menu)
+		return;
+
+	puts("");
+	reload(m);
+	show_menu(m);
+	fflush(stdout);
+}
+
+static void handle_events(void *data){
+	menu *m = data;
+
+	SDL_Event e;
+	while(SDL_PollEvent(&e)){
+		switch(e.type){
+		case SDL_QUIT:
+			reactor_stop(loop);
+			break;
+
+		case SDL_JOYDEVICEADDED:
+			printf("\nJoystick connected: %s\n", SDL_JoystickNameForIndex(e.jdevice.which));
+			break;
+
+		case SDL_JOYDEVICEREMOVED:
+			// SDL has no haptic events, but a wheel going away takes its
+			// haptic device with it
+			printf("\nJoystick disconnected, effects on %s might stop working.\n",
+					m->haptic->name);
+			break;
+		}
+	}
+
+	fflush(stdout);
+}
+
+void run(haptic_device *haptic, effect_slots *slots, effect_mask supported_effects){
 	bool should_run = true;
-	int num_elems = SDL_HapticNumEffects(haptic);
 
-	haptic_elem *elems = (haptic_elem*)calloc(sizeof(haptic_elem), num_elems);
+	menu m = {0};
+	m.haptic = haptic;
+	m.slots = slots;
+	m.can_query = haptic_query(haptic) & SDL_HAPTIC_STATUS;
+	m.shown = calloc(slots->num_elems + 1, 1);
+
+	loop = create_reactor();
+	if(!loop){
+		fprintf(stderr, "%s\n", SDL_GetError());
+		free(m.shown);
+		return;
+	}
+
+	// joysticks that were there from the start aren't news
+	SDL_PumpEvents();
+	SDL_FlushEvents(SDL_JOYDEVICEADDED, SDL_JOYDEVICEADDED);
+
+	// with a poller the menu only has to look again when it says
+	// something changed, otherwise check every now and then
+	int status_timer = -1;
+	if(poller){
+		reactor_add_fd(loop, poller_fd(poller), dispatch_status, poller);
+		poller_subscribe(poller, on_status_event, &m);
+	} else {
+		status_timer = reactor_add_timer(loop, 250, refresh_status, &m);
+	}
+
+	int event_timer = reactor_add_timer(loop, 100, handle_events, &m);
+
+	if(watch)
+		reactor_add_fd(loop, watch_fd(watch), on_watch, &m);
+
 	do {
-		show_status(haptic, num_elems, elems);
+		if(m.reload_pending)
+			reload(&m);
 
-		show_choices();
+		show_menu(&m);
 
 		choice c;
 		for(;;){
+			m.at_menu = true;
 			c = get_choice();
+			m.at_menu = false;
 
 			if(c != TRY_AGAIN)
 				break;
@@ -935,30 +962,733 @@ void run(SDL_Haptic *haptic, effect_mask supported_effects){
 				puts("Try again.");
 		}
 
-		if(c == QUIT)
+		// prompts hold on to elems, so -A waits until they're done
+		if(c == QUIT){
 			should_run = false;
-		else
-			run_choice(haptic, num_elems, elems, supported_effects, c);
+		} else {
+			poller_hold(poller);
+			run_choice(haptic, slots, supported_effects, c);
+			poller_release(poller);
+		}
 
 	} while(should_run);
 
-	free(elems);
+	if(poller)
+		poller_unsubscribe(poller, on_status_event, &m);
+
+	if(watch)
+		reactor_remove_fd(loop, watch_fd(watch));
+
+	if(status_timer >= 0)
+		reactor_remove_timer(loop, status_timer);
+
+	if(event_timer >= 0)
+		reactor_remove_timer(loop, event_timer);
+
+	destroy_reactor(loop);
+	loop = NULL;
+	free(m.shown);
+}
+
+typedef struct {
+	const char *script;
+	const char *stream;
+	size_t stream_depth;
+	const char *shm;
+	const char *sock;
+	unsigned update_rate;
+	const char *sims[RIG_MAX_DEVICES];
+	size_t num_sims;
+	const char *devices;
+	bool interactive;
+	unsigned mix_rate;
+	unsigned morph_rate;
+	unsigned condition_rate;
+	bool timeline;
+	uint64_t timeline_spin;
+	const char *timeline_csv;
+	unsigned status_rate;
+	bool reclaim;
+	bool stats;
+	const char *stats_file;
+	unsigned stats_interval;
+	const char *presets;
+	const char *convert;
+	const char *watch;
+	const char *capcache;
+	const char *status_out;
+	unsigned status_out_rate;
+	int play_limit;
+	const char *record;
+	const char *replay;
+	double replay_speed;
+	calibrate_options calibrate;
+	const char *render;
+	const char *render_out;
+	double render_rate;
+	double render_duration;
+	bool render_raw;
+} options;
+
+static int run_timeline_file(batch *b, FILE *f, const char *file, const options *opts){
+	timeline *t = load_timeline(b, f, file);
+	if(!t){
+		fprintf(stderr, "%s\n", SDL_GetError());
+		return -1;
+	}
+
+	timeline_stats stats;
+	int ret = run_timeline(t, b, opts->timeline_spin, &stats);
+	print_timeline_stats(stderr, &stats);
+
+	if(opts->timeline_csv && write_timeline_csv(t, opts->timeline_csv)){
+		fprintf(stderr, "%s\n", SDL_GetError());
+		ret = -1;
+	}
+
+	free_timeline(t);
+	return ret;
+}
+
+int run_script(haptic_device *haptic, effect_slots *slots, effect_mask supported_effects, const char *script, const options *opts){
+	FILE *f = stdin;
+	if(strcmp(script, "-")){
+		f = fopen(script, "r");
+		if(!f){
+			perror(script);
+			return -1;
+		}
+	}
+
+	batch b;
+	init_batch(&b, slots, supported_effects);
+	b.poller = poller;
+	b.presets = presets;
+	b.rig = rig;
+
+	mix_output *mix = NULL;
+	if(!opts->mix_rate){
+		b.morph = start_morpher(slots, opts->morph_rate);
+		if(!b.morph)
+			fprintf(stderr, "Couldn't start morphing: %s\n", SDL_GetError());
+	} else {
+		b.mixer = create_mixer();
+		if(b.mixer)
+			mix = start_mix(slots, b.mixer, opts->mix_rate);
+
+		if(!mix){
+			fprintf(stderr, "Couldn't start mixer: %s\n", SDL_GetError());
+			destroy_mixer(b.mixer);
+			if(f != stdin)
+				fclose(f);
+
+			return -1;
+		}
+	}
+
+	const char *file = f == stdin ? "<stdin>" : script;
+	int ret = opts->timeline ? run_timeline_file(&b, f, file, opts)
+		: run_batch_file(&b, f, file);
+
+	stop_morpher(b.morph);
+	stop_mix(mix);
+	destroy_mixer(b.mixer);
+
+	if(f != stdin)
+		fclose(f);
+
+	return ret;
+}
+
+int run_stream_file(haptic_device *haptic, effect_slots *slots, const char *file, size_t depth){
+	int fd = 0;
+	if(strcmp(file, "-")){
+		fd = open(file, O_RDONLY | O_BINARY);
+		if(fd < 0){
+			perror(file);
+			return -1;
+		}
+	}
+#ifdef _WIN32
+	else {
+		_setmode(fd, O_BINARY);
+	}
+#endif
+
+	stream_stats stats;
+	int ret = run_stream(slots, fd, depth, &stats);
+	if(ret)
+		fprintf(stderr, "%s\n", SDL_GetError());
+	else
+		print_stream_stats(&stats);
+
+	if(fd != 0)
+		close(fd);
+
+	return ret;
+}
+
+int run_convert(const char *script, const char *out){
+	FILE *f = stdin;
+	if(strcmp(script, "-")){
+		f = fopen(script, "r");
+		if(!f){
+			perror(script);
+			return -1;
+		}
+	}
+
+	int ret = convert_presets(f, f == stdin ? "<stdin>" : script, out);
+	if(ret < 0)
+		fprintf(stderr, "%s\n", SDL_GetError());
+	else
+		fprintf(stderr, "Wrote %i presets to %s\n", ret, out);
+
+	if(f != stdin)
+		fclose(f);
+
+	return ret < 0 ? -1 : 0;
+}
+
+shm_server *server = NULL;
+sock_server *sock = NULL;
+
+static int add_device(haptic_device **devices, size_t *n, haptic_device *haptic){
+	if(!haptic){
+		fprintf(stderr, "Couldn't open haptic device: %s\n", SDL_GetError());
+		return -1;
+	}
+
+	if(*n == RIG_MAX_DEVICES){
+		fprintf(stderr, "At most %i devices can be driven at once.\n", RIG_MAX_DEVICES);
+		close_device(haptic);
+		return -1;
+	}
+
+	devices[(*n)++] = haptic;
+	return 0;
+}
+
+// opens every -S and -D device, as a rig if there's more than one
+haptic_device *get_rig(const options *opts){
+	haptic_device *devices[RIG_MAX_DEVICES];
+	size_t n = 0;
+
+	for(size_t i = 0; i < opts->num_sims; ++i){
+		if(add_device(devices, &n, open_sim_device(opts->sims[i])))
+			goto err;
+	}
+
+	if(opts->devices && !strcmp(opts->devices, "all")){
+		for(int i = 0; i < SDL_NumHaptics(); ++i){
+			if(add_device(devices, &n, open_sdl_device(i)))
+				goto err;
+		}
+	} else if(opts->devices){
+		const char *p = opts->devices;
+		for(;;){
+			char *end;
+			long i = strtol(p, &end, 10);
+			if(end == p || (*end && *end != ',')){
+				fprintf(stderr, "Expected 'all' or device numbers, got '%s'.\n", opts->devices);
+				goto err;
+			}
+
+			if(add_device(devices, &n, open_sdl_device(i)))
+				goto err;
+
+			if(!*end)
+				break;
+
+			p = end + 1;
+		}
+	}
+
+	if(!n){
+		fputs("Couldn't open haptic device: No haptic devices found.\n", stderr);
+		return NULL;
+	}
+
+	haptic_device *haptic = n == 1 ? devices[0] : open_rig(devices, n);
+	if(!haptic){
+		fprintf(stderr, "%s\n", SDL_GetError());
+		goto err;
+	}
+
+	puts(n == 1 ? "Found haptic device:" : "Found haptic devices:");
+	for(size_t i = 0; i < n; ++i)
+		printf("%zu: %s\n", i, devices[i]->name);
+
+	return haptic;
+
+err:
+	while(n)
+		close_device(devices[--n]);
+
+	return NULL;
+}
+
+void on_interrupt(int sig){
+	if(server)
+		request_stop_shm(server);
+
+	if(sock)
+		request_stop_sock(sock);
+}
+
+int serve_shm(haptic_device *haptic, effect_slots *slots, const char *name, bool interactive){
+	server = start_shm(slots, name);
+	if(!server){
+		fprintf(stderr, "%s\n", SDL_GetError());
+		return -1;
+	}
+
+	fprintf(stderr, "Serving force updates on %s\n", name);
+
+	if(interactive){
+		run(haptic, slots, get_supported_effects(haptic));
+	} else {
+		// without the menu nothing else would notice -l being saved
+		if(watch && start_watch_thread(watch))
+			fprintf(stderr, "%s\n", SDL_GetError());
+
+		signal(SIGINT, on_interrupt);
+		signal(SIGTERM, on_interrupt);
+		wait_shm(server);
+	}
+
+	stop_shm(server);
+	server = NULL;
+	return 0;
+}
+
+int serve_sock(haptic_device *haptic, effect_slots *slots, const char *path, bool interactive){
+	effect_mask supported_effects = get_supported_effects(haptic);
+
+	sock = start_sock(slots, supported_effects, path);
+	if(!sock){
+		fprintf(stderr, "%s\n", SDL_GetError());
+		return -1;
+	}
+
+	fprintf(stderr, "Serving clients on %s\n", path);
+
+	if(interactive){
+		run(haptic, slots, supported_effects);
+	} else {
+		if(watch && start_watch_thread(watch))
+			fprintf(stderr, "%s\n", SDL_GetError());
+
+		signal(SIGINT, on_interrupt);
+		signal(SIGTERM, on_interrupt);
+		wait_sock(sock);
+	}
+
+	stop_sock(sock);
+	sock = NULL;
+	return 0;
+}
+
+// -A, streamed and mixed effects are never finished so they stay, and
+// neither are preempted ones waiting to resume. Called on the poller's
+// thread, a prompt or script command may have played the effect again
+// since it was seen stopping, so the device has the last say.
+static void reclaim_finished(const status_event *e, void *data){
+	effect_slots *slots = data;
+	haptic_elem *elem = &slots->elems[e->elem];
+
+	if(!e->playing && elem->active && elem->id == e->id
+			&& slots->priority[e->elem] != SLOT_PRIORITY_MAX
+			&& !(slots->sched && scheduler_queued(slots->sched, elem))
+			&& haptic_effect_status(slots->haptic, elem->id) == 0)
+		destroy_slot_effect(slots, elem);
+}
+
+void usage(const char *prog){
+	fprintf(stderr, "usage: %s [-f script | -t timeline [-j us] [-J csv]] [-s samples] [-q depth] [-m ring | -U socket] [-r rate] [-S spec]... [-D devices] [-K cache] [-O status [-Q hz]] [-N n] [-x rate] [-M hz] [-c rate] [-I] [-P file] [-p ms] [-u hz] [-A] [-w trace] [-b presets] [-l defs] [-i]\n", prog);
+	fprintf(stderr, "       %s -B script -o presets\n", prog);
+	fprintf(stderr, "       %s -W trace [-n speed] [-S spec] [-I]\n", prog);
+	fprintf(stderr, "       %s -L trials [-T units] [-c rate] [-I]\n", prog);
+	fprintf(stderr, "       %s -R script [-o out] [-H rate] [-d ms] [-F csv|f32]\n", prog);
+	fputs("  -f script   run effect commands from script, - for stdin\n", stderr);
+	fputs("  -t timeline run a script with @ms timed commands, see README\n", stderr);
+	fputs("  -j us       busy wait the last us before each timed command (default 0)\n", stderr);
+	fputs("  -J csv      write when each timed command was due and when it ran to csv\n", stderr);
+	fputs("  -s samples  stream 16-bit force samples into a constant effect, - for stdin\n", stderr);
+	fputs("  -q depth    samples queued before old ones are dropped (default 4)\n", stderr);
+	fputs("  -m ring     drain force updates from a shared memory ring, e.g. /ffbsdl\n", stderr);
+	fputs("  -U socket   own the device and serve clients on a Unix socket, see sockproto.h\n", stderr);
+	fputs("  -r rate     upload streamed changes to each effect at most rate times a second\n", stderr);
+	fputs("  -S spec     use a simulated device instead, e.g. slots=16,playing=4,latency=200\n", stderr);
+	fputs("              can be given several times\n", stderr);
+	fputs("  -D devices  drive several devices at once, all or e.g. 0,2\n", stderr);
+	fputs("  -K cache    where to cache what the device can do, none to always ask it\n", stderr);
+	fputs("  -O status   write the state of every effect as JSON lines to status, - for stdout\n", stderr);
+	fputs("  -Q hz       how often to write a status line (default 10)\n", stderr);
+	fputs("  -N n        effects the device plays at once (default what it says), 0 to not schedule\n", stderr);
+	fputs("  -x rate     mix script effects in software into one effect, rate ticks a second\n", stderr);
+	fputs("  -M hz       step morphing effects hz times a second (default 100)\n", stderr);
+	fputs("  -c rate     play condition effects the device can't in software, rate ticks a second\n", stderr);
+	fputs("  -I          time every haptic call, see the i menu command\n", stderr);
+	fputs("  -P file     write call stats as Prometheus text to file, implies -I\n", stderr);
+	fputs("  -p ms       how often to write the stats file (default 1000)\n", stderr);
+	fputs("  -u hz       how often to ask the device which effects are playing (default 10, 0 for never)\n", stderr);
+	fputs("  -A          destroy effects once they finish playing\n", stderr);
+	fputs("  -b presets  load a preset library for the preset command and menu\n", stderr);
+	fputs("  -B script   turn the effects a script creates into a preset library at -o\n", stderr);
+	fputs("  -l defs     create the effects in defs and keep them in sync as it's edited\n", stderr);
+	fputs("  -w trace    record every call made to the device to trace\n", stderr);
+	fputs("  -W trace    replay a recorded trace on the device instead of anything else\n", stderr);
+	fputs("  -n speed    replay this many times faster, 0 for as fast as possible (default 1)\n", stderr);
+	fputs("  -L trials   measure how long the wheel takes to move after a force step\n", stderr);
+	fputs("  -T units    axis movement that counts as moving (default 1000 of 32767)\n", stderr);
+	fputs("  -i          continue interactively after the script/stream\n", stderr);
+	fputs("  -R script   render the effects a script creates to a file, no device needed\n", stderr);
+	fputs("  -o out      where to write the render, - for stdout (default), or the preset library\n", stderr);
+	fputs("  -H rate     render samples per second (default 1000)\n", stderr);
+	fputs("  -d ms       how long to render (default until every effect is done)\n", stderr);
+	fputs("  -F format   csv (default) or f32 for raw interleaved floats\n", stderr);
+}
+
+int parse_options(int argc, char **argv, options *opts){
+	memset(opts, 0, sizeof(*opts));
+	opts->stream_depth = STREAM_DEFAULT_DEPTH;
+	opts->status_rate = 10;
+	opts->morph_rate = 100;
+	opts->status_out_rate = 10;
+	opts->play_limit = -1;
+	opts->render_out = "-";
+	opts->render_rate = 1000;
+	opts->replay_speed = 1;
+	default_calibrate_options(&opts->calibrate);
+
+	for(int i = 1; i < argc; ++i){
+		if(!strcmp(argv[i], "-f") && i + 1 < argc)
+			opts->script = argv[++i];
+		else if(!strcmp(argv[i], "-t") && i + 1 < argc){
+			opts->script = argv[++i];
+			opts->timeline = true;
+		}
+		else if(!strcmp(argv[i], "-j") && i + 1 < argc)
+			opts->timeline_spin = strtoull(argv[++i], NULL, 0) * 1000;
+		else if(!strcmp(argv[i], "-J") && i + 1 < argc)
+			opts->timeline_csv = argv[++i];
+		else if(!strcmp(argv[i], "-s") && i + 1 < argc)
+			opts->stream = argv[++i];
+		else if(!strcmp(argv[i], "-q") && i + 1 < argc)
+			opts->stream_depth = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-m") && i + 1 < argc)
+			opts->shm = argv[++i];
+		else if(!strcmp(argv[i], "-U") && i + 1 < argc)
+			opts->sock = argv[++i];
+		else if(!strcmp(argv[i], "-r") && i + 1 < argc)
+			opts->update_rate = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-S") && i + 1 < argc && opts->num_sims < RIG_MAX_DEVICES)
+			opts->sims[opts->num_sims++] = argv[++i];
+		else if(!strcmp(argv[i], "-D") && i + 1 < argc)
+			opts->devices = argv[++i];
+		else if(!strcmp(argv[i], "-x") && i + 1 < argc)
+			opts->mix_rate = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-O") && i + 1 < argc)
+			opts->status_out = argv[++i];
+		else if(!strcmp(argv[i], "-Q") && i + 1 < argc)
+			opts->status_out_rate = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-N") && i + 1 < argc)
+			opts->play_limit = strtol(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-K") && i + 1 < argc)
+			opts->capcache = argv[++i];
+		else if(!strcmp(argv[i], "-M") && i + 1 < argc)
+			opts->morph_rate = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-c") && i + 1 < argc)
+			opts->condition_rate = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-u") && i + 1 < argc)
+			opts->status_rate = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-A"))
+			opts->reclaim = true;
+		else if(!strcmp(argv[i], "-I"))
+			opts->stats = true;
+		else if(!strcmp(argv[i], "-P") && i + 1 < argc)
+			opts->stats_file = argv[++i];
+		else if(!strcmp(argv[i], "-p") && i + 1 < argc)
+			opts->stats_interval = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-b") && i + 1 < argc)
+			opts->presets = argv[++i];
+		else if(!strcmp(argv[i], "-B") && i + 1 < argc)
+			opts->convert = argv[++i];
+		else if(!strcmp(argv[i], "-l") && i + 1 < argc)
+			opts->watch = argv[++i];
+		else if(!strcmp(argv[i], "-w") && i + 1 < argc)
+			opts->record = argv[++i];
+		else if(!strcmp(argv[i], "-W") && i + 1 < argc)
+			opts->replay = argv[++i];
+		else if(!strcmp(argv[i], "-n") && i + 1 < argc)
+			opts->replay_speed = strtod(argv[++i], NULL);
+		else if(!strcmp(argv[i], "-L") && i + 1 < argc)
+			opts->calibrate.trials = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-T") && i + 1 < argc)
+			opts->calibrate.threshold = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-i"))
+			opts->interactive = true;
+		else if(!strcmp(argv[i], "-R") && i + 1 < argc)
+			opts->render = argv[++i];
+		else if(!strcmp(argv[i], "-o") && i + 1 < argc)
+			opts->render_out = argv[++i];
+		else if(!strcmp(argv[i], "-H") && i + 1 < argc)
+			opts->render_rate = strtod(argv[++i], NULL);
+		else if(!strcmp(argv[i], "-d") && i + 1 < argc)
+			opts->render_duration = strtod(argv[++i], NULL);
+		else if(!strcmp(argv[i], "-F") && i + 1 < argc){
+			const char *format = argv[++i];
+			if(!strcmp(format, "f32"))
+				opts->render_raw = true;
+			else if(strcmp(format, "csv"))
+				return -1;
+		}
+		else
+			return -1;
+	}
+
+	if(opts->convert)
+		return strcmp(opts->render_out, "-") ? 0 : -1;
+
+	if(opts->render || opts->replay || opts->calibrate.trials)
+		return 0;
+
+	if(!opts->script && !opts->stream && !opts->shm && !opts->sock)
+		opts->interactive = true;
+
+	return 0;
 }
 
 int main(int argc, char **argv){
-	if(init())
+	int ret = 1;
+	uint64_t start = now_ns();
+	char *default_capcache = NULL;
+
+	options opts;
+	if(parse_options(argc, argv, &opts)){
+		usage(argv[0]);
+		return ret;
+	}
+
+	if(opts.convert){
+		ret = !!run_convert(opts.convert, opts.render_out);
+		goto init_err;
+	}
+
+	if(opts.render){
+		// rendering never touches a device, SDL is only needed for threads
+		if(init(true))
+			goto init_err;
+
+		ret = run_render(opts.render, opts.render_out, opts.render_rate,
+				opts.render_duration, opts.render_raw);
+		if(ret)
+			fprintf(stderr, "%s\n", SDL_GetError());
+
+		ret = !!ret;
+		goto haptic_err;
+	}
+
+	if(init(opts.num_sims && !opts.devices))
 		goto init_err;
 
-	SDL_Haptic *haptic = get_haptic();
+	const char *capcache = opts.capcache;
+	if(!capcache)
+		capcache = default_capcache = default_capcache_path();
+	else if(!strcmp(capcache, "none"))
+		capcache = NULL;
+
+	haptic_device *haptic = opts.devices || opts.num_sims > 1 ? get_rig(&opts)
+		: get_haptic(opts.num_sims ? opts.sims[0] : NULL, capcache);
 	if(!haptic)
 		goto haptic_err;
 
+	rig = is_rig(haptic) ? haptic : NULL;
+	bool cached = from_capcache(haptic);
+
+	SDL_Joystick *joy = NULL;
+	if(opts.condition_rate){
+		joy = get_joystick(haptic);
+		haptic_device *wrapped = joy ? wrap_conditions(haptic, joy, opts.condition_rate) : NULL;
+		if(!wrapped){
+			if(joy)
+				fprintf(stderr, "Couldn't play conditions in software: %s\n", SDL_GetError());
+
+			destroy_haptic(haptic);
+			goto joystick_err;
+		}
+
+		haptic = wrapped;
+	}
+
+	stats_dump *dump = NULL;
+	if(opts.stats || opts.stats_file){
+		if(enable_device_stats(haptic)){
+			fprintf(stderr, "%s\n", SDL_GetError());
+			goto slots_err;
+		}
+
+		// the rig's own stats only time handing calls to the workers
+		for(size_t i = 0; rig && i < rig_size(rig); ++i){
+			if(enable_device_stats(rig_device(rig, i))){
+				fprintf(stderr, "%s\n", SDL_GetError());
+				goto slots_err;
+			}
+		}
+	}
+
+	if(opts.stats_file){
+		dump = start_stats_dump(haptic->name, haptic->stats, opts.stats_file,
+				opts.stats_interval);
+		if(!dump){
+			fprintf(stderr, "Couldn't write stats: %s\n", SDL_GetError());
+			goto slots_err;
+		}
+	}
+
+	if(opts.record && enable_device_trace(haptic, opts.record)){
+		fprintf(stderr, "%s\n", SDL_GetError());
+		goto slots_err;
+	}
+
+	if(opts.replay){
+		ret = !!replay_trace(haptic, opts.replay, opts.replay_speed);
+		if(ret)
+			fprintf(stderr, "%s\n", SDL_GetError());
+
+		if(opts.stats)
+			print_device_stats(stderr, haptic->name, haptic->stats);
+
+		goto slots_err;
+	}
+
+	if(opts.calibrate.trials){
+		// -c already has the joystick open
+		if(!joy)
+			joy = get_joystick(haptic);
+
+		ret = !joy || calibrate_latency(haptic, joy, &opts.calibrate);
+		if(joy && ret)
+			fprintf(stderr, "%s\n", SDL_GetError());
+
+		if(opts.stats)
+			print_device_stats(stderr, haptic->name, haptic->stats);
+
+		goto slots_err;
+	}
+
+	if(opts.presets){
+		presets = open_presets(opts.presets);
+		if(!presets){
+			fprintf(stderr, "%s\n", SDL_GetError());
+			goto slots_err;
+		}
+	}
+
 	effect_mask supported_effects = get_supported_effects(haptic);
-	run(haptic, supported_effects);
+	set_update_rate(opts.update_rate);
+
+	int num_elems = haptic_num_effects(haptic);
+
+	effect_slots slot_table, *slots = &slot_table;
+	if(num_elems < 0 || init_slots(slots, haptic, num_elems)){
+		fprintf(stderr, "%s\n", SDL_GetError());
+		goto slots_err;
+	}
+
+	if(opts.stats)
+		fprintf(stderr, "startup: %.1f ms, capabilities from the %s\n",
+				(now_ns() - start) / 1e6, cached ? "cache" : "device");
+
+	// only worth it when the device can hold effects it can't play at once
+	play_scheduler *sched = NULL;
+	int limit = opts.play_limit < 0 ? haptic_num_playing(haptic) : opts.play_limit;
+	if(limit > 0 && (limit < num_elems || opts.play_limit > 0)){
+		sched = start_scheduler(slots, limit);
+		if(!sched){
+			fprintf(stderr, "%s\n", SDL_GetError());
+			goto sched_err;
+		}
+	}
 
+	// the menu and -O fall back to asking the device themselves, only -A
+	// really needs the poller
+	if((opts.interactive || opts.reclaim || opts.status_out) && opts.status_rate){
+		poller = start_status_poller(slots, opts.status_rate);
+		if(!poller && opts.reclaim)
+			fprintf(stderr, "Can't destroy finished effects: %s\n", SDL_GetError());
+
+		if(poller && opts.reclaim)
+			poller_subscribe_locked(poller, reclaim_finished, slots);
+	}
+
+	if(opts.watch){
+		watch = start_watch(slots, supported_effects, opts.watch);
+		if(!watch){
+			fprintf(stderr, "%s\n", SDL_GetError());
+			goto watch_err;
+		}
+	}
+
+	monitor *status = NULL;
+	if(opts.status_out){
+		status = start_monitor(slots, poller, opts.status_out, opts.status_out_rate);
+		if(!status){
+			fprintf(stderr, "%s\n", SDL_GetError());
+			goto monitor_err;
+		}
+	}
+
+	ret = 0;
+	if(opts.script && run_script(haptic, slots, supported_effects, opts.script, &opts))
+		ret = 1;
+
+	if(opts.stream && run_stream_file(haptic, slots, opts.stream, opts.stream_depth))
+		ret = 1;
+
+	if(opts.shm){
+		if(serve_shm(haptic, slots, opts.shm, opts.interactive))
+			ret = 1;
+	} else if(opts.sock){
+		if(serve_sock(haptic, slots, opts.sock, opts.interactive))
+			ret = 1;
+	} else if(opts.interactive){
+		run(haptic, slots, supported_effects);
+	}
+
+	print_update_stats();
+	print_slot_stats(slots);
+	if(opts.stats)
+		print_device_stats(stderr, haptic->name, haptic->stats);
+
+	for(size_t i = 0; rig && opts.stats && i < rig_size(rig); ++i)
+		print_device_stats(stderr, rig_device(rig, i)->name, rig_device(rig, i)->stats);
+
+	if(rig)
+		print_rig_stats(stderr, rig);
+
+	stop_monitor(status);
+monitor_err:
+	stop_watch(watch);
+	watch = NULL;
+watch_err:
+	stop_status_poller(poller);
+	poller = NULL;
+	stop_scheduler(sched);
+sched_err:
+	free_slots(slots);
+	close_presets(presets);
+	presets = NULL;
+slots_err:
+	stop_stats_dump(dump);
 	destroy_haptic(haptic);
+	rig = NULL;
+joystick_err:
+	destroy_joystick(joy);
 haptic_err:
 	cleanup();
 init_err:
-	return 0;
+	free(default_capcache);
+	return ret;
 }
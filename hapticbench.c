@@ -0,0 +1,259 @@
+// Benchmark for the haptic calls ffbsdl makes. Creates, updates, runs,
+// queries, stops and destroys every supported effect type over and over,
+// then prints latency percentiles for each call and how many calls per
+// second each type got through, and appends them to a CSV file so runs on
+// different drivers can be compared.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <SDL2/SDL.h>
+#include "device.h"
+#include "effect.h"
+#include "hist.h"
+#include "timing.h"
+
+typedef enum {
+	CALL_NEW,
+	CALL_UPDATE,
+	CALL_RUN,
+	CALL_STATUS,
+	CALL_STOP,
+	CALL_DESTROY,
+	NUM_CALLS,
+} call;
+
+static const char *call_names[NUM_CALLS] = {
+	"new", "update", "run", "status", "stop", "destroy",
+};
+
+// the effects the create_*() prompts can build
+static const Uint16 types[] = {
+	SDL_HAPTIC_CONSTANT,
+	SDL_HAPTIC_SINE,
+	SDL_HAPTIC_TRIANGLE,
+	SDL_HAPTIC_SAWTOOTHUP,
+	SDL_HAPTIC_SAWTOOTHDOWN,
+	SDL_HAPTIC_RAMP,
+	SDL_HAPTIC_SPRING,
+	SDL_HAPTIC_DAMPER,
+	SDL_HAPTIC_INERTIA,
+	SDL_HAPTIC_FRICTION,
+};
+
+#define NUM_TYPES (sizeof(types) / sizeof(types[0]))
+
+typedef struct {
+	const char *sim;
+	int device;
+	size_t rounds;
+	size_t warmup;
+	const char *out;
+} options;
+
+void usage(const char *prog){
+	fprintf(stderr, "usage: %s [-d index] [-S spec] [-n rounds] [-w warmup] [-o results.csv]\n", prog);
+	fputs("  -d index    haptic device to benchmark (default 0)\n", stderr);
+	fputs("  -S spec     benchmark a simulated device instead, see ffbsdl -S\n", stderr);
+	fputs("  -n rounds   times to go through every call for each type (default 1000)\n", stderr);
+	fputs("  -w warmup   rounds to run before timing (default 50)\n", stderr);
+	fputs("  -o file     append results to file as CSV\n", stderr);
+}
+
+int parse_options(int argc, char **argv, options *opts){
+	memset(opts, 0, sizeof(*opts));
+	opts->rounds = 1000;
+	opts->warmup = 50;
+
+	for(int i = 1; i < argc; ++i){
+		if(!strcmp(argv[i], "-d") && i + 1 < argc)
+			opts->device = strtol(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-S") && i + 1 < argc)
+			opts->sim = argv[++i];
+		else if(!strcmp(argv[i], "-n") && i + 1 < argc)
+			opts->rounds = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-w") && i + 1 < argc)
+			opts->warmup = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-o") && i + 1 < argc)
+			opts->out = argv[++i];
+		else
+			return -1;
+	}
+
+	return 0;
+}
+
+// one pass through every call, recorded into h unless it's NULL
+static int bench_round(haptic_device *haptic, SDL_HapticEffect *effect,
+		bool status, hist h[NUM_CALLS]){
+	uint64_t t[NUM_CALLS + 1];
+
+	t[CALL_NEW] = now_ns();
+	int id = haptic_new_effect(haptic, effect);
+	if(id < 0)
+		return -1;
+
+	// change something every round so drivers that skip identical
+	// updates still have to do the work
+	effect->constant.delay ^= 1;
+
+	t[CALL_UPDATE] = now_ns();
+	int ret = haptic_update_effect(haptic, id, effect);
+
+	t[CALL_RUN] = now_ns();
+	ret |= haptic_run_effect(haptic, id, 1);
+
+	t[CALL_STATUS] = now_ns();
+	if(status)
+		ret |= haptic_effect_status(haptic, id) < 0;
+
+	t[CALL_STOP] = now_ns();
+	ret |= haptic_stop_effect(haptic, id);
+
+	t[CALL_DESTROY] = now_ns();
+	haptic_destroy_effect(haptic, id);
+	t[NUM_CALLS] = now_ns();
+
+	if(ret)
+		return -1;
+
+	for(int c = 0; h && c < NUM_CALLS; ++c){
+		if(c != CALL_STATUS || status)
+			hist_add(&h[c], t[c + 1] - t[c]);
+	}
+
+	return 0;
+}
+
+// calls is how many were timed in elapsed nanoseconds of wall clock, which
+// goes in a row of its own as the calls aren't timed back to back
+static void write_results(FILE *f, const char *stamp, haptic_device *haptic,
+		Uint16 type, const hist h[NUM_CALLS], uint64_t calls, uint64_t elapsed){
+	for(int c = 0; c < NUM_CALLS; ++c){
+		if(!h[c].count)
+			continue;
+
+		fprintf(f, "%s,\"%s\",%s,%s,%s,%llu,%llu,%llu,%llu,%llu,%llu,\n",
+				stamp, haptic->name, haptic->backend->name,
+				get_haptic_type_name(type), call_names[c],
+				(unsigned long long)h[c].count,
+				(unsigned long long)(h[c].sum / h[c].count),
+				(unsigned long long)hist_percentile(&h[c], 50),
+				(unsigned long long)hist_percentile(&h[c], 99),
+				(unsigned long long)hist_percentile(&h[c], 99.9),
+				(unsigned long long)h[c].max);
+	}
+
+	fprintf(f, "%s,\"%s\",%s,%s,all,%llu,%llu,,,,,%.0f\n",
+			stamp, haptic->name, haptic->backend->name,
+			get_haptic_type_name(type), (unsigned long long)calls,
+			(unsigned long long)(calls ? elapsed / calls : 0),
+			elapsed ? calls * 1e9 / elapsed : 0);
+}
+
+int main(int argc, char **argv){
+	options opts;
+	if(parse_options(argc, argv, &opts)){
+		usage(argv[0]);
+		return 1;
+	}
+
+	if(SDL_Init(opts.sim ? 0 : SDL_INIT_HAPTIC)){
+		fprintf(stderr, "%s\n", SDL_GetError());
+		return 1;
+	}
+
+	int ret = 1;
+	haptic_device *haptic = opts.sim ? open_sim_device(opts.sim)
+		: open_sdl_device(opts.device);
+	if(!haptic){
+		fprintf(stderr, "Couldn't open haptic device: %s\n", SDL_GetError());
+		goto haptic_err;
+	}
+
+	FILE *out = NULL;
+	if(opts.out){
+		out = fopen(opts.out, "a");
+		if(!out){
+			perror(opts.out);
+			goto out_err;
+		}
+
+		// only the first run into a file gets a header
+		if(ftell(out) == 0)
+			fputs("time,device,backend,type,call,count,mean_ns,p50_ns,p99_ns,p999_ns,max_ns,calls_per_sec\n", out);
+	}
+
+	char stamp[32];
+	time_t now = time(NULL);
+	strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+	unsigned int supported = haptic_query(haptic);
+	bool status = supported & SDL_HAPTIC_STATUS;
+
+	printf("%s (%s), %zu rounds\n", haptic->name, haptic->backend->name, opts.rounds);
+	if(!status)
+		puts("device can't report effect status, skipping status calls");
+
+	ret = 0;
+	for(size_t i = 0; i < NUM_TYPES; ++i){
+		Uint16 type = types[i];
+		if(!(supported & type))
+			continue;
+
+		SDL_HapticEffect effect;
+		init_effect(&effect, type);
+		mirror_condition_axes(&effect);
+
+		hist h[NUM_CALLS];
+		for(int c = 0; c < NUM_CALLS; ++c)
+			hist_init(&h[c]);
+
+		int err = 0;
+		uint64_t start = now_ns();
+		for(size_t r = 0; r < opts.warmup + opts.rounds && !err; ++r){
+			if(r == opts.warmup)
+				start = now_ns();
+
+			err = bench_round(haptic, &effect, status, r < opts.warmup ? NULL : h);
+		}
+
+		uint64_t elapsed = now_ns() - start;
+
+		if(err){
+			fprintf(stderr, "%s: %s\n", get_haptic_type_name(type), SDL_GetError());
+			ret = 1;
+			continue;
+		}
+
+		uint64_t calls = 0;
+		for(int c = 0; c < NUM_CALLS; ++c){
+			if(!h[c].count)
+				continue;
+
+			char name[64];
+			snprintf(name, sizeof(name), "%s %s", get_haptic_type_name(type), call_names[c]);
+			hist_print(stdout, name, &h[c]);
+			calls += h[c].count;
+		}
+
+		// includes reading the clock between calls, as any caller timing
+		// its calls would
+		printf("%s: %llu calls in %.1fms, %.0f calls/s\n", get_haptic_type_name(type),
+				(unsigned long long)calls, elapsed / 1e6,
+				elapsed ? calls * 1e9 / elapsed : 0);
+
+		if(out)
+			write_results(out, stamp, haptic, type, h, calls, elapsed);
+	}
+
+	if(out)
+		fclose(out);
+
+out_err:
+	close_device(haptic);
+haptic_err:
+	SDL_Quit();
+	return ret;
+}
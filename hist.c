@@ -0,0 +1,88 @@
+#include <string.h>
+#include "hist.h"
+
+void hist_init(hist *h){
+	memset(h, 0, sizeof(*h));
+	h->min = UINT64_MAX;
+}
+
+size_t hist_bucket(uint64_t v){
+	int msb = v ? 63 - __builtin_clzll(v) : 0;
+	int e = msb - HIST_SUB_BITS + 1;
+	if(e < 0)
+		e = 0;
+
+	return ((size_t)e << (HIST_SUB_BITS - 1)) + (v >> e);
+}
+
+// highest value that still lands in bucket i
+uint64_t hist_bucket_value(size_t i){
+	if(i < (1 << HIST_SUB_BITS))
+		return i;
+
+	int e = (i >> (HIST_SUB_BITS - 1)) - 1;
+	uint64_t m = i - ((size_t)e << (HIST_SUB_BITS - 1));
+	return ((m + 1) << e) - 1;
+}
+
+void hist_add(hist *h, uint64_t v){
+	h->buckets[hist_bucket(v)]++;
+	h->count++;
+	h->sum += v;
+
+	if(v < h->min)
+		h->min = v;
+
+	if(v > h->max)
+		h->max = v;
+}
+
+void hist_merge(hist *dst, const hist *src){
+	for(size_t i = 0; i < HIST_BUCKETS; ++i)
+		dst->buckets[i] += src->buckets[i];
+
+	dst->count += src->count;
+	dst->sum += src->sum;
+
+	if(src->min < dst->min)
+		dst->min = src->min;
+
+	if(src->max > dst->max)
+		dst->max = src->max;
+}
+
+uint64_t hist_percentile(const hist *h, double p){
+	if(!h->count)
+		return 0;
+
+	uint64_t target = (uint64_t)(p / 100.0 * h->count + 0.5);
+	if(target < 1)
+		target = 1;
+
+	uint64_t seen = 0;
+	for(size_t i = 0; i < HIST_BUCKETS; ++i){
+		seen += h->buckets[i];
+		if(seen >= target){
+			uint64_t v = hist_bucket_value(i);
+			return v > h->max ? h->max : v;
+		}
+	}
+
+	return h->max;
+}
+
+void hist_print(FILE *f, const char *name, const hist *h){
+	if(!h->count){
+		fprintf(f, "%s: no samples\n", name);
+		return;
+	}
+
+	fprintf(f, "%s: n=%llu min=%.1fus mean=%.1fus p50=%.1fus p99=%.1fus p999=%.1fus max=%.1fus\n",
+			name, (unsigned long long)h->count,
+			h->min / 1000.0,
+			(double)h->sum / h->count / 1000.0,
+			hist_percentile(h, 50) / 1000.0,
+			hist_percentile(h, 99) / 1000.0,
+			hist_percentile(h, 99.9) / 1000.0,
+			h->max / 1000.0);
+}
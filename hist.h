@@ -0,0 +1,34 @@
+#ifndef HIST_H
+#define HIST_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// Log-linear histogram in the style of HdrHistogram: every power of two is
+// split into 2^(HIST_SUB_BITS - 1) buckets, which keeps the relative error
+// of any recorded value under ~3% while covering the full 64-bit range.
+#define HIST_SUB_BITS 6
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 2) << (HIST_SUB_BITS - 1))
+
+typedef struct {
+	uint64_t count;
+	uint64_t min;
+	uint64_t max;
+	uint64_t sum;
+	uint64_t buckets[HIST_BUCKETS];
+} hist;
+
+void hist_init(hist *h);
+void hist_add(hist *h, uint64_t v);
+void hist_merge(hist *dst, const hist *src);
+
+size_t hist_bucket(uint64_t v);
+uint64_t hist_bucket_value(size_t i);
+
+// p is in percent, so hist_percentile(h, 99.9) gives the p999
+uint64_t hist_percentile(const hist *h, double p);
+
+// values are assumed to be nanoseconds and printed in microseconds
+void hist_print(FILE *f, const char *name, const hist *h);
+
+#endif /* HIST_H */
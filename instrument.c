@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "instrument.h"
+
+const char *haptic_call_name(haptic_call call){
+	static const char *names[NUM_HCALLS] = {
+		"new_effect",
+		"update_effect",
+		"run_effect",
+		"stop_effect",
+		"destroy_effect",
+		"effect_status",
+		"set_gain",
+		"set_autocenter",
+	};
+
+	return call < NUM_HCALLS ? names[call] : "unknown";
+}
+
+device_stats *create_device_stats(){
+	device_stats *stats = calloc(1, sizeof(*stats));
+	if(!stats){
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	for(int i = 0; i < NUM_HCALLS; ++i)
+		atomic_init(&stats->calls[i].min, UINT64_MAX);
+
+	return stats;
+}
+
+void destroy_device_stats(device_stats *stats){
+	free(stats);
+}
+
+void record_call(device_stats *stats, haptic_call call, uint64_t ns, const char *error){
+	call_stats *c = &stats->calls[call];
+
+	atomic_fetch_add_explicit(&c->buckets[hist_bucket(ns)], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&c->sum, ns, memory_order_relaxed);
+	atomic_fetch_add_explicit(&c->count, 1, memory_order_relaxed);
+
+	// calls on one device are serialized, so these rarely retry
+	uint64_t v = atomic_load_explicit(&c->min, memory_order_relaxed);
+	while(ns < v && !atomic_compare_exchange_weak_explicit(&c->min, &v, ns,
+				memory_order_relaxed, memory_order_relaxed));
+
+	v = atomic_load_explicit(&c->max, memory_order_relaxed);
+	while(ns > v && !atomic_compare_exchange_weak_explicit(&c->max, &v, ns,
+				memory_order_relaxed, memory_order_relaxed));
+
+	if(error){
+		atomic_fetch_add_explicit(&c->errors, 1, memory_order_relaxed);
+
+		SDL_AtomicLock(&c->error_lock);
+		snprintf(c->last_error, sizeof(c->last_error), "%s", error);
+		SDL_AtomicUnlock(&c->error_lock);
+	}
+}
+
+void snapshot_call(device_stats *stats, haptic_call call, hist *h, uint64_t *errors,
+		char last_error[CALL_ERROR_LEN]){
+	call_stats *c = &stats->calls[call];
+
+	// not one consistent snapshot, a call recorded meanwhile might show up
+	// in the buckets but not the count, which doesn't matter for stats
+	hist_init(h);
+	for(size_t i = 0; i < HIST_BUCKETS; ++i)
+		h->buckets[i] = atomic_load_explicit(&c->buckets[i], memory_order_relaxed);
+
+	h->count = atomic_load_explicit(&c->count, memory_order_relaxed);
+	h->sum = atomic_load_explicit(&c->sum, memory_order_relaxed);
+	h->min = atomic_load_explicit(&c->min, memory_order_relaxed);
+	h->max = atomic_load_explicit(&c->max, memory_order_relaxed);
+
+	if(errors)
+		*errors = atomic_load_explicit(&c->errors, memory_order_relaxed);
+
+	if(last_error){
+		SDL_AtomicLock(&c->error_lock);
+		memcpy(last_error, c->last_error, CALL_ERROR_LEN);
+		SDL_AtomicUnlock(&c->error_lock);
+	}
+}
+
+void print_device_stats(FILE *f, const char *device, device_stats *stats){
+	fprintf(f, "%s:\n", device);
+
+	for(int i = 0; i < NUM_HCALLS; ++i){
+		hist h;
+		uint64_t errors;
+		char last_error[CALL_ERROR_LEN];
+		snapshot_call(stats, i, &h, &errors, last_error);
+
+		if(!h.count)
+			continue;
+
+		hist_print(f, haptic_call_name(i), &h);
+		if(errors)
+			fprintf(f, "  %llu errors, last: %s\n",
+					(unsigned long long)errors, last_error);
+	}
+}
+
+// label values can't hold raw quotes, backslashes or newlines
+static void write_label(FILE *f, const char *s){
+	for(; *s; ++s){
+		if(*s == '"' || *s == '\\')
+			fputc('\\', f);
+
+		if(*s == '\n')
+			fputs("\\n", f);
+		else
+			fputc(*s, f);
+	}
+}
+
+#define LABELS(f, device, call) \
+	fputs("{device=\"", f); \
+	write_label(f, device); \
+	fprintf(f, "\",call=\"%s\"", haptic_call_name(call))
+
+void write_prometheus(FILE *f, const char *device, device_stats *stats){
+	static const double quantiles[] = {0.5, 0.99, 0.999};
+
+	hist h[NUM_HCALLS];
+	uint64_t errors[NUM_HCALLS];
+	for(int i = 0; i < NUM_HCALLS; ++i)
+		snapshot_call(stats, i, &h[i], &errors[i], NULL);
+
+	fputs("# HELP ffbsdl_haptic_calls_total Haptic calls made.\n", f);
+	fputs("# TYPE ffbsdl_haptic_calls_total counter\n", f);
+	for(int i = 0; i < NUM_HCALLS; ++i){
+		fputs("ffbsdl_haptic_calls_total", f);
+		LABELS(f, device, i);
+		fprintf(f, "} %llu\n", (unsigned long long)h[i].count);
+	}
+
+	fputs("# HELP ffbsdl_haptic_errors_total Haptic calls that failed.\n", f);
+	fputs("# TYPE ffbsdl_haptic_errors_total counter\n", f);
+	for(int i = 0; i < NUM_HCALLS; ++i){
+		fputs("ffbsdl_haptic_errors_total", f);
+		LABELS(f, device, i);
+		fprintf(f, "} %llu\n", (unsigned long long)errors[i]);
+	}
+
+	fputs("# HELP ffbsdl_haptic_call_seconds Time spent in haptic calls.\n", f);
+	fputs("# TYPE ffbsdl_haptic_call_seconds summary\n", f);
+	for(int i = 0; i < NUM_HCALLS; ++i){
+		for(size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); ++q){
+			fputs("ffbsdl_haptic_call_seconds", f);
+			LABELS(f, device, i);
+			fprintf(f, ",quantile=\"%g\"} %.9f\n", quantiles[q],
+					hist_percentile(&h[i], quantiles[q] * 100) / 1e9);
+		}
+
+		fputs("ffbsdl_haptic_call_seconds_sum", f);
+		LABELS(f, device, i);
+		fprintf(f, "} %.9f\n", h[i].sum / 1e9);
+
+		fputs("ffbsdl_haptic_call_seconds_count", f);
+		LABELS(f, device, i);
+		fprintf(f, "} %llu\n", (unsigned long long)h[i].count);
+	}
+}
+
+#undef LABELS
+
+struct stats_dump {
+	const char *device;
+	device_stats *stats;
+	const char *path;
+	char tmp[4096];
+	unsigned interval;
+
+	SDL_Thread *thread;
+	SDL_mutex *lock;
+	SDL_cond *cond;
+	bool stop;
+};
+
+static int dump(stats_dump *d){
+	FILE *f = fopen(d->tmp, "w");
+	if(!f)
+		return -1;
+
+	write_prometheus(f, d->device, d->stats);
+	if(fclose(f))
+		return -1;
+
+#ifdef _WIN32
+	// rename() won't replace an existing file on Windows
+	remove(d->path);
+#endif
+
+	return rename(d->tmp, d->path);
+}
+
+static int dump_thread(void *data){
+	stats_dump *d = data;
+	bool warned = false;
+
+	SDL_LockMutex(d->lock);
+	while(!d->stop){
+		SDL_CondWaitTimeout(d->cond, d->lock, d->interval);
+
+		// only complain once, the file might become writable again
+		if(dump(d) && !warned){
+			perror(d->path);
+			warned = true;
+		}
+	}
+
+	SDL_UnlockMutex(d->lock);
+	return 0;
+}
+
+stats_dump *start_stats_dump(const char *device, device_stats *stats,
+		const char *path, unsigned interval){
+	stats_dump *d = calloc(1, sizeof(*d));
+	if(!d){
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	if(snprintf(d->tmp, sizeof(d->tmp), "%s.tmp", path) >= (int)sizeof(d->tmp)){
+		free(d);
+		SDL_SetError("Stats path is too long.");
+		return NULL;
+	}
+
+	d->device = device;
+	d->stats = stats;
+	d->path = path;
+	d->interval = interval ? interval : 1000;
+
+	d->lock = SDL_CreateMutex();
+	d->cond = SDL_CreateCond();
+	if(d->lock && d->cond)
+		d->thread = SDL_CreateThread(dump_thread, "stats", d);
+
+	if(!d->thread){
+		SDL_DestroyCond(d->cond);
+		SDL_DestroyMutex(d->lock);
+		free(d);
+		return NULL;
+	}
+
+	return d;
+}
+
+void stop_stats_dump(stats_dump *d){
+	if(!d)
+		return;
+
+	SDL_LockMutex(d->lock);
+	d->stop = true;
+	SDL_CondSignal(d->cond);
+	SDL_UnlockMutex(d->lock);
+
+	SDL_WaitThread(d->thread, NULL);
+	SDL_DestroyCond(d->cond);
+	SDL_DestroyMutex(d->lock);
+	free(d);
+}
@@ -0,0 +1,73 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <SDL2/SDL.h>
+#include "hist.h"
+
+// Per device counters and latency histograms for every call that goes
+// through the device wrappers. Recording only uses relaxed atomics, so the
+// menu and the Prometheus dump can read them while other threads call in.
+// Devices without stats skip all of this, see enable_device_stats().
+
+typedef enum {
+	HCALL_NEW_EFFECT,
+	HCALL_UPDATE_EFFECT,
+	HCALL_RUN_EFFECT,
+	HCALL_STOP_EFFECT,
+	HCALL_DESTROY_EFFECT,
+	HCALL_EFFECT_STATUS,
+	HCALL_SET_GAIN,
+	HCALL_SET_AUTOCENTER,
+	NUM_HCALLS,
+} haptic_call;
+
+#define CALL_ERROR_LEN 128
+
+typedef struct {
+	atomic_ullong count;
+	atomic_ullong errors;
+	atomic_ullong sum;
+	atomic_ullong min;
+	atomic_ullong max;
+	atomic_ullong buckets[HIST_BUCKETS];
+
+	// only written when a call fails, so a spinlock is plenty
+	SDL_SpinLock error_lock;
+	char last_error[CALL_ERROR_LEN];
+} call_stats;
+
+typedef struct {
+	call_stats calls[NUM_HCALLS];
+} device_stats;
+
+const char *haptic_call_name(haptic_call call);
+
+device_stats *create_device_stats();
+void destroy_device_stats(device_stats *stats);
+
+// error is what SDL_GetError() said, NULL if the call succeeded
+void record_call(device_stats *stats, haptic_call call, uint64_t ns, const char *error);
+
+// copies a call's latencies into h, which can then be used as usual
+void snapshot_call(device_stats *stats, haptic_call call, hist *h, uint64_t *errors,
+		char last_error[CALL_ERROR_LEN]);
+
+void print_device_stats(FILE *f, const char *device, device_stats *stats);
+
+// Prometheus text exposition format, with latencies as a summary in seconds
+void write_prometheus(FILE *f, const char *device, device_stats *stats);
+
+typedef struct stats_dump stats_dump;
+
+// Rewrites path with write_prometheus() every interval milliseconds, going
+// through a temporary file so readers never see half of it.
+stats_dump *start_stats_dump(const char *device, device_stats *stats,
+		const char *path, unsigned interval);
+
+// writes the file one last time and stops
+void stop_stats_dump(stats_dump *d);
+
+#endif /* INSTRUMENT_H */
@@ -0,0 +1,140 @@
+// Benchmark for the software mixer. Ticks mixers holding more and more
+// playing logical effects and prints how long each tick took, the target
+// being a few microseconds with hundreds of effects.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "mixer.h"
+#include "hist.h"
+#include "timing.h"
+
+static const Uint16 types[] = {
+	SDL_HAPTIC_CONSTANT,
+	SDL_HAPTIC_SINE,
+	SDL_HAPTIC_TRIANGLE,
+	SDL_HAPTIC_SAWTOOTHUP,
+	SDL_HAPTIC_SAWTOOTHDOWN,
+	SDL_HAPTIC_RAMP,
+};
+
+void usage(const char *prog){
+	fprintf(stderr, "usage: %s [-t ticks] [-n effects]...\n", prog);
+	fputs("  -t ticks    ticks to time per run (default 100000)\n", stderr);
+	fputs("  -n effects  number of logical effects, can be given several times\n", stderr);
+	fputs("              (default 1, 16, 64, 256, 1024)\n", stderr);
+}
+
+static void random_effect(SDL_HapticEffect *effect, int i){
+	init_effect(effect, types[i % (sizeof(types) / sizeof(types[0]))]);
+
+	// the leading members are the same for every effect we mix
+	SDL_HapticConstant *c = &effect->constant;
+	c->length = 500 + rand() % 5000;
+	c->delay = rand() % 100;
+	c->attack_length = rand() % 200;
+	c->fade_length = rand() % 200;
+
+	switch(effect->type){
+	case SDL_HAPTIC_CONSTANT:
+		effect->constant.level = rand() % 65535 - 32767;
+		break;
+
+	case SDL_HAPTIC_RAMP:
+		effect->ramp.start = rand() % 65535 - 32767;
+		effect->ramp.end = rand() % 65535 - 32767;
+		break;
+
+	default:
+		effect->periodic.period = 10 + rand() % 500;
+		effect->periodic.magnitude = rand() % 32767;
+		effect->periodic.phase = rand() % 36000;
+		break;
+	}
+}
+
+static int bench(size_t effects, size_t ticks){
+	mixer *m = create_mixer();
+	if(!m)
+		return -1;
+
+	uint64_t now = now_ns();
+	for(size_t i = 0; i < effects; ++i){
+		SDL_HapticEffect effect;
+		char name[EFFECT_NAME_LEN];
+
+		random_effect(&effect, i);
+		snprintf(name, sizeof(name), "e%zu", i);
+
+		int id = mixer_add(m, name, &effect);
+		if(id < 0 || mixer_play(m, id, SDL_HAPTIC_INFINITY, now)){
+			destroy_mixer(m);
+			return -1;
+		}
+	}
+
+	hist h;
+	hist_init(&h);
+
+	// a 1kHz tick, the clock is faked so the time spent ticking doesn't
+	// change which part of each effect gets evaluated
+	volatile float sink = 0;
+	for(size_t i = 0; i < ticks; ++i){
+		uint64_t start = now_ns();
+		sink += mixer_tick(m, now + i * 1000000);
+		hist_add(&h, now_ns() - start);
+	}
+
+	(void)sink;
+
+	char name[64];
+	snprintf(name, sizeof(name), "%zu effects", effects);
+	hist_print(stdout, name, &h);
+	printf("%zu effects: %.1fns per effect at p50\n", effects,
+			(double)hist_percentile(&h, 50) / (effects ? effects : 1));
+
+	destroy_mixer(m);
+	return 0;
+}
+
+int main(int argc, char **argv){
+	size_t ticks = 100000;
+	size_t sizes[32];
+	size_t num_sizes = 0;
+
+	for(int i = 1; i < argc; ++i){
+		if(!strcmp(argv[i], "-t") && i + 1 < argc)
+			ticks = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-n") && i + 1 < argc && num_sizes < 32)
+			sizes[num_sizes++] = strtoul(argv[++i], NULL, 0);
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(!num_sizes){
+		static const size_t defaults[] = {1, 16, 64, 256, 1024};
+		memcpy(sizes, defaults, sizeof(defaults));
+		num_sizes = sizeof(defaults) / sizeof(defaults[0]);
+	}
+
+	if(SDL_Init(0)){
+		fprintf(stderr, "%s\n", SDL_GetError());
+		return 1;
+	}
+
+	srand(1);
+
+	int ret = 0;
+	for(size_t i = 0; i < num_sizes && !ret; ++i){
+		if(bench(sizes[i], ticks)){
+			fprintf(stderr, "%s\n", SDL_GetError());
+			ret = 1;
+		}
+	}
+
+	SDL_Quit();
+	return ret;
+}
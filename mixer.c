@@ -0,0 +1,494 @@
+#include <float.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mixer.h"
+#include "hist.h"
+#include "render.h"
+#include "simd.h"
+#include "stream.h"
+#include "timing.h"
+#include "update.h"
+
+// starts are kept as float milliseconds from a base that's moved forward
+// every so often, so they never get large enough to lose precision
+#define MIXER_REBASE_MS 60000.0f
+
+typedef enum {
+	MIX_NONE,
+	MIX_CONSTANT,
+	MIX_SINE,
+	MIX_TRIANGLE,
+	MIX_SAWTOOTHUP,
+	MIX_SAWTOOTHDOWN,
+	MIX_RAMP,
+} mix_kind;
+
+// VLANES logical effects, one per lane, so a tick can work on all of them
+// with the same instructions regardless of their type
+typedef struct {
+	vfloat start;
+	vfloat delay;
+	vfloat cycle;
+	vfloat total;
+
+	// force is offset + gain * envelope * wave
+	vfloat offset;
+	vfloat gain;
+	vfloat period;
+	vfloat phase;
+	vfloat ramp_start;
+	vfloat ramp_slope;
+
+	vfloat magnitude;
+	vfloat attack_length;
+	vfloat attack_level;
+	vfloat fade_start;
+	vfloat fade_length;
+	vfloat fade_level;
+
+	vint kind;
+} mix_group;
+
+typedef struct {
+	char name[EFFECT_NAME_LEN];
+	SDL_HapticEffect effect;
+	Uint32 iterations;
+	bool used;
+	bool playing;
+} mix_effect;
+
+struct mixer {
+	SDL_mutex *lock;
+
+	mix_group *groups;
+	mix_effect *effects;
+	// lanes allocated and lanes up to the last one in use
+	size_t cap;
+	size_t used;
+	size_t count;
+
+	uint64_t base;
+};
+
+mixer *create_mixer(){
+	mixer *m = calloc(1, sizeof(*m));
+	if(!m){
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	m->lock = SDL_CreateMutex();
+	if(!m->lock){
+		free(m);
+		return NULL;
+	}
+
+	m->base = now_ns();
+	return m;
+}
+
+void destroy_mixer(mixer *m){
+	if(!m)
+		return;
+
+	SDL_DestroyMutex(m->lock);
+	free(m->groups);
+	free(m->effects);
+	free(m);
+}
+
+static float since_base(mixer *m, uint64_t now){
+	return (int64_t)(now - m->base) / 1e6;
+}
+
+static void set_lane(mixer *m, size_t id, float start){
+	mix_group *g = &m->groups[id / VLANES];
+	size_t l = id % VLANES;
+	mix_effect *e = &m->effects[id];
+
+	render_params p;
+	prepare_render(&p, &e->effect, e->iterations);
+
+	int kind = MIX_NONE;
+	float offset = 0, gain = 1, magnitude = 0;
+	float ramp_start = 0, ramp_slope = 0;
+
+	switch(p.type){
+	case SDL_HAPTIC_CONSTANT:
+		kind = MIX_CONSTANT;
+		gain = p.level < 0 ? -1 : 1;
+		magnitude = fabsf(p.level);
+		break;
+
+	case SDL_HAPTIC_SINE: kind = MIX_SINE; break;
+	case SDL_HAPTIC_TRIANGLE: kind = MIX_TRIANGLE; break;
+	case SDL_HAPTIC_SAWTOOTHUP: kind = MIX_SAWTOOTHUP; break;
+	case SDL_HAPTIC_SAWTOOTHDOWN: kind = MIX_SAWTOOTHDOWN; break;
+
+	case SDL_HAPTIC_RAMP:
+		magnitude = fmaxf(fabsf(p.start), fabsf(p.end));
+		if(!magnitude)
+			break;
+
+		// the envelope works on the magnitude, so the ramp itself is
+		// scaled to peak at 1
+		kind = MIX_RAMP;
+		ramp_start = p.start / magnitude;
+		ramp_slope = (p.end - p.start) / magnitude / p.cycle;
+		break;
+	}
+
+	if(kind >= MIX_SINE && kind <= MIX_SAWTOOTHDOWN){
+		if(p.period){
+			offset = p.offset;
+			gain = p.level < 0 ? -1 : 1;
+			magnitude = fabsf(p.level);
+		} else {
+			kind = MIX_NONE;
+		}
+	}
+
+	g->start[l] = e->playing ? start : INFINITY;
+	g->delay[l] = p.delay;
+	g->cycle[l] = p.cycle;
+	g->total[l] = p.total;
+
+	g->offset[l] = offset;
+	g->gain[l] = gain;
+	g->period[l] = p.period ? p.period : 1;
+	g->phase[l] = p.phase;
+	g->ramp_start[l] = ramp_start;
+	g->ramp_slope[l] = ramp_slope;
+
+	g->magnitude[l] = magnitude;
+	g->attack_length[l] = fmaxf(p.attack_length, FLT_MIN);
+	g->attack_level[l] = p.attack_level;
+	g->fade_start[l] = p.fade_start;
+	g->fade_length[l] = fmaxf(p.fade_length, FLT_MIN);
+	g->fade_level[l] = p.fade_level;
+
+	g->kind[l] = kind;
+}
+
+static int check_id(mixer *m, int id){
+	if(id < 0 || (size_t)id >= m->used || !m->effects[id].used)
+		return SDL_SetError("No logical effect %i.", id);
+
+	return 0;
+}
+
+static int check_effect(const SDL_HapticEffect *effect){
+	switch(effect->type){
+	case SDL_HAPTIC_CONSTANT:
+	case SDL_HAPTIC_SINE:
+	case SDL_HAPTIC_TRIANGLE:
+	case SDL_HAPTIC_SAWTOOTHUP:
+	case SDL_HAPTIC_SAWTOOTHDOWN:
+	case SDL_HAPTIC_RAMP:
+		return 0;
+	}
+
+	return SDL_SetError("%s can't be mixed in software.",
+			get_haptic_type_name(effect->type));
+}
+
+static int grow(mixer *m){
+	size_t cap = m->cap ? m->cap * 2 : 64;
+
+	mix_group *groups = realloc(m->groups, cap / VLANES * sizeof(*groups));
+	if(!groups)
+		return SDL_SetError("Out of memory.");
+
+	m->groups = groups;
+
+	mix_effect *effects = realloc(m->effects, cap * sizeof(*effects));
+	if(!effects)
+		return SDL_SetError("Out of memory.");
+
+	m->effects = effects;
+
+	memset(&m->groups[m->cap / VLANES], 0, (cap - m->cap) / VLANES * sizeof(*groups));
+	memset(&m->effects[m->cap], 0, (cap - m->cap) * sizeof(*effects));
+	m->cap = cap;
+	return 0;
+}
+
+int mixer_add(mixer *m, const char *name, const SDL_HapticEffect *effect){
+	if(check_effect(effect))
+		return -1;
+
+	if(strlen(name) >= EFFECT_NAME_LEN)
+		return SDL_SetError("Effect name '%s' is too long.", name);
+
+	SDL_LockMutex(m->lock);
+
+	// reuse the first hole so the lanes stay packed
+	size_t id = 0;
+	while(id < m->used && m->effects[id].used)
+		++id;
+
+	if(id == m->cap && grow(m)){
+		SDL_UnlockMutex(m->lock);
+		return -1;
+	}
+
+	mix_effect *e = &m->effects[id];
+	strcpy(e->name, name);
+	e->effect = *effect;
+	e->iterations = 1;
+	e->used = true;
+	e->playing = false;
+	set_lane(m, id, INFINITY);
+
+	if(id == m->used)
+		m->used++;
+
+	m->count++;
+	SDL_UnlockMutex(m->lock);
+	return id;
+}
+
+int mixer_find(mixer *m, const char *name){
+	int id = -1;
+
+	SDL_LockMutex(m->lock);
+	for(size_t i = 0; i < m->used; ++i){
+		if(m->effects[i].used && !strcmp(m->effects[i].name, name)){
+			id = i;
+			break;
+		}
+	}
+
+	SDL_UnlockMutex(m->lock);
+	return id;
+}
+
+int mixer_get(mixer *m, int id, SDL_HapticEffect *effect){
+	SDL_LockMutex(m->lock);
+	int ret = check_id(m, id);
+	if(!ret)
+		*effect = m->effects[id].effect;
+
+	SDL_UnlockMutex(m->lock);
+	return ret;
+}
+
+int mixer_update(mixer *m, int id, const SDL_HapticEffect *effect){
+	if(check_effect(effect))
+		return -1;
+
+	SDL_LockMutex(m->lock);
+	int ret = check_id(m, id);
+	if(!ret){
+		// like a device, changing an effect doesn't restart it
+		m->effects[id].effect = *effect;
+		set_lane(m, id, m->groups[id / VLANES].start[id % VLANES]);
+	}
+
+	SDL_UnlockMutex(m->lock);
+	return ret;
+}
+
+int mixer_play(mixer *m, int id, Uint32 iterations, uint64_t now){
+	SDL_LockMutex(m->lock);
+	int ret = check_id(m, id);
+	if(!ret){
+		m->effects[id].iterations = iterations;
+		m->effects[id].playing = true;
+		set_lane(m, id, since_base(m, now));
+	}
+
+	SDL_UnlockMutex(m->lock);
+	return ret;
+}
+
+int mixer_stop(mixer *m, int id){
+	SDL_LockMutex(m->lock);
+	int ret = check_id(m, id);
+	if(!ret){
+		m->effects[id].playing = false;
+		m->groups[id / VLANES].start[id % VLANES] = INFINITY;
+	}
+
+	SDL_UnlockMutex(m->lock);
+	return ret;
+}
+
+int mixer_remove(mixer *m, int id){
+	SDL_LockMutex(m->lock);
+	int ret = check_id(m, id);
+	if(!ret){
+		memset(&m->effects[id], 0, sizeof(m->effects[id]));
+		set_lane(m, id, INFINITY);
+		m->count--;
+
+		while(m->used && !m->effects[m->used - 1].used)
+			m->used--;
+	}
+
+	SDL_UnlockMutex(m->lock);
+	return ret;
+}
+
+size_t mixer_count(mixer *m){
+	SDL_LockMutex(m->lock);
+	size_t count = m->count;
+	SDL_UnlockMutex(m->lock);
+	return count;
+}
+
+static vfloat mix_group_at(const mix_group *g, float now){
+	vfloat local = now - g->start - g->delay;
+	vint active = (local >= 0) & (local < g->total);
+
+	// stopped lanes end up with NaNs here, active masks them out
+	vfloat t = local - g->cycle * vtrunc(local / g->cycle);
+
+	vfloat a = vmin(t / g->attack_length, vsplat(1));
+	vfloat env = g->attack_level + (g->magnitude - g->attack_level) * a;
+	vfloat f = vclamp((t - g->fade_start) / g->fade_length, 0, 1);
+	env += (g->fade_level - env) * f;
+
+	// working out every shape and picking per lane is cheaper than
+	// grouping lanes by type
+	vfloat x = vfrac(vmax(t + g->phase, vsplat(0)) / g->period);
+	vfloat saw = vsawtoothup(x);
+	vfloat w = vselect(g->kind == MIX_CONSTANT, vsplat(1), vsplat(0));
+	w = vselect(g->kind == MIX_SINE, vsine(x), w);
+	w = vselect(g->kind == MIX_TRIANGLE, vtriangle(x), w);
+	w = vselect(g->kind == MIX_SAWTOOTHUP, saw, w);
+	w = vselect(g->kind == MIX_SAWTOOTHDOWN, -saw, w);
+	w = vselect(g->kind == MIX_RAMP, g->ramp_start + g->ramp_slope * t, w);
+
+	vfloat v = vclamp(g->offset + g->gain * env * w, -1, 1);
+	return vselect(active & (g->kind != MIX_NONE), v, vsplat(0));
+}
+
+float mixer_tick(mixer *m, uint64_t now){
+	SDL_LockMutex(m->lock);
+
+	float t = since_base(m, now);
+	size_t groups = (m->used + VLANES - 1) / VLANES;
+
+	if(t > MIXER_REBASE_MS){
+		m->base += (uint64_t)(t * 1e6);
+		for(size_t i = 0; i < groups; ++i)
+			m->groups[i].start -= t;
+
+		t = since_base(m, now);
+	}
+
+	vfloat sum = {0};
+	for(size_t i = 0; i < groups; ++i)
+		sum += mix_group_at(&m->groups[i], t);
+
+	SDL_UnlockMutex(m->lock);
+
+	float total = 0;
+	for(int l = 0; l < VLANES; ++l)
+		total += sum[l];
+
+	return total > 1 ? 1 : total < -1 ? -1 : total;
+}
+
+struct mix_output {
+	effect_slots *slots;
+	haptic_device *haptic;
+	haptic_elem *elem;
+	mixer *m;
+	uint64_t period;
+
+	SDL_Thread *thread;
+	atomic_bool stop;
+
+	hist ticks;
+	uint64_t late;
+};
+
+static int mix_thread(void *data){
+	mix_output *o = data;
+	uint64_t deadline = now_ns();
+
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL);
+
+	while(!atomic_load(&o->stop)){
+		uint64_t start = now_ns();
+		float force = mixer_tick(o->m, start);
+		hist_add(&o->ticks, now_ns() - start);
+
+		// -O and the poller read the effect under slots->lock
+		SDL_LockMutex(o->slots->lock);
+		o->elem->effect.constant.level = lrintf(force * 32767);
+		queue_update(o->elem);
+		flush_updates(o->haptic, 1, o->elem);
+		SDL_UnlockMutex(o->slots->lock);
+
+		// don't try to catch up on missed ticks, the force is worked out
+		// from the time anyway
+		deadline += o->period;
+		uint64_t now = now_ns();
+		if(deadline < now){
+			o->late++;
+			deadline = now;
+		}
+
+		sleep_until_ns(deadline);
+	}
+
+	return 0;
+}
+
+mix_output *start_mix(effect_slots *slots, mixer *m, unsigned hz){
+	if(!hz){
+		SDL_SetError("Mixer tick rate must be positive.");
+		return NULL;
+	}
+
+	mix_output *o = calloc(1, sizeof(*o));
+	if(!o){
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	o->elem = create_stream_effect(slots, "mix");
+	if(!o->elem){
+		free(o);
+		return NULL;
+	}
+
+	o->slots = slots;
+	o->haptic = slots->haptic;
+	o->m = m;
+	o->period = 1000000000 / hz;
+	hist_init(&o->ticks);
+	atomic_init(&o->stop, false);
+
+	o->thread = SDL_CreateThread(mix_thread, "mix", o);
+	if(!o->thread){
+		free(o);
+		return NULL;
+	}
+
+	return o;
+}
+
+void stop_mix(mix_output *o){
+	if(!o)
+		return;
+
+	atomic_store(&o->stop, true);
+	SDL_WaitThread(o->thread, NULL);
+
+	SDL_LockMutex(o->slots->lock);
+	o->elem->effect.constant.level = 0;
+	upload_effect(o->haptic, o->elem);
+	SDL_UnlockMutex(o->slots->lock);
+
+	fprintf(stderr, "mix: %zu logical effects, %llu late ticks\n",
+			mixer_count(o->m), (unsigned long long)o->late);
+	hist_print(stderr, "mix tick", &o->ticks);
+	free(o);
+}
@@ -0,0 +1,40 @@
+#ifndef MIXER_H
+#define MIXER_H
+
+#include <stdint.h>
+#include "effect.h"
+#include "device.h"
+#include "slots.h"
+
+// Most wheels only hold a handful of effects, so the mixer plays any number
+// of logical constant, periodic and ramp effects in software and streams
+// their sum into a single constant effect on the device. Logical effects
+// are referred to by the index mixer_add() returns.
+
+typedef struct mixer mixer;
+
+mixer *create_mixer();
+void destroy_mixer(mixer *m);
+
+int mixer_add(mixer *m, const char *name, const SDL_HapticEffect *effect);
+int mixer_find(mixer *m, const char *name);
+int mixer_get(mixer *m, int id, SDL_HapticEffect *effect);
+int mixer_update(mixer *m, int id, const SDL_HapticEffect *effect);
+int mixer_play(mixer *m, int id, Uint32 iterations, uint64_t now);
+int mixer_stop(mixer *m, int id);
+int mixer_remove(mixer *m, int id);
+size_t mixer_count(mixer *m);
+
+// sum of all logical effects at now, clamped to [-1, 1]
+float mixer_tick(mixer *m, uint64_t now);
+
+typedef struct mix_output mix_output;
+
+// Starts a thread that ticks the mixer hz times a second and writes the
+// sum into a constant effect created in slots.
+mix_output *start_mix(effect_slots *slots, mixer *m, unsigned hz);
+
+// stops the thread and prints how long ticks took
+void stop_mix(mix_output *o);
+
+#endif /* MIXER_H */
@@ -0,0 +1,392 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "monitor.h"
+#include "hist.h"
+#include "timing.h"
+
+typedef struct {
+	char *data;
+	size_t len;
+	size_t cap;
+	bool overflow;
+} out_buf;
+
+struct monitor {
+	effect_slots *slots;
+	haptic_device *haptic;
+	status_poller *poller;
+	bool can_query;
+	const char *path;
+	uint64_t period;
+
+	// without a poller, effect status is asked for before taking
+	// slots->lock, so a slow device doesn't hold everyone else up
+	size_t *listed;
+	int *ids;
+	// by elem index, along with the id it was asked for
+	int *status;
+	int *status_id;
+
+	SDL_Thread *thread;
+	atomic_bool stop;
+
+	out_buf buf;
+
+	hist build;
+	uint64_t records;
+	uint64_t late;
+	uint64_t dropped;
+};
+
+static void put(out_buf *b, const char *s, size_t n){
+	if(b->len + n > b->cap){
+		b->overflow = true;
+		return;
+	}
+
+	memcpy(b->data + b->len, s, n);
+	b->len += n;
+}
+
+#define PUT(b, s) put(b, s, sizeof(s) - 1)
+
+static void put_char(out_buf *b, char c){
+	put(b, &c, 1);
+}
+
+static void put_int(out_buf *b, long long v){
+	char tmp[24];
+	size_t i = sizeof(tmp);
+	unsigned long long u = v < 0 ? -(unsigned long long)v : (unsigned long long)v;
+
+	do {
+		tmp[--i] = '0' + u % 10;
+		u /= 10;
+	} while(u);
+
+	if(v < 0)
+		tmp[--i] = '-';
+
+	put(b, tmp + i, sizeof(tmp) - i);
+}
+
+static void put_string(out_buf *b, const char *s){
+	static const char hex[] = "0123456789abcdef";
+
+	put_char(b, '"');
+	for(; *s; ++s){
+		unsigned char c = *s;
+		if(c == '"' || c == '\\'){
+			put_char(b, '\\');
+			put_char(b, c);
+		} else if(c < 0x20){
+			char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+			put(b, esc, sizeof(esc));
+		} else {
+			put_char(b, c);
+		}
+	}
+	put_char(b, '"');
+}
+
+// -1 is what the device layer uses for not set yet
+static void put_setting(out_buf *b, int v){
+	if(v < 0)
+		PUT(b, "null");
+	else
+		put_int(b, v);
+}
+
+static void put_params(out_buf *b, const SDL_HapticEffect *effect){
+	bool first = true;
+
+	PUT(b, "{");
+	for(size_t i = 0; i < num_effect_fields; ++i){
+		const effect_field *f = &effect_fields[i];
+		if(!(f->types & effect->type))
+			continue;
+
+		if(!first)
+			put_char(b, ',');
+
+		first = false;
+		put_string(b, f->name);
+		put_char(b, ':');
+
+		if(f->axes){
+			put_char(b, '[');
+			for(int axis = 0; axis < 3; ++axis){
+				if(axis)
+					put_char(b, ',');
+
+				put_int(b, get_effect_axis(effect, f, axis));
+			}
+			put_char(b, ']');
+		} else {
+			put_int(b, get_effect_field(effect, f));
+		}
+	}
+	PUT(b, "}");
+}
+
+static void sample_status(monitor *m){
+	effect_slots *s = m->slots;
+	for(size_t i = 0; i < s->num_elems; ++i)
+		m->status_id[i] = -1;
+
+	if(m->poller || !m->can_query)
+		return;
+
+	size_t n = list_slots(s, m->listed, m->ids);
+	for(size_t k = 0; k < n; ++k){
+		size_t i = m->listed[k];
+		m->status_id[i] = m->ids[k];
+		m->status[i] = haptic_effect_status(m->haptic, m->ids[k]);
+	}
+}
+
+// 1 if playing, 0 if not and -1 if it isn't known
+static int get_status(monitor *m, const haptic_elem *elem){
+	if(m->poller)
+		return poller_status(m->poller, elem);
+
+	size_t i = elem - m->slots->elems;
+	return m->status_id[i] == elem->id ? m->status[i] : -1;
+}
+
+static void build_record(monitor *m, uint64_t ms){
+	out_buf *b = &m->buf;
+	effect_slots *s = m->slots;
+
+	b->len = 0;
+	b->overflow = false;
+
+	PUT(b, "{\"ms\":");
+	put_int(b, ms);
+	PUT(b, ",\"seq\":");
+	put_int(b, m->records);
+	PUT(b, ",\"gain\":");
+	put_setting(b, haptic_get_gain(m->haptic));
+	PUT(b, ",\"autocenter\":");
+	put_setting(b, haptic_get_autocenter(m->haptic));
+	PUT(b, ",\"effects\":[");
+
+	sample_status(m);
+
+	// held so effects don't come and go halfway through
+	SDL_LockMutex(s->lock);
+
+	bool first = true;
+	for(size_t i = 0; i < s->num_elems; ++i){
+		const haptic_elem *elem = &s->elems[i];
+		if(!elem->active)
+			continue;
+
+		if(!first)
+			put_char(b, ',');
+
+		first = false;
+		PUT(b, "{\"slot\":");
+		put_int(b, i);
+		PUT(b, ",\"id\":");
+		put_int(b, elem->id);
+		PUT(b, ",\"name\":");
+		put_string(b, elem->name);
+		PUT(b, ",\"type\":");
+		put_string(b, get_haptic_type_name(elem->effect.type));
+		PUT(b, ",\"playing\":");
+		int status = get_status(m, elem);
+		if(status < 0)
+			PUT(b, "null");
+		else if(status)
+			PUT(b, "true");
+		else
+			PUT(b, "false");
+		PUT(b, ",\"params\":");
+		put_params(b, &elem->effect);
+		put_char(b, '}');
+	}
+
+	SDL_UnlockMutex(s->lock);
+
+	PUT(b, "]}\n");
+}
+
+// enough for every effect with the longest name and every field there is,
+// at the widest numbers there are
+static size_t record_size(size_t num_elems){
+	size_t params = 2;
+	for(size_t i = 0; i < num_effect_fields; ++i)
+		params += strlen(effect_fields[i].name) + 4 + 3 * 22;
+
+	size_t effect = 128 + 6 * EFFECT_NAME_LEN + params;
+	return 256 + num_elems * effect;
+}
+
+static int write_all(int fd, const char *data, size_t len){
+	while(len){
+		ssize_t n = write(fd, data, len);
+		if(n < 0 && errno == EINTR)
+			continue;
+
+		if(n <= 0)
+			return -1;
+
+		data += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int open_output(monitor *m){
+	if(!strcmp(m->path, "-"))
+		return 1;
+
+#ifdef _WIN32
+	return open(m->path, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+#else
+	// a FIFO can't be opened until someone reads it, keep trying instead
+	// of blocking so stopping never waits for a reader that doesn't come
+	for(;;){
+		int fd = open(m->path, O_WRONLY | O_CREAT | O_TRUNC | O_NONBLOCK, 0644);
+		if(fd >= 0){
+			fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+			return fd;
+		}
+
+		if(errno != ENXIO || atomic_load(&m->stop))
+			return -1;
+
+		SDL_Delay(100);
+	}
+#endif
+}
+
+static int monitor_thread(void *data){
+	monitor *m = data;
+
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_LOW);
+
+	int fd = open_output(m);
+	if(fd < 0 && atomic_load(&m->stop))
+		return 0;
+
+	if(fd < 0){
+		fprintf(stderr, "Couldn't open %s: %s\n", m->path, strerror(errno));
+		return -1;
+	}
+
+	uint64_t start = now_ns(), deadline = start;
+
+	while(!atomic_load(&m->stop)){
+		uint64_t now = now_ns();
+		build_record(m, (now - start) / 1000000);
+		hist_add(&m->build, now_ns() - now);
+
+		if(m->buf.overflow){
+			m->dropped++;
+		} else if(write_all(fd, m->buf.data, m->buf.len)){
+			fprintf(stderr, "Couldn't write status to %s: %s\n", m->path, strerror(errno));
+			break;
+		}
+
+		m->records++;
+
+		deadline += m->period;
+		now = now_ns();
+		if(deadline < now){
+			m->late++;
+			deadline = now;
+		}
+
+		sleep_until_ns(deadline);
+	}
+
+	if(fd != 1)
+		close(fd);
+
+	return 0;
+}
+
+static void free_monitor(monitor *m){
+	free(m->buf.data);
+	free(m->listed);
+	free(m->ids);
+	free(m->status);
+	free(m->status_id);
+	free(m);
+}
+
+monitor *start_monitor(effect_slots *slots, status_poller *poller, const char *path, unsigned hz){
+	if(!hz){
+		SDL_SetError("Status rate must be positive.");
+		return NULL;
+	}
+
+	monitor *m = calloc(1, sizeof(*m));
+	if(!m){
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	m->slots = slots;
+	m->haptic = slots->haptic;
+	m->poller = poller;
+	m->can_query = haptic_query(m->haptic) & SDL_HAPTIC_STATUS;
+	m->path = path;
+	m->period = 1000000000 / hz;
+	hist_init(&m->build);
+	atomic_init(&m->stop, false);
+
+	size_t num = slots->num_elems ? slots->num_elems : 1;
+	m->buf.cap = record_size(slots->num_elems);
+	m->buf.data = malloc(m->buf.cap);
+	m->listed = calloc(num, sizeof(*m->listed));
+	m->ids = calloc(num, sizeof(*m->ids));
+	m->status = calloc(num, sizeof(*m->status));
+	m->status_id = calloc(num, sizeof(*m->status_id));
+	if(!m->buf.data || !m->listed || !m->ids || !m->status || !m->status_id){
+		free_monitor(m);
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+#ifndef _WIN32
+	// a reader going away should end the monitor, not ffbsdl
+	signal(SIGPIPE, SIG_IGN);
+#endif
+
+	m->thread = SDL_CreateThread(monitor_thread, "monitor", m);
+	if(!m->thread){
+		free_monitor(m);
+		return NULL;
+	}
+
+	return m;
+}
+
+void stop_monitor(monitor *m){
+	if(!m)
+		return;
+
+	atomic_store(&m->stop, true);
+	SDL_WaitThread(m->thread, NULL);
+
+	fprintf(stderr, "status: %llu records, %llu late, %llu too big\n",
+			(unsigned long long)m->records, (unsigned long long)m->late,
+			(unsigned long long)m->dropped);
+	hist_print(stderr, "status record", &m->build);
+
+	free_monitor(m);
+}
@@ -0,0 +1,31 @@
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include "slots.h"
+#include "poller.h"
+
+// Writes the state of every effect as one line of JSON hz times a second,
+// for dashboards and the like:
+//
+//	{"ms":1500,"seq":15,"gain":80,"autocenter":null,"effects":[
+//		{"slot":0,"id":0,"name":"wheel","type":"CONSTANT","playing":true,
+//		 "params":{"direction":9000,"length":4294967295,"level":-8000,...}}]}
+//
+// all on one line, with condition parameters as arrays of three axes and
+// null for a gain or autocenter that hasn't been set, or whether an effect
+// is playing when the device can't tell. Records are built in
+// a buffer sized up front without any allocation or printf, and written
+// from a low priority thread, so a slow reader only holds up the monitor.
+
+typedef struct monitor monitor;
+
+// path is opened on the monitor's thread, so a FIFO can wait for its
+// reader without holding anything up, - is stdout. poller, if given,
+// saves asking the device whether effects are playing, otherwise it's asked
+// before taking slots->lock so a slow device only holds up the monitor.
+monitor *start_monitor(effect_slots *slots, status_poller *poller, const char *path, unsigned hz);
+
+// stops the thread and prints how long building records took
+void stop_monitor(monitor *m);
+
+#endif /* MONITOR_H */
@@ -0,0 +1,283 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "morph.h"
+#include "hist.h"
+#include "timing.h"
+#include "update.h"
+
+// more than any effect type has, counting each condition axis
+#define MORPH_MAX_FIELDS 32
+
+typedef struct {
+	bool active;
+	// where in morpher.active
+	size_t pos;
+	// to notice the elem was destroyed or evicted and reused
+	int id;
+
+	uint64_t start;
+	uint64_t duration;
+	SDL_HapticEffect from;
+	SDL_HapticEffect to;
+
+	// only the fields that differ, as index into effect_fields and axis
+	uint8_t fields[MORPH_MAX_FIELDS][2];
+	size_t num_fields;
+} morph;
+
+struct morpher {
+	effect_slots *slots;
+	haptic_device *haptic;
+	uint64_t period;
+
+	SDL_Thread *thread;
+	SDL_mutex *lock;
+	SDL_cond *wake;
+	bool stop;
+
+	// one per elem in slots
+	morph *morphs;
+	size_t *active;
+	size_t num_active;
+
+	hist ticks;
+	uint64_t late;
+	uint64_t started;
+	uint64_t finished;
+	uint64_t cancelled;
+	uint64_t lost;
+};
+
+static void remove_morph(morpher *m, size_t i){
+	morph *mo = &m->morphs[i];
+	size_t last = m->active[--m->num_active];
+
+	m->active[mo->pos] = last;
+	m->morphs[last].pos = mo->pos;
+	mo->active = false;
+}
+
+static long long step(const effect_field *f, long long from, long long to, double t){
+	// nothing sensible lies between infinity and a length
+	if(f->kind == FIELD_U32 && (from == SDL_HAPTIC_INFINITY || to == SDL_HAPTIC_INFINITY))
+		return t < 1 ? from : to;
+
+	return from + llround((to - from) * t);
+}
+
+// returns true once the morph is done
+static bool advance(morph *mo, haptic_elem *elem, uint64_t now){
+	double t = 1;
+	if(now < mo->start + mo->duration)
+		t = (double)(now - mo->start) / mo->duration;
+
+	for(size_t k = 0; k < mo->num_fields; ++k){
+		const effect_field *f = &effect_fields[mo->fields[k][0]];
+		int axis = mo->fields[k][1];
+
+		long long v = step(f, get_effect_axis(&mo->from, f, axis),
+				get_effect_axis(&mo->to, f, axis), t);
+		set_effect_axis(&elem->effect, f, axis, v);
+	}
+
+	queue_update(elem);
+	return t >= 1;
+}
+
+// Steps every morph and uploads the changes. Returns nanoseconds until
+// the update layer's rate limit lets the rest through, if anything is
+// still waiting for it.
+static uint64_t tick(morpher *m, uint64_t now){
+	effect_slots *s = m->slots;
+
+	// held so nothing is destroyed under us
+	SDL_LockMutex(s->lock);
+
+	for(size_t k = m->num_active; k-- > 0;){
+		size_t i = m->active[k];
+		morph *mo = &m->morphs[i];
+		haptic_elem *elem = &s->elems[i];
+
+		if(!elem->active || elem->id != mo->id || elem->effect.type != mo->to.type){
+			remove_morph(m, i);
+			m->lost++;
+			continue;
+		}
+
+		if(advance(mo, elem, now)){
+			remove_morph(m, i);
+			m->finished++;
+		}
+	}
+
+	uint64_t next = flush_updates(m->haptic, s->num_elems, s->elems);
+	SDL_UnlockMutex(s->lock);
+	return next;
+}
+
+static int morph_thread(void *data){
+	morpher *m = data;
+	uint64_t deadline = 0, pending = 0;
+
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+
+	SDL_LockMutex(m->lock);
+	while(!m->stop){
+		if(!m->num_active && !pending){
+			SDL_CondWait(m->wake, m->lock);
+			deadline = now_ns();
+			continue;
+		}
+
+		uint64_t start = now_ns();
+		pending = tick(m, start);
+		hist_add(&m->ticks, now_ns() - start);
+		SDL_UnlockMutex(m->lock);
+
+		// like the mixer, skip ticks we missed instead of catching up,
+		// where effects are is worked out from the time anyway
+		deadline += m->period;
+		uint64_t now = now_ns();
+		if(deadline < now){
+			m->late++;
+			deadline = now;
+		}
+
+		sleep_until_ns(deadline);
+		SDL_LockMutex(m->lock);
+	}
+	SDL_UnlockMutex(m->lock);
+
+	return 0;
+}
+
+morpher *start_morpher(effect_slots *slots, unsigned hz){
+	if(!hz){
+		SDL_SetError("Morph tick rate must be positive.");
+		return NULL;
+	}
+
+	morpher *m = calloc(1, sizeof(*m));
+	if(!m){
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	m->slots = slots;
+	m->haptic = slots->haptic;
+	m->period = 1000000000 / hz;
+	hist_init(&m->ticks);
+
+	m->morphs = calloc(slots->num_elems, sizeof(*m->morphs));
+	m->active = calloc(slots->num_elems, sizeof(*m->active));
+	m->lock = SDL_CreateMutex();
+	m->wake = SDL_CreateCond();
+	if(!m->morphs || !m->active || !m->lock || !m->wake){
+		SDL_SetError("Out of memory.");
+		goto err;
+	}
+
+	m->thread = SDL_CreateThread(morph_thread, "morph", m);
+	if(!m->thread)
+		goto err;
+
+	return m;
+
+err:
+	if(m->wake)
+		SDL_DestroyCond(m->wake);
+	if(m->lock)
+		SDL_DestroyMutex(m->lock);
+	free(m->active);
+	free(m->morphs);
+	free(m);
+	return NULL;
+}
+
+void stop_morpher(morpher *m){
+	if(!m)
+		return;
+
+	SDL_LockMutex(m->lock);
+	m->stop = true;
+	SDL_CondSignal(m->wake);
+	SDL_UnlockMutex(m->lock);
+	SDL_WaitThread(m->thread, NULL);
+
+	if(m->started){
+		fprintf(stderr, "morph: %llu started, %llu finished, %llu cancelled, %llu lost, %llu late ticks\n",
+				(unsigned long long)m->started, (unsigned long long)m->finished,
+				(unsigned long long)m->cancelled, (unsigned long long)m->lost,
+				(unsigned long long)m->late);
+		hist_print(stderr, "morph tick", &m->ticks);
+	}
+
+	SDL_DestroyCond(m->wake);
+	SDL_DestroyMutex(m->lock);
+	free(m->active);
+	free(m->morphs);
+	free(m);
+}
+
+int morph_effect(morpher *m, haptic_elem *elem, const SDL_HapticEffect *target, uint32_t ms){
+	if(target->type != elem->effect.type)
+		return SDL_SetError("Can't morph %s into %s.", get_haptic_type_name(elem->effect.type),
+				get_haptic_type_name(target->type));
+
+	size_t i = elem - m->slots->elems;
+
+	SDL_LockMutex(m->lock);
+
+	// starting from where the effect is now keeps a morph that replaces
+	// another one from jumping
+	morph next = {.from = elem->effect, .to = *target};
+
+	for(size_t f = 0; f < num_effect_fields; ++f){
+		if(!(effect_fields[f].types & target->type))
+			continue;
+
+		for(int axis = 0; axis < (effect_fields[f].axes ? 3 : 1); ++axis){
+			if(get_effect_axis(&next.from, &effect_fields[f], axis)
+					== get_effect_axis(&next.to, &effect_fields[f], axis))
+				continue;
+
+			if(next.num_fields == MORPH_MAX_FIELDS){
+				SDL_UnlockMutex(m->lock);
+				return SDL_SetError("Too many fields to morph.");
+			}
+
+			next.fields[next.num_fields][0] = f;
+			next.fields[next.num_fields][1] = axis;
+			next.num_fields++;
+		}
+	}
+
+	next.id = elem->id;
+	next.start = now_ns();
+	next.duration = (uint64_t)ms * 1000000;
+
+	morph *mo = &m->morphs[i];
+	next.active = true;
+	next.pos = mo->active ? mo->pos : m->num_active;
+	if(!mo->active)
+		m->active[m->num_active++] = i;
+
+	*mo = next;
+	m->started++;
+	SDL_CondSignal(m->wake);
+	SDL_UnlockMutex(m->lock);
+	return 0;
+}
+
+void cancel_morph(morpher *m, haptic_elem *elem){
+	size_t i = elem - m->slots->elems;
+
+	SDL_LockMutex(m->lock);
+	if(m->morphs[i].active){
+		remove_morph(m, i);
+		m->cancelled++;
+	}
+
+	SDL_UnlockMutex(m->lock);
+}
@@ -0,0 +1,30 @@
+#ifndef MORPH_H
+#define MORPH_H
+
+#include <stdint.h>
+#include "effect.h"
+#include "slots.h"
+
+// Moves effects smoothly to new parameters instead of jumping there. A
+// thread ticks hz times a second while anything is morphing, steps every
+// numeric field of every morphing effect linearly towards its target and
+// uploads all of them in one pass, so the cost per tick only grows with
+// the number of effects that actually changed.
+
+typedef struct morpher morpher;
+
+morpher *start_morpher(effect_slots *slots, unsigned hz);
+
+// stops the thread, leaving effects wherever they got to, and prints how
+// long ticks took if anything was morphed
+void stop_morpher(morpher *m);
+
+// Morphs elem from where it is now to target over ms milliseconds,
+// replacing any morph it was already in. target has to be of the same
+// type as elem.
+int morph_effect(morpher *m, haptic_elem *elem, const SDL_HapticEffect *target, uint32_t ms);
+
+// leaves elem where it is, e.g. before changing it by other means
+void cancel_morph(morpher *m, haptic_elem *elem);
+
+#endif /* MORPH_H */
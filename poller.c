@@ -0,0 +1,381 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "poller.h"
+#include "timing.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+typedef struct {
+	status_fn fn;
+	void *data;
+} subscriber;
+
+struct status_poller {
+	effect_slots *slots;
+	uint64_t period;
+
+	SDL_Thread *thread;
+	atomic_bool stop;
+
+	// what the thread samples into, only touched by it
+	size_t *list_elems;
+	int *list_ids;
+
+	// guards everything below
+	SDL_mutex *lock;
+
+	// per elem, the device id last sampled and its status, -1 if unknown
+	int *ids;
+	signed char *status;
+
+	status_event queue[POLLER_QUEUE_LEN];
+	size_t head;
+	size_t len;
+	uint64_t dropped;
+
+	subscriber subscribers[POLLER_MAX_SUBSCRIBERS];
+	size_t num_subscribers;
+
+	// called from the thread, see poller_subscribe_locked()
+	subscriber locked[POLLER_MAX_SUBSCRIBERS];
+	size_t num_locked;
+	int holds;
+	// per elem, the device id of a change not delivered to them yet or -1,
+	// and whether it started playing
+	int *locked_ids;
+	bool *locked_playing;
+
+	// written to when events are queued so an event loop can wake up
+	int pipe[2];
+};
+
+static void push_event(status_poller *p, size_t elem, int id, bool playing){
+	if(p->len == POLLER_QUEUE_LEN){
+		// nobody is dispatching, forget the oldest rather than the newest
+		p->head = (p->head + 1) % POLLER_QUEUE_LEN;
+		p->len--;
+		p->dropped++;
+	}
+
+	p->queue[(p->head + p->len) % POLLER_QUEUE_LEN] = (status_event){elem, id, playing};
+	p->len++;
+
+	p->locked_ids[elem] = id;
+	p->locked_playing[elem] = playing;
+}
+
+// taking slots->lock first also means poller_hold() waits for this to be
+// done, so nothing is destroyed under a holder that just got its hold
+static void deliver_locked(status_poller *p){
+	size_t n = p->slots->num_elems;
+	status_event events[n + 1];
+	subscriber locked[POLLER_MAX_SUBSCRIBERS];
+
+	SDL_LockMutex(p->lock);
+	bool any = p->num_locked;
+	SDL_UnlockMutex(p->lock);
+	if(!any)
+		return;
+
+	SDL_LockMutex(p->slots->lock);
+	SDL_LockMutex(p->lock);
+
+	size_t num_events = 0, num_locked = p->num_locked;
+	if(!p->holds && num_locked){
+		for(size_t e = 0; e < n; ++e){
+			if(p->locked_ids[e] < 0)
+				continue;
+
+			events[num_events++] = (status_event){e, p->locked_ids[e], p->locked_playing[e]};
+			p->locked_ids[e] = -1;
+		}
+
+		memcpy(locked, p->locked, sizeof(locked));
+	}
+
+	SDL_UnlockMutex(p->lock);
+
+	for(size_t i = 0; i < num_events; ++i){
+		for(size_t s = 0; s < num_locked; ++s)
+			locked[s].fn(&events[i], locked[s].data);
+	}
+
+	SDL_UnlockMutex(p->slots->lock);
+}
+
+static void sample(status_poller *p){
+	size_t n = list_slots(p->slots, p->list_elems, p->list_ids);
+
+	// ask the device first, the lock is only needed for the snapshot
+	signed char status[n + 1];
+	for(size_t i = 0; i < n; ++i){
+		int s = haptic_effect_status(p->slots->haptic, p->list_ids[i]);
+		status[i] = s < 0 ? -1 : s > 0;
+	}
+
+	bool queued = false;
+	SDL_LockMutex(p->lock);
+
+	size_t next = 0;
+	for(size_t e = 0; e < p->slots->num_elems; ++e){
+		if(next == n || p->list_elems[next] != e){
+			p->ids[e] = -1;
+			p->status[e] = -1;
+			continue;
+		}
+
+		int id = p->list_ids[next];
+		signed char s = status[next++];
+
+		// a new effect in the same elem isn't a transition
+		if(p->ids[e] == id && p->status[e] >= 0 && s >= 0 && s != p->status[e]){
+			push_event(p, e, id, s);
+			queued = true;
+		}
+
+		p->ids[e] = id;
+		p->status[e] = s;
+	}
+
+	SDL_UnlockMutex(p->lock);
+
+	deliver_locked(p);
+
+#ifndef _WIN32
+	if(queued){
+		char c = 0;
+		if(write(p->pipe[1], &c, 1) < 0){
+			// the pipe being full means a wake up is already pending
+		}
+	}
+#endif
+}
+
+static int poller_thread(void *data){
+	status_poller *p = data;
+	uint64_t deadline = now_ns();
+
+	while(!atomic_load(&p->stop)){
+		sample(p);
+
+		deadline += p->period;
+		uint64_t now = now_ns();
+		if(deadline < now)
+			deadline = now;
+
+		// sleep in short steps so stopping doesn't take a whole period
+		while(!atomic_load(&p->stop) && (now = now_ns()) < deadline){
+			uint64_t step = now + 50000000;
+			sleep_until_ns(deadline < step ? deadline : step);
+		}
+	}
+
+	return 0;
+}
+
+status_poller *start_status_poller(effect_slots *slots, unsigned hz){
+	if(!hz){
+		SDL_SetError("Status poll rate must be positive.");
+		return NULL;
+	}
+
+	if(!(haptic_query(slots->haptic) & SDL_HAPTIC_STATUS)){
+		SDL_SetError("Device can't report effect status.");
+		return NULL;
+	}
+
+	status_poller *p = calloc(1, sizeof(*p));
+	if(!p){
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	size_t n = slots->num_elems + 1;
+	p->slots = slots;
+	p->period = 1000000000 / hz;
+	p->list_elems = calloc(n, sizeof(*p->list_elems));
+	p->list_ids = calloc(n, sizeof(*p->list_ids));
+	p->ids = malloc(n * sizeof(*p->ids));
+	p->status = malloc(n * sizeof(*p->status));
+	p->locked_ids = malloc(n * sizeof(*p->locked_ids));
+	p->locked_playing = calloc(n, sizeof(*p->locked_playing));
+	p->lock = SDL_CreateMutex();
+	p->pipe[0] = p->pipe[1] = -1;
+	atomic_init(&p->stop, false);
+
+	if(!p->list_elems || !p->list_ids || !p->ids || !p->status
+			|| !p->locked_ids || !p->locked_playing || !p->lock){
+		SDL_SetError("Out of memory.");
+		goto err;
+	}
+
+	for(size_t i = 0; i < n; ++i){
+		p->ids[i] = -1;
+		p->status[i] = -1;
+		p->locked_ids[i] = -1;
+	}
+
+#ifndef _WIN32
+	if(pipe(p->pipe)){
+		SDL_SetError("pipe: %s", strerror(errno));
+		goto err;
+	}
+
+	fcntl(p->pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(p->pipe[1], F_SETFL, O_NONBLOCK);
+#endif
+
+	p->thread = SDL_CreateThread(poller_thread, "status", p);
+	if(!p->thread)
+		goto err;
+
+	return p;
+
+err:
+#ifndef _WIN32
+	if(p->pipe[0] >= 0){
+		close(p->pipe[0]);
+		close(p->pipe[1]);
+	}
+#endif
+
+	if(p->lock)
+		SDL_DestroyMutex(p->lock);
+
+	free(p->list_elems);
+	free(p->list_ids);
+	free(p->ids);
+	free(p->status);
+	free(p->locked_ids);
+	free(p->locked_playing);
+	free(p);
+	return NULL;
+}
+
+void stop_status_poller(status_poller *p){
+	if(!p)
+		return;
+
+	atomic_store(&p->stop, true);
+	SDL_WaitThread(p->thread, NULL);
+
+#ifndef _WIN32
+	close(p->pipe[0]);
+	close(p->pipe[1]);
+#endif
+
+	SDL_DestroyMutex(p->lock);
+	free(p->list_elems);
+	free(p->list_ids);
+	free(p->ids);
+	free(p->status);
+	free(p->locked_ids);
+	free(p->locked_playing);
+	free(p);
+}
+
+int poller_status(status_poller *p, const haptic_elem *elem){
+	size_t e = elem - p->slots->elems;
+
+	SDL_LockMutex(p->lock);
+	int status = p->ids[e] == elem->id ? p->status[e] : -1;
+	SDL_UnlockMutex(p->lock);
+	return status;
+}
+
+int poller_subscribe(status_poller *p, status_fn fn, void *data){
+	int ret = 0;
+
+	SDL_LockMutex(p->lock);
+	if(p->num_subscribers == POLLER_MAX_SUBSCRIBERS)
+		ret = SDL_SetError("Too many status subscribers.");
+	else
+		p->subscribers[p->num_subscribers++] = (subscriber){fn, data};
+
+	SDL_UnlockMutex(p->lock);
+	return ret;
+}
+
+void poller_unsubscribe(status_poller *p, status_fn fn, void *data){
+	SDL_LockMutex(p->lock);
+	for(size_t i = 0; i < p->num_subscribers; ++i){
+		if(p->subscribers[i].fn != fn || p->subscribers[i].data != data)
+			continue;
+
+		memmove(&p->subscribers[i], &p->subscribers[i + 1],
+				(--p->num_subscribers - i) * sizeof(p->subscribers[0]));
+		break;
+	}
+
+	SDL_UnlockMutex(p->lock);
+}
+
+int poller_subscribe_locked(status_poller *p, status_fn fn, void *data){
+	int ret = 0;
+
+	SDL_LockMutex(p->lock);
+	if(p->num_locked == POLLER_MAX_SUBSCRIBERS)
+		ret = SDL_SetError("Too many status subscribers.");
+	else
+		p->locked[p->num_locked++] = (subscriber){fn, data};
+
+	SDL_UnlockMutex(p->lock);
+	return ret;
+}
+
+void poller_hold(status_poller *p){
+	if(!p)
+		return;
+
+	SDL_LockMutex(p->slots->lock);
+	SDL_LockMutex(p->lock);
+	p->holds++;
+	SDL_UnlockMutex(p->lock);
+	SDL_UnlockMutex(p->slots->lock);
+}
+
+void poller_release(status_poller *p){
+	if(!p)
+		return;
+
+	SDL_LockMutex(p->lock);
+	p->holds--;
+	SDL_UnlockMutex(p->lock);
+}
+
+int poller_fd(status_poller *p){
+	return p->pipe[0];
+}
+
+void poller_dispatch(status_poller *p){
+#ifndef _WIN32
+	char buf[64];
+	while(read(p->pipe[0], buf, sizeof(buf)) > 0);
+#endif
+
+	status_event events[POLLER_QUEUE_LEN];
+	subscriber subscribers[POLLER_MAX_SUBSCRIBERS];
+
+	// copied out so subscribers can call back into the poller
+	SDL_LockMutex(p->lock);
+	size_t n = p->len;
+	for(size_t i = 0; i < n; ++i)
+		events[i] = p->queue[(p->head + i) % POLLER_QUEUE_LEN];
+
+	p->head = (p->head + n) % POLLER_QUEUE_LEN;
+	p->len = 0;
+
+	size_t num_subscribers = p->num_subscribers;
+	memcpy(subscribers, p->subscribers, sizeof(subscribers));
+	SDL_UnlockMutex(p->lock);
+
+	for(size_t i = 0; i < n; ++i){
+		for(size_t s = 0; s < num_subscribers; ++s)
+			subscribers[s].fn(&events[i], subscribers[s].data);
+	}
+}
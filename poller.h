@@ -0,0 +1,53 @@
+#ifndef POLLER_H
+#define POLLER_H
+
+#include <stdbool.h>
+#include "slots.h"
+
+// Asking the device whether an effect is playing is a driver round-trip,
+// so a thread asks about every effect a few times a second and everyone
+// else reads its snapshot. Changes are queued as events and handed to
+// subscribers by poller_dispatch() on whichever thread calls it, normally
+// the menu's event loop once poller_fd() becomes readable. Subscribers
+// that have to act whether or not anything dispatches, like destroying
+// finished effects, are called on the poller's own thread instead.
+
+#define POLLER_QUEUE_LEN 256
+#define POLLER_MAX_SUBSCRIBERS 8
+
+typedef struct {
+	// index into slots->elems and the device id it had when sampled
+	size_t elem;
+	int id;
+	bool playing;
+} status_event;
+
+typedef void (*status_fn)(const status_event *e, void *data);
+
+typedef struct status_poller status_poller;
+
+status_poller *start_status_poller(effect_slots *slots, unsigned hz);
+void stop_status_poller(status_poller *p);
+
+// 1 if playing, 0 if stopped and -1 if the poller hasn't seen elem yet
+int poller_status(status_poller *p, const haptic_elem *elem);
+
+int poller_subscribe(status_poller *p, status_fn fn, void *data);
+void poller_unsubscribe(status_poller *p, status_fn fn, void *data);
+
+// fn is called on the poller's thread with slots->lock held, so it may
+// destroy effects. Only the latest change of each elem is kept while held.
+int poller_subscribe_locked(status_poller *p, status_fn fn, void *data);
+
+// Holds back events for poller_subscribe_locked() while the caller holds
+// on to elems without slots->lock, like a prompt or a script command
+// does. Events seen meanwhile are delivered after the next sample once
+// nothing holds the poller any more. Holds nest, p can be NULL.
+void poller_hold(status_poller *p);
+void poller_release(status_poller *p);
+
+// readable when events are waiting, -1 where that's not supported
+int poller_fd(status_poller *p);
+void poller_dispatch(status_poller *p);
+
+#endif /* POLLER_H */
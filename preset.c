@@ -0,0 +1,299 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "preset.h"
+#include "batch.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct preset_library {
+	const uint8_t *data;
+	size_t size;
+
+	const preset_header *header;
+	const preset_record *records;
+	const uint32_t *table;
+};
+
+uint32_t preset_hash(const char *name){
+	uint32_t h = 2166136261u;
+	for(; *name; ++name)
+		h = (h ^ (uint8_t)*name) * 16777619u;
+
+	return h;
+}
+
+static uint64_t align_up(uint64_t v){
+	return (v + PRESET_ALIGN - 1) & ~(uint64_t)(PRESET_ALIGN - 1);
+}
+
+static int check_library(preset_library *lib, const char *path){
+	const preset_header *h = (const preset_header *)lib->data;
+	if(lib->size < sizeof(*h) || h->magic != PRESET_MAGIC)
+		return SDL_SetError("%s is not a preset library.", path);
+
+	if(h->version != PRESET_VERSION || h->record_size != sizeof(preset_record)
+			|| h->effect_size != sizeof(SDL_HapticEffect))
+		return SDL_SetError("%s was written by an incompatible build.", path);
+
+	if(!h->buckets || h->buckets & (h->buckets - 1) || h->buckets <= h->count
+			|| h->records_offset % PRESET_ALIGN || h->table_offset % PRESET_ALIGN
+			|| h->records_offset + (uint64_t)h->count * sizeof(preset_record) > lib->size
+			|| h->table_offset + (uint64_t)h->buckets * sizeof(uint32_t) > lib->size)
+		return SDL_SetError("%s is truncated or corrupt.", path);
+
+	lib->header = h;
+	lib->records = (const preset_record *)(lib->data + h->records_offset);
+	lib->table = (const uint32_t *)(lib->data + h->table_offset);
+	return 0;
+}
+
+#ifdef _WIN32
+// no mmap, reading the whole thing in at once is the next best thing
+static int map_file(preset_library *lib, const char *path){
+	FILE *f = fopen(path, "rb");
+	if(!f)
+		return SDL_SetError("Couldn't open %s: %s", path, strerror(errno));
+
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	rewind(f);
+
+	uint8_t *data = size > 0 ? malloc(size) : NULL;
+	if(!data || fread(data, size, 1, f) != 1){
+		free(data);
+		fclose(f);
+		return SDL_SetError("Couldn't read %s.", path);
+	}
+
+	fclose(f);
+	lib->data = data;
+	lib->size = size;
+	return 0;
+}
+
+static void unmap_file(preset_library *lib){
+	free((void *)lib->data);
+}
+#else
+static int map_file(preset_library *lib, const char *path){
+	int fd = open(path, O_RDONLY);
+	if(fd < 0)
+		return SDL_SetError("Couldn't open %s: %s", path, strerror(errno));
+
+	struct stat st;
+	if(fstat(fd, &st)){
+		close(fd);
+		return SDL_SetError("Couldn't stat %s: %s", path, strerror(errno));
+	}
+
+	if(!st.st_size){
+		close(fd);
+		return SDL_SetError("%s is empty.", path);
+	}
+
+	// records are read in place, nothing is copied until an effect is made
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED)
+		return SDL_SetError("Couldn't map %s: %s", path, strerror(errno));
+
+	lib->data = data;
+	lib->size = st.st_size;
+	return 0;
+}
+
+static void unmap_file(preset_library *lib){
+	munmap((void *)lib->data, lib->size);
+}
+#endif
+
+preset_library *open_presets(const char *path){
+	preset_library *lib = calloc(1, sizeof(*lib));
+	if(!lib){
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	if(map_file(lib, path)){
+		free(lib);
+		return NULL;
+	}
+
+	if(check_library(lib, path)){
+		unmap_file(lib);
+		free(lib);
+		return NULL;
+	}
+
+	return lib;
+}
+
+void close_presets(preset_library *lib){
+	if(!lib)
+		return;
+
+	unmap_file(lib);
+	free(lib);
+}
+
+const preset_record *find_preset(const preset_library *lib, const char *name){
+	uint32_t hash = preset_hash(name);
+	uint32_t mask = lib->header->buckets - 1;
+
+	for(uint32_t b = hash & mask;; b = (b + 1) & mask){
+		uint32_t i = lib->table[b];
+		if(i == PRESET_EMPTY || i >= lib->header->count)
+			return NULL;
+
+		const preset_record *r = &lib->records[i];
+		if(r->hash == hash && !strncmp(r->name, name, EFFECT_NAME_LEN))
+			return r;
+	}
+}
+
+size_t preset_count(const preset_library *lib){
+	return lib->header->count;
+}
+
+const preset_record *preset_at(const preset_library *lib, size_t i){
+	return i < lib->header->count ? &lib->records[i] : NULL;
+}
+
+static int parse_preset(int argc, char *argv[], preset_record *r){
+	memset(r, 0, sizeof(*r));
+	if(parse_create_args(argc, argv, &r->effect, &r->priority))
+		return -1;
+
+	strcpy(r->name, argv[1]);
+	r->hash = preset_hash(r->name);
+	return 0;
+}
+
+static int build_table(preset_record *records, uint32_t count, uint32_t *table,
+		uint32_t buckets){
+	for(uint32_t b = 0; b < buckets; ++b)
+		table[b] = PRESET_EMPTY;
+
+	uint32_t mask = buckets - 1;
+	for(uint32_t i = 0; i < count; ++i){
+		uint32_t b = records[i].hash & mask;
+		for(; table[b] != PRESET_EMPTY; b = (b + 1) & mask){
+			const preset_record *r = &records[table[b]];
+			if(r->hash == records[i].hash && !strcmp(r->name, records[i].name))
+				return SDL_SetError("Preset '%s' is defined twice.", r->name);
+		}
+
+		table[b] = i;
+	}
+
+	return 0;
+}
+
+static int write_library(const char *out, const preset_record *records,
+		uint32_t count, const uint32_t *table, uint32_t buckets){
+	preset_header h = {
+		.magic = PRESET_MAGIC,
+		.version = PRESET_VERSION,
+		.record_size = sizeof(preset_record),
+		.effect_size = sizeof(SDL_HapticEffect),
+		.count = count,
+		.buckets = buckets,
+	};
+	h.records_offset = align_up(sizeof(h));
+	h.table_offset = align_up(h.records_offset + (uint64_t)count * sizeof(preset_record));
+
+	FILE *f = fopen(out, "wb");
+	if(!f)
+		return SDL_SetError("Couldn't open %s: %s", out, strerror(errno));
+
+	static const uint8_t zero[PRESET_ALIGN];
+	uint64_t records_end = h.records_offset + (uint64_t)count * sizeof(preset_record);
+
+	bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+		&& fwrite(zero, h.records_offset - sizeof(h), 1, f) <= 1
+		&& fwrite(records, sizeof(*records), count, f) == count
+		&& fwrite(zero, h.table_offset - records_end, 1, f) <= 1
+		&& fwrite(table, sizeof(*table), buckets, f) == buckets;
+
+	if(fclose(f) || !ok)
+		return SDL_SetError("Couldn't write %s: %s", out, strerror(errno));
+
+	return 0;
+}
+
+int convert_presets(FILE *in, const char *file, const char *out){
+	preset_record *records = NULL;
+	uint32_t *table = NULL;
+	size_t count = 0, cap = 0, line_no = 0;
+	int ret = -1;
+
+	char line[1024];
+	while(fgets(line, sizeof(line), in)){
+		line_no++;
+
+		char *argv[BATCH_MAX_ARGS];
+		int argc = split_args(line, argv);
+		if(argc < 0)
+			goto err;
+
+		if(argc < 3 || strcmp(argv[0], "create"))
+			continue;
+
+		if(count == cap){
+			cap = cap ? cap * 2 : 256;
+			preset_record *r = realloc(records, cap * sizeof(*r));
+			if(!r){
+				SDL_SetError("Out of memory.");
+				goto err;
+			}
+
+			records = r;
+		}
+
+		if(parse_preset(argc, argv, &records[count]))
+			goto err;
+
+		count++;
+	}
+
+	if(count >= UINT32_MAX / 4){
+		SDL_SetError("Too many presets.");
+		goto err;
+	}
+
+	uint32_t buckets = 16;
+	while(buckets < count * 2)
+		buckets *= 2;
+
+	table = malloc(buckets * sizeof(*table));
+	if(!table){
+		SDL_SetError("Out of memory.");
+		goto err;
+	}
+
+	line_no = 0;
+	if(build_table(records, count, table, buckets))
+		goto err;
+
+	ret = write_library(out, records, count, table, buckets);
+	if(!ret)
+		ret = count;
+
+err:
+	if(ret < 0 && line_no){
+		char msg[256];
+		snprintf(msg, sizeof(msg), "%s", SDL_GetError());
+		SDL_SetError("%s:%zu: %s", file, line_no, msg);
+	}
+
+	free(table);
+	free(records);
+	return ret;
+}
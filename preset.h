@@ -0,0 +1,61 @@
+#ifndef PRESET_H
+#define PRESET_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "effect.h"
+
+// A preset library is a file of ready to upload effects that's mapped
+// straight into memory, so opening one costs the same with ten presets or
+// a hundred thousand. The layout is a preset_header, then the records, then
+// an open addressing hash table of record indices, with each part aligned
+// to PRESET_ALIGN. Like traces, libraries use the layout of the machine
+// that wrote them.
+
+#define PRESET_MAGIC 0x50424646 // "FFBP"
+#define PRESET_VERSION 1
+#define PRESET_ALIGN 64
+
+// marks an empty hash table slot
+#define PRESET_EMPTY UINT32_MAX
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t effect_size;
+
+	uint32_t count;
+	// hash table size, a power of two at least twice count
+	uint32_t buckets;
+	uint64_t records_offset;
+	uint64_t table_offset;
+} preset_header;
+
+typedef struct {
+	char name[EFFECT_NAME_LEN];
+	// FNV-1a of name, see preset_hash()
+	uint32_t hash;
+	int32_t priority;
+	SDL_HapticEffect effect;
+} preset_record;
+
+typedef struct preset_library preset_library;
+
+uint32_t preset_hash(const char *name);
+
+preset_library *open_presets(const char *path);
+void close_presets(preset_library *lib);
+
+// the record points into the mapping, so it's only valid until close
+const preset_record *find_preset(const preset_library *lib, const char *name);
+
+size_t preset_count(const preset_library *lib);
+const preset_record *preset_at(const preset_library *lib, size_t i);
+
+// Builds a library from the create commands in a script, other commands
+// are skipped. file is only used for error messages. Returns how many
+// presets were written.
+int convert_presets(FILE *in, const char *file, const char *out);
+
+#endif /* PRESET_H */
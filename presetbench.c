@@ -0,0 +1,218 @@
+// Benchmark for preset loading. Writes libraries of more and more presets
+// as a script and as a preset library, then times getting every effect out
+// of each: parsing the script the way -f would, against mapping the
+// library and looking every preset up by name.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "batch.h"
+#include "preset.h"
+#include "timing.h"
+
+#define SCRIPT_FILE "presetbench.ffb"
+#define LIBRARY_FILE "presetbench.ffp"
+
+static const char *types[] = {
+	"constant", "sine", "triangle", "sawtoothup", "sawtoothdown",
+	"ramp", "spring", "damper", "inertia", "friction",
+};
+
+void usage(const char *prog){
+	fprintf(stderr, "usage: %s [-r runs] [-n presets]...\n", prog);
+	fputs("  -r runs     times to load each library, the best is shown (default 5)\n", stderr);
+	fputs("  -n presets  number of presets, can be given several times\n", stderr);
+	fputs("              (default 100, 1000, 10000, 100000)\n", stderr);
+}
+
+static int write_script(size_t presets){
+	FILE *f = fopen(SCRIPT_FILE, "w");
+	if(!f)
+		return SDL_SetError("Couldn't open " SCRIPT_FILE ".");
+
+	for(size_t i = 0; i < presets; ++i){
+		size_t t = i % (sizeof(types) / sizeof(types[0]));
+		fprintf(f, "create car%zu_%s %s length=%d delay=%d", i, types[t], types[t],
+				500 + rand() % 5000, rand() % 100);
+
+		// constant, four periodics, ramp, then the conditions
+		if(t == 0)
+			fprintf(f, " level=%d", rand() % 65535 - 32767);
+		else if(t <= 4)
+			fprintf(f, " period=%d magnitude=%d phase=%d", 10 + rand() % 500,
+					rand() % 32767, rand() % 36000);
+		else if(t == 5)
+			fprintf(f, " start=%d end=%d", rand() % 65535 - 32767, rand() % 65535 - 32767);
+		else
+			fprintf(f, " right_coeff=%d left_coeff=%d deadband=%d", rand() % 32767,
+					rand() % 32767, rand() % 1000);
+
+		if(t <= 5 && i % 3 == 0)
+			fprintf(f, " attack_length=%d fade_length=%d", rand() % 200, rand() % 200);
+
+		fputc('\n', f);
+	}
+
+	return fclose(f) ? SDL_SetError("Couldn't write " SCRIPT_FILE ".") : 0;
+}
+
+// what starting up with a script of presets costs, every line parsed into
+// an effect
+static int load_script(size_t presets, SDL_HapticEffect *effects){
+	FILE *f = fopen(SCRIPT_FILE, "r");
+	if(!f)
+		return SDL_SetError("Couldn't open " SCRIPT_FILE ".");
+
+	char line[1024];
+	size_t n = 0;
+	while(n < presets && fgets(line, sizeof(line), f)){
+		char *argv[BATCH_MAX_ARGS];
+		int argc = split_args(line, argv);
+		if(argc < 3 || parse_effect_args(argc - 2, argv + 2, &effects[n++])){
+			fclose(f);
+			return -1;
+		}
+	}
+
+	fclose(f);
+	return n == presets ? 0 : SDL_SetError("Short read of " SCRIPT_FILE ".");
+}
+
+// the same with a library, every preset found by name and copied out
+static int load_library(size_t presets, char (*names)[EFFECT_NAME_LEN],
+		SDL_HapticEffect *effects, uint64_t *open_ns){
+	uint64_t start = now_ns();
+	preset_library *lib = open_presets(LIBRARY_FILE);
+	if(!lib)
+		return -1;
+
+	*open_ns = now_ns() - start;
+
+	for(size_t i = 0; i < presets; ++i){
+		const preset_record *r = find_preset(lib, names[i]);
+		if(!r){
+			close_presets(lib);
+			return SDL_SetError("Preset %s went missing.", names[i]);
+		}
+
+		effects[i] = r->effect;
+	}
+
+	close_presets(lib);
+	return 0;
+}
+
+static int bench(size_t presets, size_t runs){
+	if(write_script(presets))
+		return -1;
+
+	uint64_t start = now_ns();
+	FILE *f = fopen(SCRIPT_FILE, "r");
+	if(!f || convert_presets(f, SCRIPT_FILE, LIBRARY_FILE) < 0){
+		if(f)
+			fclose(f);
+
+		return -1;
+	}
+
+	fclose(f);
+	uint64_t convert = now_ns() - start;
+
+	SDL_HapticEffect *a = calloc(presets ? presets : 1, sizeof(*a));
+	SDL_HapticEffect *b = calloc(presets ? presets : 1, sizeof(*b));
+	char (*names)[EFFECT_NAME_LEN] = calloc(presets ? presets : 1, sizeof(*names));
+	if(!a || !b || !names){
+		free(a);
+		free(b);
+		free(names);
+		return SDL_SetError("Out of memory.");
+	}
+
+	for(size_t i = 0; i < presets; ++i){
+		snprintf(names[i], sizeof(names[i]), "car%zu_%s", i,
+				types[i % (sizeof(types) / sizeof(types[0]))]);
+	}
+
+	uint64_t script = UINT64_MAX, library = UINT64_MAX, open = UINT64_MAX;
+	int ret = 0;
+	for(size_t i = 0; i < runs && !ret; ++i){
+		start = now_ns();
+		ret = load_script(presets, a);
+		uint64_t t = now_ns() - start;
+		if(t < script)
+			script = t;
+
+		uint64_t o = UINT64_MAX;
+		start = now_ns();
+		ret = ret ? ret : load_library(presets, names, b, &o);
+		t = now_ns() - start;
+		if(t < library)
+			library = t;
+
+		if(o < open)
+			open = o;
+	}
+
+	if(!ret && memcmp(a, b, presets * sizeof(*a)))
+		ret = SDL_SetError("Library and script effects differ.");
+
+	if(!ret){
+		printf("%zu presets: script %.3fms, library %.3fms (open %.1fus, %.0fns per lookup), "
+				"%.1fx faster, converting took %.3fms\n",
+				presets, script / 1e6, library / 1e6, open / 1e3,
+				presets ? (double)(library - open) / presets : 0.0,
+				library ? (double)script / library : 0.0, convert / 1e6);
+	}
+
+	free(a);
+	free(b);
+	free(names);
+	return ret;
+}
+
+int main(int argc, char **argv){
+	size_t runs = 5;
+	size_t sizes[32];
+	size_t num_sizes = 0;
+
+	for(int i = 1; i < argc; ++i){
+		if(!strcmp(argv[i], "-r") && i + 1 < argc)
+			runs = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-n") && i + 1 < argc && num_sizes < 32)
+			sizes[num_sizes++] = strtoul(argv[++i], NULL, 0);
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(!num_sizes){
+		static const size_t defaults[] = {100, 1000, 10000, 100000};
+		memcpy(sizes, defaults, sizeof(defaults));
+		num_sizes = sizeof(defaults) / sizeof(defaults[0]);
+	}
+
+	if(!runs)
+		runs = 1;
+
+	if(SDL_Init(0)){
+		fprintf(stderr, "%s\n", SDL_GetError());
+		return 1;
+	}
+
+	srand(1);
+
+	int ret = 0;
+	for(size_t i = 0; i < num_sizes && !ret; ++i){
+		if(bench(sizes[i], runs)){
+			fprintf(stderr, "%s\n", SDL_GetError());
+			ret = 1;
+		}
+	}
+
+	remove(SCRIPT_FILE);
+	remove(LIBRARY_FILE);
+	SDL_Quit();
+	return ret;
+}
@@ -0,0 +1,305 @@
+#include <stdlib.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+#include "reactor.h"
+
+#define LINE_BUF_LEN 4096
+
+#ifdef _WIN32
+
+#include <stdio.h>
+
+// no poll() on console handles, so just block on input like before
+
+struct reactor {
+	bool stopped;
+};
+
+reactor *create_reactor(){
+	return calloc(1, sizeof(reactor));
+}
+
+void destroy_reactor(reactor *r){
+	free(r);
+}
+
+int reactor_add_fd(reactor *r, int fd, reactor_fn fn, void *data){
+	return SDL_SetError("Event loops are not supported on this platform.");
+}
+
+void reactor_remove_fd(reactor *r, int fd){}
+
+int reactor_add_timer(reactor *r, unsigned interval, reactor_fn fn, void *data){
+	return SDL_SetError("Event loops are not supported on this platform.");
+}
+
+void reactor_remove_timer(reactor *r, int timer){}
+
+int reactor_poll(reactor *r, int timeout){
+	return r->stopped ? -1 : 0;
+}
+
+void reactor_stop(reactor *r){
+	r->stopped = true;
+}
+
+bool reactor_stopped(reactor *r){
+	return r->stopped;
+}
+
+int reactor_read_line(reactor *r, int fd, char *line, size_t size){
+	if(r->stopped || !fgets(line, size, stdin))
+		return -1;
+
+	size_t len = strcspn(line, "\n");
+	if(line[len] != '\n' && !feof(stdin)){
+		int c;
+		while((c = getchar()) != '\n' && c != EOF);
+	}
+
+	line[len] = '\0';
+	return len;
+}
+
+#else
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+typedef struct {
+	reactor_fn fn;
+	void *data;
+	bool timer;
+	bool removed;
+} watch;
+
+struct reactor {
+	struct pollfd fds[REACTOR_MAX_FDS];
+	watch watches[REACTOR_MAX_FDS];
+	size_t num;
+	// set while callbacks run, so removals wait until they're done
+	bool dispatching;
+	bool stopped;
+
+	// what reactor_read_line() has read past the last line it returned
+	char line_buf[LINE_BUF_LEN];
+	size_t line_len;
+	bool line_ready;
+	bool line_eof;
+	int line_fd;
+};
+
+reactor *create_reactor(){
+	reactor *r = calloc(1, sizeof(*r));
+	if(!r)
+		SDL_SetError("Out of memory.");
+	else
+		r->line_fd = -1;
+
+	return r;
+}
+
+void destroy_reactor(reactor *r){
+	if(!r)
+		return;
+
+	for(size_t i = 0; i < r->num; ++i){
+		if(r->watches[i].timer)
+			close(r->fds[i].fd);
+	}
+
+	free(r);
+}
+
+static int add(reactor *r, int fd, reactor_fn fn, void *data, bool timer){
+	if(r->num == REACTOR_MAX_FDS)
+		return SDL_SetError("Too many file descriptors in event loop.");
+
+	r->fds[r->num] = (struct pollfd){.fd = fd, .events = POLLIN};
+	r->watches[r->num] = (watch){.fn = fn, .data = data, .timer = timer};
+	r->num++;
+	return 0;
+}
+
+static void compact(reactor *r){
+	size_t n = 0;
+	for(size_t i = 0; i < r->num; ++i){
+		if(r->watches[i].removed)
+			continue;
+
+		r->fds[n] = r->fds[i];
+		r->watches[n] = r->watches[i];
+		n++;
+	}
+
+	r->num = n;
+}
+
+static void remove_fd(reactor *r, int fd){
+	for(size_t i = 0; i < r->num; ++i){
+		if(r->fds[i].fd != fd || r->watches[i].removed)
+			continue;
+
+		if(r->watches[i].timer)
+			close(fd);
+
+		// a negative fd is skipped by poll() until we get to compact
+		r->watches[i].removed = true;
+		r->fds[i].fd = -1;
+	}
+
+	if(!r->dispatching)
+		compact(r);
+}
+
+int reactor_add_fd(reactor *r, int fd, reactor_fn fn, void *data){
+	return add(r, fd, fn, data, false);
+}
+
+void reactor_remove_fd(reactor *r, int fd){
+	remove_fd(r, fd);
+}
+
+int reactor_add_timer(reactor *r, unsigned interval, reactor_fn fn, void *data){
+	int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if(fd < 0)
+		return SDL_SetError("timerfd_create: %s", strerror(errno));
+
+	struct itimerspec spec = {
+		.it_interval = {interval / 1000, interval % 1000 * 1000000},
+		.it_value = {interval / 1000, interval % 1000 * 1000000},
+	};
+
+	if(timerfd_settime(fd, 0, &spec, NULL)){
+		SDL_SetError("timerfd_settime: %s", strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	if(add(r, fd, fn, data, true)){
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+void reactor_remove_timer(reactor *r, int timer){
+	remove_fd(r, timer);
+}
+
+int reactor_poll(reactor *r, int timeout){
+	if(r->stopped)
+		return -1;
+
+	int n = poll(r->fds, r->num, timeout);
+	if(n < 0)
+		return errno == EINTR ? 0 : SDL_SetError("poll: %s", strerror(errno));
+
+	r->dispatching = true;
+
+	// callbacks added meanwhile wait for the next poll
+	size_t num = r->num;
+	for(size_t i = 0; i < num && n > 0; ++i){
+		if(!r->fds[i].revents || r->watches[i].removed)
+			continue;
+
+		n--;
+
+		if(r->watches[i].timer){
+			// a missed tick is just that, don't call fn several times
+			uint64_t expirations;
+			if(read(r->fds[i].fd, &expirations, sizeof(expirations)) < 0)
+				continue;
+		}
+
+		r->watches[i].fn(r->watches[i].data);
+	}
+
+	r->dispatching = false;
+	compact(r);
+	return r->stopped ? -1 : 0;
+}
+
+void reactor_stop(reactor *r){
+	r->stopped = true;
+}
+
+bool reactor_stopped(reactor *r){
+	return r->stopped;
+}
+
+static void read_input(void *data){
+	reactor *r = data;
+
+	if(r->line_len == LINE_BUF_LEN){
+		// a single line filled the whole buffer, keep the start and drop
+		// the rest until the newline shows up
+		r->line_len = LINE_BUF_LEN / 2;
+	}
+
+	ssize_t n = read(r->line_fd, r->line_buf + r->line_len, LINE_BUF_LEN - r->line_len);
+	if(n < 0 && (errno == EINTR || errno == EAGAIN))
+		return;
+
+	if(n <= 0)
+		r->line_eof = true;
+	else
+		r->line_len += n;
+
+	r->line_ready = true;
+}
+
+int reactor_read_line(reactor *r, int fd, char *line, size_t size){
+	// prompts don't end in a newline, so stdout has to be flushed by hand
+	// now that stdin isn't read through stdio
+	fflush(stdout);
+
+	if(r->line_fd != fd){
+		r->line_fd = fd;
+		r->line_len = 0;
+		r->line_eof = false;
+	}
+
+	bool added = false;
+	char *nl;
+	while(!(nl = memchr(r->line_buf, '\n', r->line_len)) && !r->line_eof){
+		if(!added){
+			if(reactor_add_fd(r, fd, read_input, r))
+				return -1;
+
+			added = true;
+		}
+
+		r->line_ready = false;
+		while(!r->line_ready){
+			if(reactor_poll(r, -1) < 0){
+				reactor_remove_fd(r, fd);
+				return -1;
+			}
+		}
+	}
+
+	if(added)
+		reactor_remove_fd(r, fd);
+
+	// whatever is left at EOF counts as a last line
+	size_t len = nl ? (size_t)(nl - r->line_buf) : r->line_len;
+	if(!nl && !len)
+		return -1;
+
+	size_t copy = len < size - 1 ? len : size - 1;
+	memcpy(line, r->line_buf, copy);
+	line[copy] = '\0';
+
+	size_t used = nl ? len + 1 : len;
+	memmove(r->line_buf, r->line_buf + used, r->line_len - used);
+	r->line_len -= used;
+	return copy;
+}
+
+#endif
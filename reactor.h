@@ -0,0 +1,44 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A small poll() loop that the interactive menu runs while it waits for
+// input, so timers and other file descriptors get serviced in the meantime
+// instead of everything stopping in a blocking read. Callbacks run on the
+// thread calling reactor_poll() and must not wait for input themselves.
+
+#define REACTOR_MAX_FDS 32
+
+typedef void (*reactor_fn)(void *data);
+
+typedef struct reactor reactor;
+
+reactor *create_reactor();
+void destroy_reactor(reactor *r);
+
+// calls fn whenever fd becomes readable
+int reactor_add_fd(reactor *r, int fd, reactor_fn fn, void *data);
+void reactor_remove_fd(reactor *r, int fd);
+
+// Calls fn every interval milliseconds from a timerfd, returns the fd to
+// pass to reactor_remove_timer() or -1.
+int reactor_add_timer(reactor *r, unsigned interval, reactor_fn fn, void *data);
+void reactor_remove_timer(reactor *r, int timer);
+
+// Waits up to timeout milliseconds, -1 for no limit, and runs the
+// callbacks of whatever became ready. Returns -1 if reactor_stop() was
+// called.
+int reactor_poll(reactor *r, int timeout);
+
+// makes reactor_poll() and reactor_read_line() return, e.g. on SDL_QUIT
+void reactor_stop(reactor *r);
+bool reactor_stopped(reactor *r);
+
+// Keeps the reactor running until a whole line has been read from fd, which
+// is stored without the newline. Overlong lines are cut to size. Returns -1
+// on EOF or when the reactor was stopped.
+int reactor_read_line(reactor *r, int fd, char *line, size_t size);
+
+#endif /* REACTOR_H */
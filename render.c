@@ -0,0 +1,391 @@
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "render.h"
+#include "batch.h"
+#include "simd.h"
+#include "timing.h"
+
+// samples rendered per effect before they're written out, keeps memory
+// bounded no matter how long the render is
+#define RENDER_CHUNK 16384
+
+static float norm(long long v){
+	float f = v / 32767.0f;
+	return f > 1 ? 1 : f;
+}
+
+void prepare_render(render_params *p, const SDL_HapticEffect *effect, Uint32 iterations){
+	memset(p, 0, sizeof(*p));
+	p->type = effect->type;
+
+	// every effect we render shares the same leading members
+	const SDL_HapticConstant *c = &effect->constant;
+	bool forever = c->length == SDL_HAPTIC_INFINITY
+		|| iterations == SDL_HAPTIC_INFINITY;
+
+	p->delay = c->delay;
+	p->cycle = c->length == SDL_HAPTIC_INFINITY ? FLT_MAX : c->length;
+	p->total = forever ? INFINITY : (float)c->length * iterations;
+
+	Uint16 attack_length = 0, attack_level = 0;
+	Uint16 fade_length = 0, fade_level = 0;
+	float magnitude = 0;
+
+#define ENVELOPE(m) \
+	attack_length = effect->m.attack_length; \
+	attack_level = effect->m.attack_level; \
+	fade_length = effect->m.fade_length; \
+	fade_level = effect->m.fade_level
+
+	switch(effect->type){
+	case SDL_HAPTIC_CONSTANT:
+		p->level = norm(effect->constant.level);
+		magnitude = fabsf(p->level);
+		ENVELOPE(constant);
+		break;
+
+	case SDL_HAPTIC_SINE:
+	case SDL_HAPTIC_TRIANGLE:
+	case SDL_HAPTIC_SAWTOOTHUP:
+	case SDL_HAPTIC_SAWTOOTHDOWN:
+		p->level = norm(effect->periodic.magnitude);
+		p->offset = norm(effect->periodic.offset);
+		p->period = effect->periodic.period;
+		// phase is in hundredths of a degree
+		p->phase = effect->periodic.phase / 36000.0f * p->period;
+		magnitude = fabsf(p->level);
+		ENVELOPE(periodic);
+		break;
+
+	case SDL_HAPTIC_RAMP:
+		p->start = norm(effect->ramp.start);
+		p->end = norm(effect->ramp.end);
+		magnitude = fmaxf(fabsf(p->start), fabsf(p->end));
+		ENVELOPE(ramp);
+		break;
+	}
+
+#undef ENVELOPE
+
+	// the envelope is worked out on the magnitude and without one it just
+	// stays at the magnitude
+	p->attack_length = attack_length;
+	p->attack_level = attack_length ? norm(attack_level) : magnitude;
+
+	p->fade_length = fade_length;
+	p->fade_level = norm(fade_level);
+	p->fade_start = fade_length && p->cycle != FLT_MAX
+		? p->cycle - fade_length : FLT_MAX;
+}
+
+float render_duration(const render_params *p){
+	return p->delay + p->total;
+}
+
+static vfloat envelope(const render_params *p, vfloat t, float magnitude){
+	vfloat a = vmin(t / fmaxf(p->attack_length, FLT_MIN), vsplat(1));
+	vfloat level = p->attack_level + (magnitude - p->attack_level) * a;
+
+	vfloat f = vclamp((t - p->fade_start) / fmaxf(p->fade_length, FLT_MIN), 0, 1);
+	return level + (p->fade_level - level) * f;
+}
+
+// local is the time since the delay ran out in each lane
+static vfloat render_lanes(const render_params *p, vfloat local){
+	vint active = (local >= 0) & (local < p->total);
+
+	// time within the current iteration
+	vfloat t = local - p->cycle * vtrunc(local / p->cycle);
+	vfloat v = {0};
+
+	switch(p->type){
+	case SDL_HAPTIC_CONSTANT:
+		v = envelope(p, t, fabsf(p->level));
+		v = p->level < 0 ? -v : v;
+		break;
+
+	case SDL_HAPTIC_SINE:
+	case SDL_HAPTIC_TRIANGLE:
+	case SDL_HAPTIC_SAWTOOTHUP:
+	case SDL_HAPTIC_SAWTOOTHDOWN: {
+		if(!p->period)
+			break;
+
+		vfloat x = vfrac(vmax(t + p->phase, vsplat(0)) / p->period);
+		vfloat w;
+
+		if(p->type == SDL_HAPTIC_SINE)
+			w = vsine(x);
+		else if(p->type == SDL_HAPTIC_TRIANGLE)
+			w = vtriangle(x);
+		else if(p->type == SDL_HAPTIC_SAWTOOTHUP)
+			w = vsawtoothup(x);
+		else
+			w = -vsawtoothup(x);
+
+		vfloat env = envelope(p, t, fabsf(p->level));
+		v = p->offset + (p->level < 0 ? -env : env) * w;
+		break;
+	}
+
+	case SDL_HAPTIC_RAMP: {
+		float magnitude = fmaxf(fabsf(p->start), fabsf(p->end));
+		if(!magnitude)
+			break;
+
+		vfloat r = p->start + (p->end - p->start) * (t / p->cycle);
+		v = r * (envelope(p, t, magnitude) / magnitude);
+		break;
+	}
+	}
+
+	return vselect(active, vclamp(v, -1, 1), vsplat(0));
+}
+
+void render_samples(const render_params *p, double t0, double dt, size_t n, float *out){
+	vfloat lanes = vlanes() * (float)dt;
+	size_t i = 0;
+
+	// block start times are worked out in double so long renders don't
+	// drift, the lanes only add a small offset on top
+	for(; i + VLANES <= n; i += VLANES){
+		vfloat v = render_lanes(p, (float)(t0 + i * dt - p->delay) + lanes);
+		memcpy(&out[i], &v, sizeof(v));
+	}
+
+	if(i < n){
+		vfloat v = render_lanes(p, (float)(t0 + i * dt - p->delay) + lanes);
+		memcpy(&out[i], &v, (n - i) * sizeof(float));
+	}
+}
+
+typedef struct {
+	char name[EFFECT_NAME_LEN];
+	SDL_HapticEffect effect;
+	Uint32 iterations;
+	render_params params;
+} render_effect;
+
+typedef struct {
+	render_effect *effects;
+	size_t count;
+
+	double t0;
+	double dt;
+	size_t n;
+	float *buf;
+	atomic_size_t next;
+} render_job;
+
+static int read_effects(const char *script, render_effect **effects, size_t *count){
+	FILE *f = fopen(script, "r");
+	if(!f)
+		return SDL_SetError("%s: %s", script, strerror(errno));
+
+	size_t cap = 0;
+	char line[1024];
+	size_t lineno = 0;
+	int ret = 0;
+
+	*effects = NULL;
+	*count = 0;
+
+	while(!ret && fgets(line, sizeof(line), f)){
+		char *argv[BATCH_MAX_ARGS];
+		int argc = split_args(line, argv);
+		lineno++;
+
+		if(argc < 0){
+			ret = -1;
+		} else if(argc >= 3 && !strcmp(argv[0], "create")){
+			if(*count == cap){
+				cap = cap ? cap * 2 : 64;
+				render_effect *e = realloc(*effects, cap * sizeof(*e));
+				if(!e){
+					ret = SDL_SetError("Out of memory.");
+					break;
+				}
+
+				*effects = e;
+			}
+
+			render_effect *e = &(*effects)[*count];
+			memset(e, 0, sizeof(*e));
+			snprintf(e->name, sizeof(e->name), "%s", argv[1]);
+			e->iterations = 1;
+
+			if(!(ret = parse_effect_args(argc - 2, argv + 2, &e->effect)))
+				(*count)++;
+		} else if(argc >= 2 && !strcmp(argv[0], "play")){
+			// play lines tell how many iterations to render
+			for(size_t i = 0; i < *count; ++i){
+				if(strcmp((*effects)[i].name, argv[1]))
+					continue;
+
+				if(argc > 2)
+					(*effects)[i].iterations = strcmp(argv[2], "inf")
+						? strtoul(argv[2], NULL, 0)
+						: SDL_HAPTIC_INFINITY;
+			}
+		}
+	}
+
+	if(ret){
+		// SDL formats errors into the buffer SDL_GetError() points at
+		char msg[256];
+		snprintf(msg, sizeof(msg), "%s", SDL_GetError());
+		SDL_SetError("%s:%zu: %s", script, lineno, msg);
+		free(*effects);
+	}
+
+	fclose(f);
+	return ret;
+}
+
+static int render_thread(void *data){
+	render_job *job = data;
+
+	for(;;){
+		size_t i = atomic_fetch_add(&job->next, 1);
+		if(i >= job->count)
+			break;
+
+		render_samples(&job->effects[i].params, job->t0, job->dt, job->n,
+				job->buf + i * RENDER_CHUNK);
+	}
+
+	return 0;
+}
+
+static void render_chunk(render_job *job, int threads){
+	SDL_Thread *workers[64];
+	int started = 0;
+
+	atomic_store(&job->next, 0);
+
+	// the calling thread renders too, so one thread needs no extra workers
+	for(int i = 1; i < threads; ++i){
+		workers[started] = SDL_CreateThread(render_thread, "render", job);
+		if(workers[started])
+			started++;
+	}
+
+	render_thread(job);
+
+	for(int i = 0; i < started; ++i)
+		SDL_WaitThread(workers[i], NULL);
+}
+
+static void write_chunk(FILE *f, const render_job *job, size_t first, bool raw, float *frame){
+	for(size_t s = 0; s < job->n; ++s){
+		if(raw){
+			for(size_t i = 0; i < job->count; ++i)
+				frame[i] = job->buf[i * RENDER_CHUNK + s];
+
+			fwrite(frame, sizeof(float), job->count, f);
+			continue;
+		}
+
+		fprintf(f, "%.4f", (first + s) * job->dt);
+		for(size_t i = 0; i < job->count; ++i)
+			fprintf(f, ",%.5f", job->buf[i * RENDER_CHUNK + s]);
+
+		fputc('\n', f);
+	}
+}
+
+int run_render(const char *script, const char *out, double rate, double duration, bool raw){
+	if(rate <= 0)
+		return SDL_SetError("Sample rate must be positive.");
+
+	render_effect *effects;
+	size_t count;
+	if(read_effects(script, &effects, &count))
+		return -1;
+
+	if(!count){
+		free(effects);
+		return SDL_SetError("%s doesn't create any effects.", script);
+	}
+
+	bool until_done = duration <= 0;
+	for(size_t i = 0; i < count; ++i){
+		prepare_render(&effects[i].params, &effects[i].effect, effects[i].iterations);
+
+		float d = render_duration(&effects[i].params);
+		if(until_done && isinf(d)){
+			free(effects);
+			return SDL_SetError("'%s' never ends, give a duration to render.",
+					effects[i].name);
+		}
+
+		if(until_done && d > duration)
+			duration = d;
+	}
+
+	FILE *f = stdout;
+	if(strcmp(out, "-")){
+		f = fopen(out, raw ? "wb" : "w");
+		if(!f){
+			free(effects);
+			return SDL_SetError("%s: %s", out, strerror(errno));
+		}
+	}
+
+	render_job job = {0};
+	job.effects = effects;
+	job.count = count;
+	job.dt = 1000.0 / rate;
+	job.buf = malloc(count * RENDER_CHUNK * sizeof(float));
+	float *frame = malloc(count * sizeof(float));
+
+	int threads = SDL_GetCPUCount();
+	if(threads > 64)
+		threads = 64;
+
+	if((size_t)threads > count)
+		threads = count;
+
+	if(!raw){
+		fputs("time_ms", f);
+		for(size_t i = 0; i < count; ++i)
+			fprintf(f, ",%s", effects[i].name);
+
+		fputc('\n', f);
+	}
+
+	uint64_t start = now_ns();
+	uint64_t rendering = 0;
+	size_t samples = duration / job.dt + 1;
+
+	for(size_t s = 0; job.buf && frame && s < samples; s += RENDER_CHUNK){
+		job.t0 = s * job.dt;
+		job.n = samples - s < RENDER_CHUNK ? samples - s : RENDER_CHUNK;
+
+		uint64_t t = now_ns();
+		render_chunk(&job, threads);
+		rendering += now_ns() - t;
+
+		write_chunk(f, &job, s, raw, frame);
+	}
+
+	int ret = 0;
+	if(!job.buf || !frame)
+		ret = SDL_SetError("Out of memory.");
+	else
+		fprintf(stderr, "rendered %zu effects x %zu samples on %i threads in %.1fms (%.1fms total)\n",
+				count, samples, threads, rendering / 1e6,
+				(now_ns() - start) / 1e6);
+
+	if(f != stdout)
+		fclose(f);
+
+	free(frame);
+	free(job.buf);
+	free(effects);
+	return ret;
+}
@@ -0,0 +1,49 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "effect.h"
+
+// An effect boiled down to what's needed to compute its force over time,
+// levels are normalized to [-1, 1] and times are in milliseconds.
+typedef struct {
+	uint16_t type;
+
+	float delay;
+	// length of one iteration, FLT_MAX if it never ends
+	float cycle;
+	// length of all iterations, INFINITY if it never ends
+	float total;
+
+	float level;
+	float offset;
+	float start;
+	float end;
+
+	float period;
+	float phase;
+
+	float attack_length;
+	float attack_level;
+	float fade_start;
+	float fade_length;
+	float fade_level;
+} render_params;
+
+void prepare_render(render_params *p, const SDL_HapticEffect *effect, Uint32 iterations);
+
+// delay plus the length of all iterations, INFINITY if it never ends
+float render_duration(const render_params *p);
+
+// Renders n samples dt milliseconds apart, starting t0 milliseconds after the
+// effect was started. Condition effects depend on the position of the
+// device, so they render as no force.
+void render_samples(const render_params *p, double t0, double dt, size_t n, float *out);
+
+// Renders every effect defined in a script to a CSV file, or raw
+// interleaved float32 frames when raw is set. A duration of 0 renders until
+// the longest effect is done.
+int run_render(const char *script, const char *out, double rate, double duration, bool raw);
+
+#endif /* RENDER_H */
@@ -0,0 +1,648 @@
+#include <stdlib.h>
+#include <string.h>
+#include "rig.h"
+#include "effect.h"
+#include "timing.h"
+
+typedef enum {
+	RIG_NEW_EFFECT,
+	RIG_UPDATE_EFFECT,
+	RIG_RUN_EFFECT,
+	RIG_STOP_EFFECT,
+	RIG_DESTROY_EFFECT,
+	RIG_EFFECT_STATUS,
+	RIG_NUM_PLAYING,
+	RIG_SET_GAIN,
+	RIG_SET_AUTOCENTER,
+} rig_call;
+
+typedef struct {
+	rig_call call;
+	int id;
+	// iterations, gain or autocenter depending on the call
+	int arg;
+	// the caller waits for the result
+	bool reply;
+	SDL_HapticEffect effect;
+} rig_cmd;
+
+struct rig;
+
+typedef struct {
+	struct rig *rig;
+	size_t index;
+	haptic_device *haptic;
+
+	// asked once up front, so the rig doesn't have to queue for them
+	unsigned int supported;
+	int num_effects;
+	int num_axes;
+
+	SDL_Thread *thread;
+	SDL_mutex *lock;
+	SDL_cond *ready;
+	SDL_cond *space;
+
+	// commands the worker hasn't started on yet
+	rig_cmd queue[RIG_QUEUE_LEN];
+	size_t head;
+	size_t len;
+	bool stop;
+
+	uint64_t calls;
+	uint64_t errors;
+	uint64_t coalesced;
+	uint64_t full;
+	size_t max_len;
+	uint64_t busy_ns;
+} rig_worker;
+
+typedef struct {
+	bool used;
+	// the effect's id on each device, -1 where it isn't
+	int ids[RIG_MAX_DEVICES];
+} rig_effect;
+
+typedef struct rig {
+	rig_worker workers[RIG_MAX_DEVICES];
+	size_t num_workers;
+	uint32_t selected;
+
+	rig_effect *effects;
+	size_t num_effects;
+
+	// results of the call that's waiting, there's only ever one since the
+	// rig device's lock serializes callers
+	SDL_mutex *reply_lock;
+	SDL_cond *replied;
+	size_t outstanding;
+	int results[RIG_MAX_DEVICES];
+	char errors[RIG_MAX_DEVICES][128];
+
+	uint64_t started;
+} rig;
+
+static int run_cmd(rig_worker *w, rig_cmd *c){
+	haptic_device *haptic = w->haptic;
+
+	switch(c->call){
+	case RIG_NEW_EFFECT:
+		return haptic_new_effect(haptic, &c->effect);
+
+	case RIG_UPDATE_EFFECT:
+		return haptic_update_effect(haptic, c->id, &c->effect);
+
+	case RIG_RUN_EFFECT:
+		return haptic_run_effect(haptic, c->id, (Uint32)c->arg);
+
+	case RIG_STOP_EFFECT:
+		return haptic_stop_effect(haptic, c->id);
+
+	case RIG_DESTROY_EFFECT:
+		haptic_destroy_effect(haptic, c->id);
+		return 0;
+
+	case RIG_EFFECT_STATUS:
+		return haptic_effect_status(haptic, c->id);
+
+	case RIG_NUM_PLAYING:
+		return haptic_num_playing(haptic);
+
+	case RIG_SET_GAIN:
+		return haptic_set_gain(haptic, c->arg);
+
+	case RIG_SET_AUTOCENTER:
+		return haptic_set_autocenter(haptic, c->arg);
+	}
+
+	return SDL_SetError("Unknown rig call %i.", c->call);
+}
+
+static void reply(rig_worker *w, int ret){
+	rig *r = w->rig;
+
+	SDL_LockMutex(r->reply_lock);
+	r->results[w->index] = ret;
+	if(ret < 0)
+		snprintf(r->errors[w->index], sizeof(r->errors[w->index]), "%s", SDL_GetError());
+
+	if(!--r->outstanding)
+		SDL_CondSignal(r->replied);
+
+	SDL_UnlockMutex(r->reply_lock);
+}
+
+static int worker_thread(void *data){
+	rig_worker *w = data;
+
+	SDL_LockMutex(w->lock);
+	for(;;){
+		while(!w->len && !w->stop)
+			SDL_CondWait(w->ready, w->lock);
+
+		// whatever was queued still goes out before stopping
+		if(!w->len)
+			break;
+
+		rig_cmd c = w->queue[w->head];
+		w->head = (w->head + 1) % RIG_QUEUE_LEN;
+		w->len--;
+		SDL_CondSignal(w->space);
+		SDL_UnlockMutex(w->lock);
+
+		uint64_t start = now_ns();
+		int ret = run_cmd(w, &c);
+		uint64_t ns = now_ns() - start;
+
+		if(c.reply)
+			reply(w, ret);
+		else if(ret < 0)
+			fprintf(stderr, "%s: %s\n", w->haptic->name, SDL_GetError());
+
+		SDL_LockMutex(w->lock);
+		w->calls++;
+		w->errors += ret < 0;
+		w->busy_ns += ns;
+	}
+	SDL_UnlockMutex(w->lock);
+
+	return 0;
+}
+
+static void push_cmd(rig_worker *w, const rig_cmd *cmd){
+	SDL_LockMutex(w->lock);
+
+	// an update still waiting is pointless once a newer one comes in, as
+	// long as nothing else was done to the effect in between
+	if(cmd->call == RIG_UPDATE_EFFECT){
+		for(size_t i = w->len; i-- > 0;){
+			rig_cmd *c = &w->queue[(w->head + i) % RIG_QUEUE_LEN];
+			if(c->id != cmd->id)
+				continue;
+
+			if(c->call == RIG_UPDATE_EFFECT){
+				c->effect = cmd->effect;
+				c->reply |= cmd->reply;
+				w->coalesced++;
+				SDL_UnlockMutex(w->lock);
+				return;
+			}
+
+			break;
+		}
+	}
+
+	if(w->len == RIG_QUEUE_LEN){
+		w->full++;
+		while(w->len == RIG_QUEUE_LEN)
+			SDL_CondWait(w->space, w->lock);
+	}
+
+	w->queue[(w->head + w->len) % RIG_QUEUE_LEN] = *cmd;
+	if(++w->len > w->max_len)
+		w->max_len = w->len;
+
+	SDL_CondSignal(w->ready);
+	SDL_UnlockMutex(w->lock);
+}
+
+// Hands cmd to the workers in mask, using the effect's id on each device
+// if ids is given, and waits for all of them to get to it if wait is set.
+static void send_cmd(rig *r, uint32_t mask, rig_cmd cmd, const int *ids, bool wait){
+	cmd.reply = wait;
+
+	if(wait){
+		size_t n = 0;
+		for(size_t i = 0; i < r->num_workers; ++i)
+			n += !!(mask & 1u << i);
+
+		SDL_LockMutex(r->reply_lock);
+		r->outstanding = n;
+		SDL_UnlockMutex(r->reply_lock);
+	}
+
+	for(size_t i = 0; i < r->num_workers; ++i){
+		if(!(mask & 1u << i))
+			continue;
+
+		if(ids)
+			cmd.id = ids[i];
+
+		push_cmd(&r->workers[i], &cmd);
+	}
+
+	if(wait){
+		SDL_LockMutex(r->reply_lock);
+		while(r->outstanding)
+			SDL_CondWait(r->replied, r->reply_lock);
+		SDL_UnlockMutex(r->reply_lock);
+	}
+}
+
+static uint32_t effect_mask_of(rig *r, rig_effect *e){
+	uint32_t mask = 0;
+	for(size_t i = 0; i < r->num_workers; ++i){
+		if(e->ids[i] >= 0)
+			mask |= 1u << i;
+	}
+
+	return mask;
+}
+
+static rig_effect *get_effect(rig *r, int id){
+	if(id < 0 || (size_t)id >= r->num_effects || !r->effects[id].used){
+		SDL_SetError("No effect %i.", id);
+		return NULL;
+	}
+
+	return &r->effects[id];
+}
+
+static int alloc_effect(rig *r){
+	for(size_t i = 0; i < r->num_effects; ++i){
+		if(!r->effects[i].used)
+			return i;
+	}
+
+	size_t n = r->num_effects ? r->num_effects * 2 : 64;
+	rig_effect *effects = realloc(r->effects, n * sizeof(*effects));
+	if(!effects)
+		return SDL_SetError("Out of memory.");
+
+	memset(effects + r->num_effects, 0, (n - r->num_effects) * sizeof(*effects));
+
+	int id = r->num_effects;
+	r->effects = effects;
+	r->num_effects = n;
+	return id;
+}
+
+static int rig_new_effect(void *dev, SDL_HapticEffect *effect){
+	rig *r = dev;
+
+	for(size_t i = 0; i < r->num_workers; ++i){
+		if((r->selected & 1u << i) && !(effect->type & r->workers[i].supported))
+			return SDL_SetError("%s can't play %s effects.",
+					r->workers[i].haptic->name,
+					get_haptic_type_name(effect->type));
+	}
+
+	int id = alloc_effect(r);
+	if(id < 0)
+		return -1;
+
+	rig_cmd cmd = {.call = RIG_NEW_EFFECT, .id = -1, .effect = *effect};
+	send_cmd(r, r->selected, cmd, NULL, true);
+
+	rig_effect *e = &r->effects[id];
+	int failed = -1;
+	for(size_t i = 0; i < RIG_MAX_DEVICES; ++i){
+		e->ids[i] = -1;
+		if(i >= r->num_workers || !(r->selected & 1u << i))
+			continue;
+
+		if(r->results[i] < 0)
+			failed = i;
+		else
+			e->ids[i] = r->results[i];
+	}
+
+	// all or nothing, a rumble that only made it onto some devices would
+	// just be confusing
+	if(failed >= 0){
+		SDL_SetError("%s: %s", r->workers[failed].haptic->name, r->errors[failed]);
+		cmd.call = RIG_DESTROY_EFFECT;
+		send_cmd(r, effect_mask_of(r, e), cmd, e->ids, false);
+		return -1;
+	}
+
+	e->used = true;
+	return id;
+}
+
+static int rig_update_effect(void *dev, int id, SDL_HapticEffect *effect){
+	rig *r = dev;
+	rig_effect *e = get_effect(r, id);
+	if(!e)
+		return -1;
+
+	// custom samples are only borrowed, wait until every device has them
+	rig_cmd cmd = {.call = RIG_UPDATE_EFFECT, .effect = *effect};
+	send_cmd(r, effect_mask_of(r, e), cmd, e->ids, effect->type == SDL_HAPTIC_CUSTOM);
+	return 0;
+}
+
+static int rig_run_effect(void *dev, int id, Uint32 iterations){
+	rig *r = dev;
+	rig_effect *e = get_effect(r, id);
+	if(!e)
+		return -1;
+
+	rig_cmd cmd = {.call = RIG_RUN_EFFECT, .arg = (int)iterations};
+	send_cmd(r, effect_mask_of(r, e), cmd, e->ids, false);
+	return 0;
+}
+
+static int rig_stop_effect(void *dev, int id){
+	rig *r = dev;
+	rig_effect *e = get_effect(r, id);
+	if(!e)
+		return -1;
+
+	rig_cmd cmd = {.call = RIG_STOP_EFFECT};
+	send_cmd(r, effect_mask_of(r, e), cmd, e->ids, false);
+	return 0;
+}
+
+static void rig_destroy_effect(void *dev, int id){
+	rig *r = dev;
+	rig_effect *e = get_effect(r, id);
+	if(!e)
+		return;
+
+	rig_cmd cmd = {.call = RIG_DESTROY_EFFECT};
+	send_cmd(r, effect_mask_of(r, e), cmd, e->ids, false);
+	e->used = false;
+}
+
+// playing if it's playing anywhere
+static int rig_effect_status(void *dev, int id){
+	rig *r = dev;
+	rig_effect *e = get_effect(r, id);
+	if(!e)
+		return -1;
+
+	uint32_t mask = effect_mask_of(r, e);
+	rig_cmd cmd = {.call = RIG_EFFECT_STATUS};
+	send_cmd(r, mask, cmd, e->ids, true);
+
+	int status = -1, failed = -1;
+	for(size_t i = 0; i < r->num_workers; ++i){
+		if(!(mask & 1u << i))
+			continue;
+
+		if(r->results[i] < 0)
+			failed = i;
+		else if(r->results[i] > status)
+			status = r->results[i];
+	}
+
+	if(status < 0 && failed >= 0)
+		SDL_SetError("%s: %s", r->workers[failed].haptic->name, r->errors[failed]);
+
+	return status;
+}
+
+static int send_setting(rig *r, rig_call call, unsigned int feature, int arg){
+	uint32_t mask = 0;
+	for(size_t i = 0; i < r->num_workers; ++i){
+		if((r->selected & 1u << i) && (r->workers[i].supported & feature))
+			mask |= 1u << i;
+	}
+
+	if(!mask)
+		return SDL_SetError("None of the selected devices support that.");
+
+	rig_cmd cmd = {.call = call, .id = -1, .arg = arg};
+	send_cmd(r, mask, cmd, NULL, false);
+	return 0;
+}
+
+static int rig_set_gain(void *dev, int gain){
+	return send_setting(dev, RIG_SET_GAIN, SDL_HAPTIC_GAIN, gain);
+}
+
+static int rig_set_autocenter(void *dev, int autocenter){
+	return send_setting(dev, RIG_SET_AUTOCENTER, SDL_HAPTIC_AUTOCENTER, autocenter);
+}
+
+static unsigned int rig_query(void *dev){
+	rig *r = dev;
+
+	unsigned int supported = 0;
+	for(size_t i = 0; i < r->num_workers; ++i)
+		supported |= r->workers[i].supported;
+
+	return supported;
+}
+
+// a single device could end up with every effect
+static int rig_num_effects(void *dev){
+	rig *r = dev;
+
+	int n = 0;
+	for(size_t i = 0; i < r->num_workers; ++i){
+		if(r->workers[i].num_effects > n)
+			n = r->workers[i].num_effects;
+	}
+
+	return n;
+}
+
+static int rig_num_playing(void *dev){
+	rig *r = dev;
+
+	rig_cmd cmd = {.call = RIG_NUM_PLAYING, .id = -1};
+	send_cmd(r, (1u << r->num_workers) - 1, cmd, NULL, true);
+
+	int n = 0;
+	for(size_t i = 0; i < r->num_workers; ++i){
+		if(r->results[i] > 0)
+			n += r->results[i];
+	}
+
+	return n;
+}
+
+static int rig_num_axes(void *dev){
+	rig *r = dev;
+
+	int n = 0;
+	for(size_t i = 0; i < r->num_workers; ++i){
+		if(r->workers[i].num_axes > n)
+			n = r->workers[i].num_axes;
+	}
+
+	return n;
+}
+
+static void stop_workers(rig *r){
+	for(size_t i = 0; i < r->num_workers; ++i){
+		rig_worker *w = &r->workers[i];
+
+		SDL_LockMutex(w->lock);
+		w->stop = true;
+		SDL_CondSignal(w->ready);
+		SDL_UnlockMutex(w->lock);
+
+		SDL_WaitThread(w->thread, NULL);
+		SDL_DestroyCond(w->ready);
+		SDL_DestroyCond(w->space);
+		SDL_DestroyMutex(w->lock);
+	}
+
+	SDL_DestroyCond(r->replied);
+	SDL_DestroyMutex(r->reply_lock);
+}
+
+static void rig_close(void *dev){
+	rig *r = dev;
+
+	stop_workers(r);
+	for(size_t i = 0; i < r->num_workers; ++i)
+		close_device(r->workers[i].haptic);
+
+	free(r->effects);
+	free(r);
+}
+
+static const haptic_backend rig_backend = {
+	.name = "rig",
+	.new_effect = rig_new_effect,
+	.update_effect = rig_update_effect,
+	.run_effect = rig_run_effect,
+	.stop_effect = rig_stop_effect,
+	.destroy_effect = rig_destroy_effect,
+	.effect_status = rig_effect_status,
+	.set_gain = rig_set_gain,
+	.set_autocenter = rig_set_autocenter,
+	.query = rig_query,
+	.num_effects = rig_num_effects,
+	.num_playing = rig_num_playing,
+	.num_axes = rig_num_axes,
+	.close = rig_close,
+};
+
+static int start_worker(rig *r, haptic_device *haptic){
+	rig_worker *w = &r->workers[r->num_workers];
+	w->rig = r;
+	w->index = r->num_workers;
+	w->haptic = haptic;
+	w->supported = haptic_query(haptic);
+	w->num_effects = haptic_num_effects(haptic);
+	w->num_axes = haptic_num_axes(haptic);
+
+	w->lock = SDL_CreateMutex();
+	w->ready = SDL_CreateCond();
+	w->space = SDL_CreateCond();
+	if(w->lock && w->ready && w->space)
+		w->thread = SDL_CreateThread(worker_thread, "rig worker", w);
+
+	if(!w->thread){
+		SDL_DestroyCond(w->ready);
+		SDL_DestroyCond(w->space);
+		SDL_DestroyMutex(w->lock);
+		return -1;
+	}
+
+	r->num_workers++;
+	return 0;
+}
+
+haptic_device *open_rig(haptic_device **devices, size_t num_devices){
+	if(num_devices < 2 || num_devices > RIG_MAX_DEVICES){
+		SDL_SetError("A rig needs 2 to %i devices.", RIG_MAX_DEVICES);
+		return NULL;
+	}
+
+	rig *r = calloc(1, sizeof(*r));
+	if(!r){
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	r->reply_lock = SDL_CreateMutex();
+	r->replied = SDL_CreateCond();
+	if(!r->reply_lock || !r->replied)
+		goto err;
+
+	char name[128] = "";
+	for(size_t i = 0; i < num_devices; ++i){
+		if(start_worker(r, devices[i]))
+			goto err;
+
+		if(i)
+			strncat(name, " + ", sizeof(name) - strlen(name) - 1);
+
+		strncat(name, devices[i]->name, sizeof(name) - strlen(name) - 1);
+	}
+
+	r->selected = (1u << num_devices) - 1;
+	r->started = now_ns();
+
+	haptic_device *haptic = open_device(&rig_backend, r, name);
+	if(haptic)
+		return haptic;
+
+err:
+	// the devices are still the caller's
+	stop_workers(r);
+	free(r);
+	return NULL;
+}
+
+bool is_rig(haptic_device *haptic){
+	return haptic->backend == &rig_backend;
+}
+
+size_t rig_size(haptic_device *haptic){
+	return ((rig *)haptic->dev)->num_workers;
+}
+
+haptic_device *rig_device(haptic_device *haptic, size_t i){
+	return ((rig *)haptic->dev)->workers[i].haptic;
+}
+
+bool rig_selected(haptic_device *haptic, size_t i){
+	return ((rig *)haptic->dev)->selected & 1u << i;
+}
+
+int rig_select(haptic_device *haptic, const char *spec){
+	rig *r = haptic->dev;
+	uint32_t mask = 0;
+
+	if(!strcmp(spec, "all")){
+		mask = (1u << r->num_workers) - 1;
+	} else {
+		const char *p = spec;
+		for(;;){
+			char *end;
+			unsigned long i = strtoul(p, &end, 10);
+			if(end == p || (*end && *end != ','))
+				return SDL_SetError("Expected 'all' or device numbers, got '%s'.", spec);
+
+			if(i >= r->num_workers)
+				return SDL_SetError("No device %lu, the rig has %zu.", i, r->num_workers);
+
+			mask |= 1u << i;
+			if(!*end)
+				break;
+
+			p = end + 1;
+		}
+	}
+
+	SDL_LockMutex(haptic->lock);
+	r->selected = mask;
+	SDL_UnlockMutex(haptic->lock);
+	return 0;
+}
+
+void print_rig_stats(FILE *f, haptic_device *haptic){
+	rig *r = haptic->dev;
+	double elapsed = (now_ns() - r->started) / 1e9;
+
+	for(size_t i = 0; i < r->num_workers; ++i){
+		rig_worker *w = &r->workers[i];
+
+		SDL_LockMutex(w->lock);
+		fprintf(f, "%zu %s: %llu calls, %.1f/s, %.1f%% busy, %llu coalesced, "
+				"%llu errors, queue max %zu, full %llu times\n",
+				i, w->haptic->name, (unsigned long long)w->calls,
+				elapsed > 0 ? w->calls / elapsed : 0.0,
+				elapsed > 0 ? w->busy_ns / 1e7 / elapsed : 0.0,
+				(unsigned long long)w->coalesced, (unsigned long long)w->errors,
+				w->max_len, (unsigned long long)w->full);
+		SDL_UnlockMutex(w->lock);
+	}
+}
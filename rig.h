@@ -0,0 +1,44 @@
+#ifndef RIG_H
+#define RIG_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "device.h"
+
+// A rig is several haptic devices, say a wheel, pedals and a seat shaker,
+// driven as one. Every device gets a worker thread with its own command
+// queue, and the rig is itself a device that hands each call to the
+// workers of the devices it's meant for, so slots, scripts and the menu
+// work on a rig like on any other device.
+//
+// Calls that have to return something, creating effects and asking for
+// their status, are handed to every worker at once and wait for all of
+// them. Everything else only waits for room in the queues and returns 0,
+// errors are reported by the worker when the device gets to the call.
+// Updates to an effect that are still waiting in a queue are replaced by
+// newer ones, so a slow device falls behind on intermediate updates
+// rather than on everything.
+//
+// Each effect lives on the devices that were selected when it was
+// created, all of them by default. Gain and autocenter go to the
+// selected devices.
+
+#define RIG_MAX_DEVICES 16
+#define RIG_QUEUE_LEN 256
+
+// Takes over the devices, which are closed along with the rig. Can't be
+// used with fewer than two.
+haptic_device *open_rig(haptic_device **devices, size_t num_devices);
+
+bool is_rig(haptic_device *haptic);
+size_t rig_size(haptic_device *haptic);
+haptic_device *rig_device(haptic_device *haptic, size_t i);
+bool rig_selected(haptic_device *haptic, size_t i);
+
+// spec is "all" or a comma separated list of device indices
+int rig_select(haptic_device *haptic, const char *spec);
+
+// how much every worker has got through, and how far behind it fell
+void print_rig_stats(FILE *f, haptic_device *haptic);
+
+#endif /* RIG_H */
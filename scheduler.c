@@ -0,0 +1,381 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scheduler.h"
+#include "hist.h"
+#include "timing.h"
+
+#define NEVER UINT64_MAX
+
+typedef struct {
+	bool playing;
+	bool queued;
+	// preempted while playing forever, to be started again
+	bool resume;
+	uint32_t iterations;
+	// when it should be done, going by its delay and length
+	uint64_t end;
+	uint64_t queued_at;
+} sched_entry;
+
+struct play_scheduler {
+	effect_slots *slots;
+	int limit;
+
+	// everything up to the stats is guarded by slots->lock
+	sched_entry *entries;
+	size_t *playing;
+	int num_playing;
+	// elem indices, highest priority first and then oldest
+	size_t *queue;
+	size_t queue_len;
+
+	SDL_Thread *thread;
+	// guards waking the thread, always taken after slots->lock
+	SDL_mutex *lock;
+	SDL_cond *wake;
+	bool poked;
+	bool stop;
+
+	uint64_t started;
+	uint64_t preempted;
+	uint64_t deferred;
+	uint64_t resumed;
+	uint64_t failed;
+	hist wait;
+};
+
+// the same estimate the simulator plays by, a little late if anything as
+// the clock starts once the device has returned
+static uint64_t estimate_end(const SDL_HapticEffect *effect, uint32_t iterations, uint64_t now){
+	Uint32 length = effect->constant.length;
+	if(length == SDL_HAPTIC_INFINITY || iterations == SDL_HAPTIC_INFINITY)
+		return NEVER;
+
+	uint64_t ms = effect->constant.delay + (uint64_t)length * iterations;
+	return now + ms * 1000000;
+}
+
+static void poke(play_scheduler *p){
+	SDL_LockMutex(p->lock);
+	p->poked = true;
+	SDL_CondSignal(p->wake);
+	SDL_UnlockMutex(p->lock);
+}
+
+static void remove_playing(play_scheduler *p, size_t i){
+	for(int n = 0; n < p->num_playing; ++n){
+		if(p->playing[n] == i){
+			p->playing[n] = p->playing[--p->num_playing];
+			break;
+		}
+	}
+
+	p->entries[i].playing = false;
+}
+
+static void remove_queued(play_scheduler *p, size_t i){
+	for(size_t n = 0; n < p->queue_len; ++n){
+		if(p->queue[n] == i){
+			memmove(&p->queue[n], &p->queue[n + 1], (--p->queue_len - n) * sizeof(*p->queue));
+			break;
+		}
+	}
+
+	p->entries[i].queued = false;
+}
+
+static void enqueue(play_scheduler *p, size_t i, uint32_t iterations, bool resume, uint64_t now){
+	const int *priority = p->slots->priority;
+
+	size_t n = p->queue_len;
+	while(n && priority[p->queue[n - 1]] < priority[i])
+		n--;
+
+	memmove(&p->queue[n + 1], &p->queue[n], (p->queue_len - n) * sizeof(*p->queue));
+	p->queue[n] = i;
+	p->queue_len++;
+
+	sched_entry *e = &p->entries[i];
+	e->queued = true;
+	e->resume = resume;
+	e->iterations = iterations;
+	e->queued_at = now;
+	poke(p);
+}
+
+static int start(play_scheduler *p, size_t i, uint32_t iterations){
+	haptic_elem *elem = &p->slots->elems[i];
+	if(haptic_run_effect(p->slots->haptic, elem->id, iterations)){
+		p->failed++;
+		return -1;
+	}
+
+	sched_entry *e = &p->entries[i];
+	if(!e->playing)
+		p->playing[p->num_playing++] = i;
+
+	e->playing = true;
+	e->iterations = iterations;
+	e->end = estimate_end(&elem->effect, iterations, now_ns());
+	p->started++;
+	return 0;
+}
+
+static void retire(play_scheduler *p, uint64_t now){
+	for(int n = p->num_playing; n-- > 0;){
+		size_t i = p->playing[n];
+		if(p->entries[i].end <= now)
+			remove_playing(p, i);
+	}
+}
+
+// starts whatever has been waiting while there's room for it
+static void drain(play_scheduler *p){
+	while(p->queue_len && p->num_playing < p->limit){
+		size_t i = p->queue[0];
+		sched_entry *e = &p->entries[i];
+		bool resume = e->resume;
+		uint64_t queued_at = e->queued_at;
+
+		remove_queued(p, i);
+		if(start(p, i, e->iterations))
+			continue;
+
+		if(resume)
+			p->resumed++;
+		else
+			hist_add(&p->wait, now_ns() - queued_at);
+	}
+}
+
+// stops the lowest priority effect playing if it's outranked by priority,
+// of those the one that would finish first
+static bool preempt(play_scheduler *p, int priority, uint64_t now){
+	const int *prio = p->slots->priority;
+	int victim = -1;
+
+	for(int n = 0; n < p->num_playing; ++n){
+		size_t i = p->playing[n];
+		if(victim < 0 || prio[i] < prio[p->playing[victim]]
+				|| (prio[i] == prio[p->playing[victim]]
+					&& p->entries[i].end < p->entries[p->playing[victim]].end))
+			victim = n;
+	}
+
+	if(victim < 0 || prio[p->playing[victim]] >= priority)
+		return false;
+
+	size_t i = p->playing[victim];
+	sched_entry *e = &p->entries[i];
+	if(haptic_stop_effect(p->slots->haptic, p->slots->elems[i].id))
+		return false;
+
+	remove_playing(p, i);
+	p->preempted++;
+
+	// something finite would only start over from the beginning, too late
+	// to be any use
+	if(e->end == NEVER)
+		enqueue(p, i, e->iterations, true, now);
+
+	return true;
+}
+
+int scheduler_play(play_scheduler *p, haptic_elem *elem, uint32_t iterations){
+	size_t i = elem - p->slots->elems;
+	sched_entry *e = &p->entries[i];
+	uint64_t now = now_ns();
+
+	retire(p, now);
+	drain(p);
+
+	// already waiting, it'll play the way it was asked to last
+	if(e->queued){
+		e->iterations = iterations;
+		e->resume = false;
+		return 0;
+	}
+
+	// restarting doesn't need any more room
+	if(e->playing)
+		return start(p, i, iterations);
+
+	if(p->num_playing >= p->limit && !preempt(p, p->slots->priority[i], now)){
+		enqueue(p, i, iterations, false, now);
+		p->deferred++;
+		return 0;
+	}
+
+	return start(p, i, iterations);
+}
+
+int scheduler_stop(play_scheduler *p, haptic_elem *elem){
+	size_t i = elem - p->slots->elems;
+	sched_entry *e = &p->entries[i];
+
+	if(e->queued){
+		remove_queued(p, i);
+		return 0;
+	}
+
+	if(haptic_stop_effect(p->slots->haptic, elem->id))
+		return -1;
+
+	if(e->playing){
+		uint64_t now = now_ns();
+		remove_playing(p, i);
+		retire(p, now);
+		drain(p);
+	}
+
+	return 0;
+}
+
+void scheduler_forget(play_scheduler *p, haptic_elem *elem){
+	size_t i = elem - p->slots->elems;
+	sched_entry *e = &p->entries[i];
+
+	if(e->queued)
+		remove_queued(p, i);
+
+	if(e->playing){
+		uint64_t now = now_ns();
+		remove_playing(p, i);
+		retire(p, now);
+		drain(p);
+	}
+}
+
+bool scheduler_queued(play_scheduler *p, const haptic_elem *elem){
+	return p->entries[elem - p->slots->elems].queued;
+}
+
+static int scheduler_thread(void *data){
+	play_scheduler *p = data;
+	effect_slots *s = p->slots;
+
+	for(;;){
+		SDL_LockMutex(s->lock);
+		uint64_t now = now_ns();
+		retire(p, now);
+		drain(p);
+
+		// only waiting effects need anything to finish on time, the rest
+		// is retired whenever the next one is played
+		uint64_t next = NEVER;
+		for(int n = 0; p->queue_len && n < p->num_playing; ++n){
+			uint64_t end = p->entries[p->playing[n]].end;
+			if(end < next)
+				next = end;
+		}
+
+		SDL_UnlockMutex(s->lock);
+
+		SDL_LockMutex(p->lock);
+		if(!p->poked && !p->stop){
+			if(next == NEVER){
+				SDL_CondWait(p->wake, p->lock);
+			} else {
+				// rounded up, waking early would only mean waiting again
+				now = now_ns();
+				uint64_t ms = next > now ? (next - now + 999999) / 1000000 : 0;
+				SDL_CondWaitTimeout(p->wake, p->lock, ms);
+			}
+		}
+
+		p->poked = false;
+		bool stop = p->stop;
+		SDL_UnlockMutex(p->lock);
+
+		if(stop)
+			break;
+	}
+
+	return 0;
+}
+
+static void free_scheduler(play_scheduler *p){
+	if(p->wake)
+		SDL_DestroyCond(p->wake);
+	if(p->lock)
+		SDL_DestroyMutex(p->lock);
+
+	free(p->entries);
+	free(p->playing);
+	free(p->queue);
+	free(p);
+}
+
+play_scheduler *start_scheduler(effect_slots *slots, int limit){
+	if(limit < 1){
+		SDL_SetError("Devices have to play at least one effect at a time.");
+		return NULL;
+	}
+
+	play_scheduler *p = calloc(1, sizeof(*p));
+	if(!p){
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	p->slots = slots;
+	p->limit = limit;
+	hist_init(&p->wait);
+
+	// more can't play than there are effects, however many the device
+	// says it could
+	size_t num = slots->num_elems ? slots->num_elems : 1;
+	p->entries = calloc(num, sizeof(*p->entries));
+	p->playing = calloc(num, sizeof(*p->playing));
+	p->queue = calloc(num, sizeof(*p->queue));
+	p->lock = SDL_CreateMutex();
+	p->wake = SDL_CreateCond();
+	if(!p->entries || !p->playing || !p->queue || !p->lock || !p->wake){
+		free_scheduler(p);
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	if((size_t)p->limit > num)
+		p->limit = num;
+
+	p->thread = SDL_CreateThread(scheduler_thread, "scheduler", p);
+	if(!p->thread){
+		free_scheduler(p);
+		return NULL;
+	}
+
+	SDL_LockMutex(slots->lock);
+	slots->sched = p;
+	SDL_UnlockMutex(slots->lock);
+
+	return p;
+}
+
+void stop_scheduler(play_scheduler *p){
+	if(!p)
+		return;
+
+	SDL_LockMutex(p->lock);
+	p->stop = true;
+	SDL_CondSignal(p->wake);
+	SDL_UnlockMutex(p->lock);
+
+	SDL_WaitThread(p->thread, NULL);
+
+	SDL_LockMutex(p->slots->lock);
+	p->slots->sched = NULL;
+	size_t waiting = p->queue_len;
+	SDL_UnlockMutex(p->slots->lock);
+
+	if(p->started || p->deferred || p->failed){
+		fprintf(stderr, "playback: %llu started, %llu preempted, %llu deferred, %llu resumed, %llu failed, %zu still waiting\n",
+				(unsigned long long)p->started, (unsigned long long)p->preempted,
+				(unsigned long long)p->deferred, (unsigned long long)p->resumed,
+				(unsigned long long)p->failed, waiting);
+		hist_print(stderr, "deferred start", &p->wait);
+	}
+
+	free_scheduler(p);
+}
@@ -0,0 +1,44 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include "slots.h"
+
+// Devices only play so many effects at once, haptic_num_playing(), and
+// what happens past that is up to the driver: the new effect may fail to
+// start or knock out any other. The scheduler keeps track of what it
+// started and when that should finish, and when the device is full stops
+// the lowest priority effect playing, of those the one nearest to
+// finishing, to make room for one of higher priority. Anything that
+// doesn't outrank what's playing waits its turn in a queue, highest
+// priority first, and a thread starts it as soon as something finishes.
+// Preempted effects that would have played forever go back in the queue
+// to resume once there's room again.
+//
+// All of these are called with slots->lock held, through play_slot_effect()
+// and friends.
+
+typedef struct play_scheduler play_scheduler;
+
+// limit is how many effects may play at once
+play_scheduler *start_scheduler(effect_slots *slots, int limit);
+
+// stops the thread, dropping anything still waiting, and prints how often
+// effects were preempted and how long deferred ones waited
+void stop_scheduler(play_scheduler *p);
+
+// starts elem, or queues it if the device is full of effects it doesn't
+// outrank, which isn't an error
+int scheduler_play(play_scheduler *p, haptic_elem *elem, uint32_t iterations);
+
+// stops elem, or takes it out of the queue
+int scheduler_stop(play_scheduler *p, haptic_elem *elem);
+
+// elem is being destroyed, whatever is waiting for its place can start
+void scheduler_forget(play_scheduler *p, haptic_elem *elem);
+
+// whether elem is waiting to start, e.g. after being preempted, so it
+// isn't finished even though it's stopped
+bool scheduler_queued(play_scheduler *p, const haptic_elem *elem);
+
+#endif /* SCHEDULER_H */
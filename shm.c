@@ -0,0 +1,388 @@
+#include "shm.h"
+
+#ifdef _WIN32
+
+shm_server *start_shm(effect_slots *slots, const char *name){
+	SDL_SetError("Shared memory rings are not supported on this platform.");
+	return NULL;
+}
+
+void wait_shm(shm_server *s){}
+void request_stop_shm(shm_server *s){}
+void stop_shm(shm_server *s){}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "shmring.h"
+#include "hist.h"
+#include "timing.h"
+#include "update.h"
+
+#define NUM_TYPES 16
+
+struct shm_server {
+	effect_slots *slots;
+	haptic_device *haptic;
+	size_t num_elems;
+	haptic_elem *elems;
+
+	char name[64];
+	shm_ring *ring;
+	// kept open and locked for as long as we serve the ring, so another
+	// ffbsdl can tell it isn't stale
+	int fd;
+
+	SDL_Thread *thread;
+	atomic_bool stop;
+
+	// resolved once up front so the drain loop doesn't do string lookups,
+	// indexed by field and the bit number of the effect type
+	const effect_field *fields[SHM_NUM_FIELDS][NUM_TYPES];
+
+	// timestamp of the newest record queued for each slot, the latency
+	// is only known once the update layer actually gets to it
+	uint64_t *queued_at;
+
+	uint64_t records;
+	uint64_t invalid;
+	uint64_t failed;
+	hist latency;
+};
+
+static int type_index(uint16_t type){
+	for(int i = 0; i < NUM_TYPES; ++i){
+		if(type & (1 << i))
+			return i;
+	}
+
+	return 0;
+}
+
+static void resolve_fields(shm_server *s){
+	static const char *names[] = SHM_FIELD_NAMES;
+
+	for(int f = 0; f < SHM_NUM_FIELDS; ++f){
+		for(int t = 0; t < NUM_TYPES; ++t)
+			s->fields[f][t] = find_effect_field(1 << t, names[f]);
+	}
+}
+
+static int set_field(shm_server *s, haptic_elem *elem, const shm_record *r){
+	if(r->field >= SHM_NUM_FIELDS)
+		return -1;
+
+	const effect_field *f = s->fields[r->field][type_index(elem->effect.type)];
+	if(!f)
+		return -1;
+
+	// there is nobody to report errors to, so clamp like the prompts do
+	long long v = r->value;
+	if(v < f->min)
+		v = f->min;
+
+	if(v > f->max)
+		v = f->max;
+
+	set_effect_field(&elem->effect, f, v);
+	return 0;
+}
+
+// returns true when the producer asked us to quit
+static bool apply_record(shm_server *s, const shm_record *r){
+	if(r->op == SHM_QUIT)
+		return true;
+
+	s->records++;
+
+	if(r->slot >= s->num_elems || !s->elems[r->slot].active){
+		s->invalid++;
+		return false;
+	}
+
+	haptic_elem *elem = &s->elems[r->slot];
+	int ret;
+
+	switch(r->op){
+	case SHM_SET:
+		if(set_field(s, elem, r)){
+			s->invalid++;
+			return false;
+		}
+
+		queue_update(elem);
+		s->queued_at[r->slot] = r->timestamp;
+		return false;
+
+	case SHM_RUN:
+		// make sure the effect starts with its latest parameters
+		flush_effect(s->haptic, elem);
+
+		// negative iterations wrap around to SDL_HAPTIC_INFINITY
+		ret = play_slot_effect(s->slots, elem, (uint32_t)r->value);
+		break;
+
+	case SHM_STOP:
+		ret = stop_slot_effect(s->slots, elem);
+		break;
+
+	default:
+		s->invalid++;
+		return false;
+	}
+
+	if(ret)
+		s->failed++;
+	else
+		hist_add(&s->latency, shm_timestamp() - r->timestamp);
+
+	return false;
+}
+
+#define BACKOFF_MIN_NS 50000
+#define BACKOFF_MAX_NS 2000000
+
+// spin for a while so back to back records are picked up immediately, then
+// sleep longer and longer so an idle ring doesn't keep waking up a core,
+// but never past due, when the next queued update has to go out
+static void backoff(unsigned *idle, uint64_t due){
+	++*idle;
+
+	if(*idle < 1000)
+		return;
+
+	if(*idle < 2000){
+		sched_yield();
+		return;
+	}
+
+	uint64_t ns = (uint64_t)BACKOFF_MIN_NS << (*idle - 2000);
+	if(ns >= BACKOFF_MAX_NS){
+		ns = BACKOFF_MAX_NS;
+		--*idle;
+	}
+
+	uint64_t now = now_ns();
+	if(due && due < now + ns)
+		ns = due > now ? due - now : 0;
+
+	struct timespec ts = {0, ns};
+	nanosleep(&ts, NULL);
+}
+
+// returns when the next queued update is due, 0 if there are none, call
+// with slots->lock held
+static uint64_t flush(shm_server *s){
+	uint64_t next = flush_updates(s->haptic, s->num_elems, s->elems);
+	uint64_t now = shm_timestamp();
+
+	for(size_t i = 0; i < s->num_elems; ++i){
+		if(s->queued_at[i] && !s->elems[i].pending){
+			hist_add(&s->latency, now - s->queued_at[i]);
+			s->queued_at[i] = 0;
+		}
+	}
+
+	return next ? now_ns() + next : 0;
+}
+
+static int shm_thread(void *data){
+	shm_server *s = data;
+	shm_ring *ring = s->ring;
+
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL);
+
+	uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	unsigned idle = 0;
+	uint64_t due = 0;
+
+	while(!atomic_load_explicit(&s->stop, memory_order_relaxed)){
+		uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+		if(head == tail){
+			if(due && now_ns() >= due){
+				SDL_LockMutex(s->slots->lock);
+				due = flush(s);
+				SDL_UnlockMutex(s->slots->lock);
+			}
+
+			backoff(&idle, due);
+			continue;
+		}
+
+		// everything pushed so far is applied before uploading, so a
+		// burst of updates to one effect becomes a single upload. The menu
+		// of -i changes effects too, neither should see the other's half
+		// done.
+		idle = 0;
+		SDL_LockMutex(s->slots->lock);
+		while(tail != head){
+			shm_record r = ring->records[tail & (SHM_RING_LEN - 1)];
+			atomic_store_explicit(&ring->tail, ++tail, memory_order_release);
+
+			if(apply_record(s, &r)){
+				flush(s);
+				SDL_UnlockMutex(s->slots->lock);
+				return 0;
+			}
+		}
+
+		due = flush(s);
+		SDL_UnlockMutex(s->slots->lock);
+	}
+
+	return 0;
+}
+
+// A ring left behind by a crashed run would make creating one fail, so
+// it's removed, but only once nobody holds the lock on it any more.
+static int remove_stale_ring(const char *name){
+	int fd = shm_open(name, O_RDWR, 0600);
+	if(fd < 0)
+		return errno == ENOENT ? 0 : SDL_SetError("shm_open %s: %s", name, strerror(errno));
+
+	if(flock(fd, LOCK_EX | LOCK_NB)){
+		close(fd);
+		return SDL_SetError("%s is already being served by another ffbsdl.", name);
+	}
+
+	shm_unlink(name);
+	close(fd);
+	return 0;
+}
+
+static shm_ring *create_ring(const char *name, int *lock_fd){
+	int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	if(fd < 0 && errno == EEXIST){
+		if(remove_stale_ring(name))
+			return NULL;
+
+		fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	}
+
+	if(fd < 0){
+		SDL_SetError("shm_open %s: %s", name, strerror(errno));
+		return NULL;
+	}
+
+	if(flock(fd, LOCK_EX | LOCK_NB)){
+		SDL_SetError("Couldn't lock %s: %s", name, strerror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	if(ftruncate(fd, sizeof(shm_ring))){
+		SDL_SetError("ftruncate %s: %s", name, strerror(errno));
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+
+	shm_ring *ring = mmap(NULL, sizeof(shm_ring), PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0);
+	if(ring == MAP_FAILED){
+		SDL_SetError("mmap %s: %s", name, strerror(errno));
+		shm_unlink(name);
+		close(fd);
+		return NULL;
+	}
+
+	*lock_fd = fd;
+
+	ring->version = SHM_VERSION;
+	ring->len = SHM_RING_LEN;
+	ring->record_size = sizeof(shm_record);
+	atomic_store(&ring->head, 0);
+	atomic_store(&ring->tail, 0);
+
+	// producers wait for the magic, so it goes in last
+	atomic_thread_fence(memory_order_release);
+	ring->magic = SHM_MAGIC;
+
+	return ring;
+}
+
+shm_server *start_shm(effect_slots *slots, const char *name){
+	if(strlen(name) >= sizeof(((shm_server *)0)->name)){
+		SDL_SetError("Shared memory name '%s' is too long.", name);
+		return NULL;
+	}
+
+	shm_server *s = calloc(1, sizeof(*s));
+	if(!s){
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	s->queued_at = calloc(slots->num_elems, sizeof(*s->queued_at));
+	if(!s->queued_at){
+		free(s);
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	s->slots = slots;
+	s->haptic = slots->haptic;
+	s->num_elems = slots->num_elems;
+	s->elems = slots->elems;
+	strcpy(s->name, name);
+	atomic_init(&s->stop, false);
+	hist_init(&s->latency);
+	resolve_fields(s);
+
+	s->ring = create_ring(name, &s->fd);
+	if(!s->ring){
+		free(s->queued_at);
+		free(s);
+		return NULL;
+	}
+
+	s->thread = SDL_CreateThread(shm_thread, "shm", s);
+	if(!s->thread){
+		munmap(s->ring, sizeof(shm_ring));
+		shm_unlink(name);
+		close(s->fd);
+		free(s->queued_at);
+		free(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+void wait_shm(shm_server *s){
+	SDL_WaitThread(s->thread, NULL);
+	s->thread = NULL;
+}
+
+void request_stop_shm(shm_server *s){
+	atomic_store_explicit(&s->stop, true, memory_order_relaxed);
+}
+
+void stop_shm(shm_server *s){
+	request_stop_shm(s);
+	if(s->thread)
+		SDL_WaitThread(s->thread, NULL);
+
+	fprintf(stderr, "shm: %llu records, %llu invalid, %llu failed\n",
+			(unsigned long long)s->records,
+			(unsigned long long)s->invalid,
+			(unsigned long long)s->failed);
+	hist_print(stderr, "shm latency", &s->latency);
+
+	// unlinked before letting go of the lock, so nobody takes the ring for
+	// a stale one in between
+	munmap(s->ring, sizeof(shm_ring));
+	shm_unlink(s->name);
+	close(s->fd);
+	free(s->queued_at);
+	free(s);
+}
+
+#endif
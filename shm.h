@@ -0,0 +1,24 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include "effect.h"
+#include "device.h"
+#include "slots.h"
+
+typedef struct shm_server shm_server;
+
+// Creates the shared memory ring called name and starts draining it into the
+// effects in slots, records address effects by their index in slots->elems.
+// Returns NULL with the error set on failure.
+shm_server *start_shm(effect_slots *slots, const char *name);
+
+// blocks until a producer pushes SHM_QUIT or request_stop_shm() is called
+void wait_shm(shm_server *s);
+
+// safe to call from a signal handler
+void request_stop_shm(shm_server *s);
+
+// stops the consumer, prints its statistics and removes the ring
+void stop_shm(shm_server *s);
+
+#endif /* SHM_H */
@@ -0,0 +1,167 @@
+// Test producer for the ffbsdl shared memory ring. Pushes a sine sweep of
+// one effect parameter at a fixed rate, ffbsdl prints the latency from push
+// to applied update when it exits.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "shmring.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+void usage(const char *prog){
+	fprintf(stderr, "usage: %s [-n name] [-c count] [-r rate] [-s slot] [-f field] [-a amplitude] [-q]\n", prog);
+	fputs("  -n name       shared memory ring to push into (default " SHM_DEFAULT_NAME ")\n", stderr);
+	fputs("  -c count      number of updates to push (default 10000)\n", stderr);
+	fputs("  -r rate       updates per second, 0 pushes as fast as possible (default 1000)\n", stderr);
+	fputs("  -s slot       effect slot to update (default 0)\n", stderr);
+	fputs("  -f field      parameter to sweep (default level)\n", stderr);
+	fputs("  -a amplitude  amplitude of the sweep (default 16000)\n", stderr);
+	fputs("  -q            tell ffbsdl to quit once done\n", stderr);
+}
+
+int find_field(const char *name){
+	static const char *names[] = SHM_FIELD_NAMES;
+
+	for(int i = 0; i < SHM_NUM_FIELDS; ++i){
+		if(!strcmp(names[i], name))
+			return i;
+	}
+
+	return -1;
+}
+
+shm_ring *open_ring(const char *name){
+	// ffbsdl might still be starting up, give it a few seconds
+	int fd = -1;
+	for(int i = 0; i < 500 && fd < 0; ++i){
+		fd = shm_open(name, O_RDWR, 0);
+		if(fd < 0)
+			usleep(10000);
+	}
+
+	if(fd < 0){
+		fprintf(stderr, "shm_open %s: %s\n", name, strerror(errno));
+		return NULL;
+	}
+
+	shm_ring *ring = mmap(NULL, sizeof(shm_ring), PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0);
+	close(fd);
+
+	if(ring == MAP_FAILED){
+		fprintf(stderr, "mmap %s: %s\n", name, strerror(errno));
+		return NULL;
+	}
+
+	for(int i = 0; i < 500 && ring->magic != SHM_MAGIC; ++i)
+		usleep(10000);
+
+	atomic_thread_fence(memory_order_acquire);
+
+	if(ring->magic != SHM_MAGIC || ring->version != SHM_VERSION
+			|| ring->len != SHM_RING_LEN
+			|| ring->record_size != sizeof(shm_record)){
+		fprintf(stderr, "%s is not a compatible ffbsdl ring.\n", name);
+		munmap(ring, sizeof(shm_ring));
+		return NULL;
+	}
+
+	return ring;
+}
+
+void sleep_until(uint64_t t){
+	struct timespec ts = {t / 1000000000, t % 1000000000};
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+// spins while the ring is full, returns how many times it had to
+uint64_t push(shm_ring *ring, shm_record *r){
+	uint64_t full = 0;
+
+	r->timestamp = shm_timestamp();
+	while(!shm_push(ring, r)){
+		full++;
+		sched_yield();
+		r->timestamp = shm_timestamp();
+	}
+
+	return full;
+}
+
+int main(int argc, char **argv){
+	const char *name = SHM_DEFAULT_NAME;
+	unsigned long count = 10000;
+	unsigned long rate = 1000;
+	unsigned long slot = 0;
+	long amplitude = 16000;
+	int field = SHM_LEVEL;
+	bool quit = false;
+
+	for(int i = 1; i < argc; ++i){
+		if(!strcmp(argv[i], "-n") && i + 1 < argc)
+			name = argv[++i];
+		else if(!strcmp(argv[i], "-c") && i + 1 < argc)
+			count = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-r") && i + 1 < argc)
+			rate = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-s") && i + 1 < argc)
+			slot = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-a") && i + 1 < argc)
+			amplitude = strtol(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-f") && i + 1 < argc){
+			field = find_field(argv[++i]);
+			if(field < 0){
+				fprintf(stderr, "Unknown field '%s'.\n", argv[i]);
+				return 1;
+			}
+		} else if(!strcmp(argv[i], "-q"))
+			quit = true;
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	shm_ring *ring = open_ring(name);
+	if(!ring)
+		return 1;
+
+	uint64_t full = 0;
+	uint64_t period = rate ? 1000000000 / rate : 0;
+	uint64_t start = shm_timestamp();
+
+	for(unsigned long i = 0; i < count; ++i){
+		if(period)
+			sleep_until(start + i * period);
+
+		shm_record r = {0};
+		r.op = SHM_SET;
+		r.slot = slot;
+		r.field = field;
+		r.value = amplitude * sin(2 * M_PI * i / 1000.0);
+		full += push(ring, &r);
+	}
+
+	if(quit){
+		shm_record r = {0};
+		r.op = SHM_QUIT;
+		full += push(ring, &r);
+	}
+
+	double secs = (shm_timestamp() - start) / 1e9;
+	printf("pushed %lu updates in %.3fs (%.0f/s), ring full %llu times\n",
+			count, secs, count / secs, (unsigned long long)full);
+
+	munmap(ring, sizeof(shm_ring));
+	return 0;
+}
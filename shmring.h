@@ -0,0 +1,96 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+// Layout of the shared memory ring that other processes push force updates
+// into. This header is shared with producers and must not depend on SDL.
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define SHM_DEFAULT_NAME "/ffbsdl"
+#define SHM_MAGIC 0x53424646 // "FFBS"
+#define SHM_VERSION 1
+
+// must be a power of two
+#define SHM_RING_LEN 4096
+
+typedef enum {
+	// set field of the effect in slot to value and upload it
+	SHM_SET,
+	// run the effect in slot, value is the number of iterations
+	SHM_RUN,
+	SHM_STOP,
+	// ask the consumer to stop draining the ring
+	SHM_QUIT,
+} shm_op;
+
+// fields a producer can set, mapped to the effect parameters of the same name
+typedef enum {
+	SHM_LEVEL,
+	SHM_MAGNITUDE,
+	SHM_OFFSET,
+	SHM_PERIOD,
+	SHM_PHASE,
+	SHM_START,
+	SHM_END,
+	SHM_DIRECTION,
+	SHM_LENGTH,
+	SHM_RIGHT_COEFF,
+	SHM_LEFT_COEFF,
+	SHM_RIGHT_SAT,
+	SHM_LEFT_SAT,
+	SHM_DEADBAND,
+	SHM_CENTER,
+	SHM_NUM_FIELDS,
+} shm_field;
+
+#define SHM_FIELD_NAMES { \
+	"level", "magnitude", "offset", "period", "phase", "start", "end", \
+	"direction", "length", "right_coeff", "left_coeff", "right_sat", \
+	"left_sat", "deadband", "center", \
+}
+
+typedef struct {
+	// CLOCK_MONOTONIC nanoseconds when the producer pushed the record
+	uint64_t timestamp;
+	int32_t value;
+	uint16_t slot;
+	uint8_t op;
+	uint8_t field;
+} shm_record;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t len;
+	uint32_t record_size;
+
+	// head is only written by the producer, tail only by the consumer, and
+	// they live on separate cache lines so the two sides don't fight over them
+	_Alignas(64) _Atomic uint32_t head;
+	_Alignas(64) _Atomic uint32_t tail;
+
+	_Alignas(64) shm_record records[SHM_RING_LEN];
+} shm_ring;
+
+static inline uint64_t shm_timestamp(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// returns 0 when the ring is full, the record is not pushed in that case
+static inline int shm_push(shm_ring *ring, const shm_record *r){
+	uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+	if(head - tail == SHM_RING_LEN)
+		return 0;
+
+	ring->records[head & (SHM_RING_LEN - 1)] = *r;
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+	return 1;
+}
+
+#endif /* SHMRING_H */
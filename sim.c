@@ -0,0 +1,321 @@
+// Software stand-in for a haptic device, so everything can be run and
+// benchmarked on machines without a wheel. Configured with a spec like
+// "slots=16,mask=0x7ff,playing=4,axes=1,latency=200", where latency is the
+// time in microseconds every call takes, as if it went down to a driver.
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "device.h"
+#include "timing.h"
+
+#define SIM_DEFAULT_MASK (SDL_HAPTIC_CONSTANT | SDL_HAPTIC_SINE \
+		| SDL_HAPTIC_TRIANGLE | SDL_HAPTIC_SAWTOOTHUP \
+		| SDL_HAPTIC_SAWTOOTHDOWN | SDL_HAPTIC_RAMP | SDL_HAPTIC_SPRING \
+		| SDL_HAPTIC_DAMPER | SDL_HAPTIC_INERTIA | SDL_HAPTIC_FRICTION \
+		| SDL_HAPTIC_CUSTOM | SDL_HAPTIC_GAIN | SDL_HAPTIC_AUTOCENTER \
+		| SDL_HAPTIC_STATUS)
+
+typedef struct {
+	SDL_HapticEffect effect;
+	bool used;
+	bool playing;
+	uint64_t started;
+	Uint32 iterations;
+} sim_effect;
+
+typedef struct {
+	int slots;
+	unsigned int mask;
+	int playing;
+	int axes;
+	uint64_t latency;
+
+	int gain;
+	int autocenter;
+	sim_effect *effects;
+} sim_device;
+
+static void simulate_latency(sim_device *sim){
+	if(!sim->latency)
+		return;
+
+	// sleep through most of it and spin the rest, SDL_Delay() alone is
+	// far too coarse for the sub-millisecond latencies of real drivers
+	uint64_t end = now_ns() + sim->latency;
+	if(sim->latency > 2000000)
+		SDL_Delay((sim->latency - 1000000) / 1000000);
+
+	while(now_ns() < end);
+}
+
+static bool still_playing(sim_effect *e, uint64_t now){
+	if(!e->playing)
+		return false;
+
+	Uint32 length = e->effect.constant.length;
+	if(length == SDL_HAPTIC_INFINITY || e->iterations == SDL_HAPTIC_INFINITY)
+		return true;
+
+	uint64_t ms = e->effect.constant.delay + (uint64_t)length * e->iterations;
+	if(now - e->started < ms * 1000000)
+		return true;
+
+	e->playing = false;
+	return false;
+}
+
+static sim_effect *get_effect(sim_device *sim, int id){
+	if(id < 0 || id >= sim->slots || !sim->effects[id].used){
+		SDL_SetError("Haptic: Invalid effect identifier.");
+		return NULL;
+	}
+
+	return &sim->effects[id];
+}
+
+static int sim_new_effect(void *dev, SDL_HapticEffect *effect){
+	sim_device *sim = dev;
+	simulate_latency(sim);
+
+	if(!(sim->mask & effect->type))
+		return SDL_SetError("Haptic: Effect not supported by haptic device.");
+
+	for(int i = 0; i < sim->slots; ++i){
+		if(!sim->effects[i].used){
+			memset(&sim->effects[i], 0, sizeof(sim->effects[i]));
+			sim->effects[i].effect = *effect;
+			sim->effects[i].used = true;
+			return i;
+		}
+	}
+
+	return SDL_SetError("Haptic: Device has no free space left.");
+}
+
+static int sim_update_effect(void *dev, int id, SDL_HapticEffect *effect){
+	sim_device *sim = dev;
+	simulate_latency(sim);
+
+	sim_effect *e = get_effect(sim, id);
+	if(!e)
+		return -1;
+
+	if(e->effect.type != effect->type)
+		return SDL_SetError("Haptic: Updating effect type is illegal.");
+
+	e->effect = *effect;
+	return 0;
+}
+
+static int sim_run_effect(void *dev, int id, Uint32 iterations){
+	sim_device *sim = dev;
+	simulate_latency(sim);
+
+	sim_effect *e = get_effect(sim, id);
+	if(!e)
+		return -1;
+
+	uint64_t now = now_ns();
+	int playing = 0;
+	for(int i = 0; i < sim->slots; ++i){
+		if(i != id && still_playing(&sim->effects[i], now))
+			playing++;
+	}
+
+	if(playing >= sim->playing)
+		return SDL_SetError("Haptic: Too many effects playing.");
+
+	e->playing = true;
+	e->started = now;
+	e->iterations = iterations;
+	return 0;
+}
+
+static int sim_stop_effect(void *dev, int id){
+	sim_device *sim = dev;
+	simulate_latency(sim);
+
+	sim_effect *e = get_effect(sim, id);
+	if(!e)
+		return -1;
+
+	e->playing = false;
+	return 0;
+}
+
+static void sim_destroy_effect(void *dev, int id){
+	sim_device *sim = dev;
+	simulate_latency(sim);
+
+	sim_effect *e = get_effect(sim, id);
+	if(e)
+		e->used = false;
+}
+
+static int sim_effect_status(void *dev, int id){
+	sim_device *sim = dev;
+	simulate_latency(sim);
+
+	sim_effect *e = get_effect(sim, id);
+	if(!e)
+		return -1;
+
+	return still_playing(e, now_ns());
+}
+
+static int sim_set_gain(void *dev, int gain){
+	sim_device *sim = dev;
+	simulate_latency(sim);
+
+	if(!(sim->mask & SDL_HAPTIC_GAIN))
+		return SDL_SetError("Haptic: Device does not support setting gain.");
+
+	if(gain < 0 || gain > 100)
+		return SDL_SetError("Haptic: Gain must be between 0 and 100.");
+
+	sim->gain = gain;
+	return 0;
+}
+
+static int sim_set_autocenter(void *dev, int autocenter){
+	sim_device *sim = dev;
+	simulate_latency(sim);
+
+	if(!(sim->mask & SDL_HAPTIC_AUTOCENTER))
+		return SDL_SetError("Haptic: Device does not support setting autocenter.");
+
+	if(autocenter < 0 || autocenter > 100)
+		return SDL_SetError("Haptic: Autocenter must be between 0 and 100.");
+
+	sim->autocenter = autocenter;
+	return 0;
+}
+
+static unsigned int sim_query(void *dev){
+	return ((sim_device *)dev)->mask;
+}
+
+static int sim_num_effects(void *dev){
+	return ((sim_device *)dev)->slots;
+}
+
+static int sim_num_playing(void *dev){
+	return ((sim_device *)dev)->playing;
+}
+
+static int sim_num_axes(void *dev){
+	return ((sim_device *)dev)->axes;
+}
+
+static void sim_close(void *dev){
+	sim_device *sim = dev;
+	free(sim->effects);
+	free(sim);
+}
+
+static const haptic_backend sim_backend = {
+	.name = "sim",
+	.new_effect = sim_new_effect,
+	.update_effect = sim_update_effect,
+	.run_effect = sim_run_effect,
+	.stop_effect = sim_stop_effect,
+	.destroy_effect = sim_destroy_effect,
+	.effect_status = sim_effect_status,
+	.set_gain = sim_set_gain,
+	.set_autocenter = sim_set_autocenter,
+	.query = sim_query,
+	.num_effects = sim_num_effects,
+	.num_playing = sim_num_playing,
+	.num_axes = sim_num_axes,
+	.close = sim_close,
+};
+
+static int parse_spec(sim_device *sim, const char *spec, char *name, size_t len){
+	const char *p = spec;
+
+	while(*p){
+		const char *end = strchr(p, ',');
+		if(!end)
+			end = p + strlen(p);
+
+		const char *eq = memchr(p, '=', end - p);
+		if(!eq)
+			return SDL_SetError("Expected key=value in simulator spec, got '%.*s'.",
+					(int)(end - p), p);
+
+		size_t klen = eq - p;
+		char *vend;
+		unsigned long long v = strtoull(eq + 1, &vend, 0);
+
+#define KEY(k) (klen == strlen(k) && !strncmp(p, k, klen))
+
+		if(KEY("name")){
+			size_t n = end - eq - 1;
+			if(n >= len)
+				n = len - 1;
+
+			memcpy(name, eq + 1, n);
+			name[n] = '\0';
+		} else if(vend != end){
+			return SDL_SetError("Invalid value in simulator spec: '%.*s'.",
+					(int)(end - p), p);
+		} else if(KEY("slots"))
+			sim->slots = v;
+		else if(KEY("mask"))
+			sim->mask = v;
+		else if(KEY("playing"))
+			sim->playing = v;
+		else if(KEY("axes"))
+			sim->axes = v;
+		else if(KEY("latency"))
+			sim->latency = v * 1000;
+		else
+			return SDL_SetError("Unknown simulator setting '%.*s'.", (int)klen, p);
+
+#undef KEY
+
+		p = *end ? end + 1 : end;
+	}
+
+	if(sim->slots < 1 || sim->slots > 4096)
+		return SDL_SetError("Simulator slots must be 1 - 4096.");
+
+	// like most real devices, play as many effects as fit unless told otherwise
+	if(!sim->playing || sim->playing > sim->slots)
+		sim->playing = sim->slots;
+
+	return 0;
+}
+
+haptic_device *open_sim_device(const char *spec){
+	sim_device *sim = calloc(1, sizeof(*sim));
+	if(!sim){
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	sim->slots = 16;
+	sim->mask = SIM_DEFAULT_MASK;
+	sim->axes = 1;
+	sim->gain = 100;
+
+	char name[64] = "Simulated device";
+	if(parse_spec(sim, spec, name, sizeof(name))){
+		free(sim);
+		return NULL;
+	}
+
+	sim->effects = calloc(sim->slots, sizeof(*sim->effects));
+	if(!sim->effects){
+		SDL_SetError("Out of memory.");
+		free(sim);
+		return NULL;
+	}
+
+	haptic_device *haptic = open_device(&sim_backend, sim, name);
+	if(!haptic)
+		sim_close(sim);
+
+	return haptic;
+}
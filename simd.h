@@ -0,0 +1,72 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Small helpers over GCC/Clang vector extensions, which compile to SSE
+// or NEON depending on the target without tying us to any intrinsics. Four
+// lanes is what every x86-64 and ARM64 machine has natively.
+
+#include <stdint.h>
+
+#define VLANES 4
+
+typedef float vfloat __attribute__((vector_size(VLANES * sizeof(float))));
+typedef int32_t vint __attribute__((vector_size(VLANES * sizeof(int32_t))));
+
+static inline vfloat vsplat(float x){
+	return (vfloat){0} + x;
+}
+
+static inline vfloat vlanes(){
+	return (vfloat){0, 1, 2, 3};
+}
+
+// picks a where mask is set and b elsewhere, masks come from comparisons
+static inline vfloat vselect(vint mask, vfloat a, vfloat b){
+	return (vfloat)(((vint)a & mask) | ((vint)b & ~mask));
+}
+
+static inline vfloat vmin(vfloat a, vfloat b){
+	return vselect(a < b, a, b);
+}
+
+static inline vfloat vmax(vfloat a, vfloat b){
+	return vselect(a > b, a, b);
+}
+
+static inline vfloat vclamp(vfloat x, float lo, float hi){
+	return vmin(vmax(x, vsplat(lo)), vsplat(hi));
+}
+
+static inline vfloat vabs(vfloat x){
+	return (vfloat)((vint)x & 0x7fffffff);
+}
+
+static inline vfloat vtrunc(vfloat x){
+	return __builtin_convertvector(__builtin_convertvector(x, vint), vfloat);
+}
+
+// fractional part, only valid for x >= 0
+static inline vfloat vfrac(vfloat x){
+	return x - vtrunc(x);
+}
+
+// The periodic shapes take the position within the period in [0, 1) and
+// all start at 0 heading up, like the device would play them.
+
+// sin(2 pi x) with a refined parabola, within ~0.1% of full scale
+static inline vfloat vsine(vfloat x){
+	vfloat u = 2 * x - 1;
+	vfloat p = 4 * u * (1 - vabs(u));
+	p = 0.225f * (p * vabs(p) - p) + p;
+	return -p;
+}
+
+static inline vfloat vtriangle(vfloat x){
+	return 4 * vabs(vfrac(x + 0.75f) - 0.5f) - 1;
+}
+
+static inline vfloat vsawtoothup(vfloat x){
+	return 2 * vfrac(x + 0.5f) - 1;
+}
+
+#endif /* SIMD_H */
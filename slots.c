@@ -0,0 +1,427 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "slots.h"
+#include "scheduler.h"
+#include "update.h"
+
+int init_slots(effect_slots *s, haptic_device *haptic, size_t num_elems){
+	memset(s, 0, sizeof(*s));
+	s->haptic = haptic;
+	s->num_elems = num_elems;
+	s->num_ids = num_elems;
+
+	// power of two so names can be masked into a bucket
+	s->num_buckets = 16;
+	while(s->num_buckets < num_elems * 2)
+		s->num_buckets *= 2;
+
+	s->elems = calloc(num_elems, sizeof(*s->elems));
+	s->free = calloc(num_elems, sizeof(*s->free));
+	s->by_id = calloc(s->num_ids, sizeof(*s->by_id));
+	s->buckets = calloc(s->num_buckets, sizeof(*s->buckets));
+	s->next = calloc(num_elems, sizeof(*s->next));
+	s->heap = calloc(num_elems, sizeof(*s->heap));
+	s->heap_pos = calloc(num_elems, sizeof(*s->heap_pos));
+	s->priority = calloc(num_elems, sizeof(*s->priority));
+	s->last_used = calloc(num_elems, sizeof(*s->last_used));
+	s->scratch = calloc(num_elems, sizeof(*s->scratch));
+	s->candidates = calloc(num_elems, sizeof(*s->candidates));
+
+	s->lock = SDL_CreateMutex();
+
+	if(!s->lock || (num_elems && (!s->elems || !s->free || !s->by_id
+				|| !s->buckets || !s->next || !s->heap || !s->heap_pos
+				|| !s->priority || !s->last_used || !s->scratch || !s->candidates))){
+		free_slots(s);
+		return SDL_SetError("Out of memory.");
+	}
+
+	// pushed backwards so the first effect ends up in elems[0]
+	for(size_t i = num_elems; i-- > 0;)
+		s->free[s->num_free++] = i;
+
+	return 0;
+}
+
+void free_slots(effect_slots *s){
+	for(size_t i = 0; s->elems && i < s->num_elems; ++i){
+		if(s->elems[i].active && s->elems[i].effect.type == SDL_HAPTIC_CUSTOM)
+			free(s->elems[i].effect.custom.data);
+	}
+
+	free(s->elems);
+	free(s->free);
+	free(s->by_id);
+	free(s->buckets);
+	free(s->next);
+	free(s->heap);
+	free(s->heap_pos);
+	free(s->priority);
+	free(s->last_used);
+	free(s->scratch);
+	free(s->candidates);
+	if(s->lock)
+		SDL_DestroyMutex(s->lock);
+
+	memset(s, 0, sizeof(*s));
+}
+
+static size_t hash_name(const effect_slots *s, const char *name){
+	// FNV-1a
+	uint32_t h = 2166136261u;
+	for(; *name; ++name)
+		h = (h ^ (unsigned char)*name) * 16777619u;
+
+	return h & (s->num_buckets - 1);
+}
+
+static void unlink_name(effect_slots *s, size_t i){
+	size_t *link = &s->buckets[hash_name(s, s->elems[i].name)];
+	while(*link && *link != i + 1)
+		link = &s->next[*link - 1];
+
+	if(*link)
+		*link = s->next[i];
+}
+
+// heap order, lowest priority first and then least recently played
+static bool evict_before(const effect_slots *s, size_t a, size_t b){
+	if(s->priority[a] != s->priority[b])
+		return s->priority[a] < s->priority[b];
+
+	return s->last_used[a] < s->last_used[b];
+}
+
+static void heap_set(effect_slots *s, size_t pos, size_t i){
+	s->heap[pos] = i;
+	s->heap_pos[i] = pos;
+}
+
+static void heap_up(effect_slots *s, size_t pos){
+	size_t i = s->heap[pos];
+	while(pos){
+		size_t parent = (pos - 1) / 2;
+		if(!evict_before(s, i, s->heap[parent]))
+			break;
+
+		heap_set(s, pos, s->heap[parent]);
+		pos = parent;
+	}
+
+	heap_set(s, pos, i);
+}
+
+static void heap_down(effect_slots *s, size_t pos){
+	size_t i = s->heap[pos];
+	for(;;){
+		size_t child = pos * 2 + 1;
+		if(child >= s->heap_len)
+			break;
+
+		if(child + 1 < s->heap_len && evict_before(s, s->heap[child + 1], s->heap[child]))
+			child++;
+
+		if(!evict_before(s, s->heap[child], i))
+			break;
+
+		heap_set(s, pos, s->heap[child]);
+		pos = child;
+	}
+
+	heap_set(s, pos, i);
+}
+
+static void heap_remove(effect_slots *s, size_t i){
+	size_t pos = s->heap_pos[i];
+	size_t last = s->heap[--s->heap_len];
+	if(last == i)
+		return;
+
+	heap_set(s, pos, last);
+	heap_up(s, pos);
+	heap_down(s, s->heap_pos[last]);
+}
+
+static void release(effect_slots *s, haptic_elem *elem){
+	size_t i = elem - s->elems;
+
+	if(elem->effect.type == SDL_HAPTIC_CUSTOM)
+		free(elem->effect.custom.data);
+
+	if(elem->active){
+		if(s->sched)
+			scheduler_forget(s->sched, elem);
+
+		if((size_t)elem->id < s->num_ids)
+			s->by_id[elem->id] = 0;
+
+		if(elem->name[0])
+			unlink_name(s, i);
+
+		heap_remove(s, i);
+	}
+
+	memset(elem, 0, sizeof(*elem));
+	s->free[s->num_free++] = i;
+}
+
+// Finds a finished effect that isn't SLOT_PRIORITY_MAX, lowest priority and
+// least recently played first. Nothing below an effect in the heap has a
+// lower priority, so the walk stops at the first SLOT_PRIORITY_MAX one.
+// Asking the device is the slow part, so it's asked about one at a time.
+static int find_finished(effect_slots *s){
+	size_t n = 0, top = 0;
+	s->scratch[top++] = 0;
+	while(top){
+		size_t pos = s->scratch[--top];
+		size_t i = s->heap[pos];
+		if(s->priority[i] == SLOT_PRIORITY_MAX)
+			continue;
+
+		s->candidates[n++] = i;
+		for(size_t child = pos * 2 + 1; child <= pos * 2 + 2 && child < s->heap_len; ++child)
+			s->scratch[top++] = child;
+	}
+
+	while(n){
+		size_t best = 0;
+		for(size_t k = 1; k < n; ++k){
+			if(evict_before(s, s->candidates[k], s->candidates[best]))
+				best = k;
+		}
+
+		// stopped only to resume once there's room, see scheduler.h
+		size_t i = s->candidates[best];
+		if(!(s->sched && scheduler_queued(s->sched, &s->elems[i]))
+				&& haptic_effect_status(s->haptic, s->elems[i].id) <= 0)
+			return i;
+
+		s->candidates[best] = s->candidates[--n];
+	}
+
+	return -1;
+}
+
+static haptic_elem *evict(effect_slots *s, int priority){
+	if(!s->heap_len){
+		SDL_SetError("No free effect slots.");
+		return NULL;
+	}
+
+	// outranked effects go whether they're playing or not, others only
+	// once they're finished
+	size_t i = s->heap[0];
+	if(s->priority[i] == SLOT_PRIORITY_MAX || s->priority[i] >= priority){
+		int found = find_finished(s);
+		if(found < 0){
+			SDL_SetError(s->priority[i] == priority
+					? "No free effect slots, all effects are playing with equal or higher priority."
+					: "No free effect slots, all effects are playing with higher priority.");
+			return NULL;
+		}
+
+		i = found;
+	}
+
+	haptic_elem *elem = &s->elems[i];
+	haptic_destroy_effect(s->haptic, elem->id);
+	release(s, elem);
+	s->evicted++;
+	return elem;
+}
+
+static haptic_elem *create(effect_slots *s, const SDL_HapticEffect *effect,
+		const char *name, int priority){
+	if(name && strlen(name) >= EFFECT_NAME_LEN){
+		SDL_SetError("Effect name '%s' is too long.", name);
+		return NULL;
+	}
+
+	if(!s->num_free && !evict(s, priority)){
+		s->rejected++;
+		return NULL;
+	}
+
+	size_t i = s->free[--s->num_free];
+	haptic_elem *elem = &s->elems[i];
+	elem->effect = *effect;
+
+	// the slot keeps its own copy of custom samples, so callers can free
+	// theirs as soon as the effect is created
+	if(effect->type == SDL_HAPTIC_CUSTOM && effect->custom.data){
+		size_t size = (size_t)effect->custom.samples * effect->custom.channels
+				* sizeof(*effect->custom.data);
+		elem->effect.custom.data = malloc(size);
+		if(!elem->effect.custom.data){
+			s->free[s->num_free++] = i;
+			SDL_SetError("Out of memory.");
+			return NULL;
+		}
+
+		memcpy(elem->effect.custom.data, effect->custom.data, size);
+	}
+
+	int id = haptic_new_effect(s->haptic, &elem->effect);
+	if(id < 0){
+		if(effect->type == SDL_HAPTIC_CUSTOM)
+			free(elem->effect.custom.data);
+
+		s->free[s->num_free++] = i;
+		return NULL;
+	}
+
+	if((size_t)id >= s->num_ids){
+		// devices normally hand out ids below their effect count, but
+		// nothing promises that
+		size_t num_ids = s->num_ids * 2 > (size_t)id ? s->num_ids * 2 : (size_t)id + 1;
+		size_t *by_id = realloc(s->by_id, num_ids * sizeof(*by_id));
+		if(!by_id){
+			haptic_destroy_effect(s->haptic, id);
+			if(effect->type == SDL_HAPTIC_CUSTOM)
+				free(elem->effect.custom.data);
+
+			s->free[s->num_free++] = i;
+			SDL_SetError("Out of memory.");
+			return NULL;
+		}
+
+		memset(&by_id[s->num_ids], 0, (num_ids - s->num_ids) * sizeof(*by_id));
+		s->by_id = by_id;
+		s->num_ids = num_ids;
+	}
+
+	elem->id = id;
+	elem->active = true;
+	s->by_id[id] = i + 1;
+
+	if(name && name[0]){
+		strcpy(elem->name, name);
+		size_t b = hash_name(s, name);
+		s->next[i] = s->buckets[b];
+		s->buckets[b] = i + 1;
+	}
+
+	s->priority[i] = priority;
+	s->last_used[i] = ++s->clock;
+	heap_set(s, s->heap_len++, i);
+	heap_up(s, s->heap_len - 1);
+
+	mark_uploaded(elem);
+	s->created++;
+	return elem;
+}
+
+haptic_elem *create_slot_effect(effect_slots *s, const SDL_HapticEffect *effect,
+		const char *name, int priority){
+	SDL_LockMutex(s->lock);
+	haptic_elem *elem = create(s, effect, name, priority);
+	SDL_UnlockMutex(s->lock);
+	return elem;
+}
+
+void destroy_slot_effect(effect_slots *s, haptic_elem *elem){
+	SDL_LockMutex(s->lock);
+	if(elem->active){
+		haptic_destroy_effect(s->haptic, elem->id);
+		release(s, elem);
+	}
+
+	SDL_UnlockMutex(s->lock);
+}
+
+size_t list_slots(effect_slots *s, size_t *elems, int *ids){
+	size_t n = 0;
+
+	SDL_LockMutex(s->lock);
+	for(size_t i = 0; i < s->num_elems; ++i){
+		if(!s->elems[i].active)
+			continue;
+
+		elems[n] = i;
+		ids[n] = s->elems[i].id;
+		n++;
+	}
+
+	SDL_UnlockMutex(s->lock);
+	return n;
+}
+
+haptic_elem *find_slot_by_id(effect_slots *s, int id){
+	if(id < 0 || (size_t)id >= s->num_ids || !s->by_id[id])
+		return NULL;
+
+	return &s->elems[s->by_id[id] - 1];
+}
+
+haptic_elem *find_slot_by_name(effect_slots *s, const char *name){
+	for(size_t i = s->buckets[hash_name(s, name)]; i; i = s->next[i - 1]){
+		if(!strcmp(s->elems[i - 1].name, name))
+			return &s->elems[i - 1];
+	}
+
+	return NULL;
+}
+
+void touch_slot(effect_slots *s, haptic_elem *elem){
+	size_t i = elem - s->elems;
+	if(!elem->active)
+		return;
+
+	// the newest effect is always the last to go, so only moving down
+	s->last_used[i] = ++s->clock;
+	heap_down(s, s->heap_pos[i]);
+}
+
+void set_slot_priority(effect_slots *s, haptic_elem *elem, int priority){
+	SDL_LockMutex(s->lock);
+
+	size_t i = elem - s->elems;
+	if(elem->active && s->priority[i] != priority){
+		// could have to move either way
+		s->priority[i] = priority;
+		heap_up(s, s->heap_pos[i]);
+		heap_down(s, s->heap_pos[i]);
+	}
+
+	SDL_UnlockMutex(s->lock);
+}
+
+int play_slot_effect(effect_slots *s, haptic_elem *elem, uint32_t iterations){
+	SDL_LockMutex(s->lock);
+
+	int ret;
+	if(!elem->active){
+		ret = SDL_SetError("Effect was destroyed.");
+	} else {
+		touch_slot(s, elem);
+		ret = s->sched ? scheduler_play(s->sched, elem, iterations)
+			: haptic_run_effect(s->haptic, elem->id, iterations);
+	}
+
+	SDL_UnlockMutex(s->lock);
+	return ret;
+}
+
+int stop_slot_effect(effect_slots *s, haptic_elem *elem){
+	SDL_LockMutex(s->lock);
+
+	int ret;
+	if(!elem->active)
+		ret = SDL_SetError("Effect was destroyed.");
+	else
+		ret = s->sched ? scheduler_stop(s->sched, elem) : haptic_stop_effect(s->haptic, elem->id);
+
+	SDL_UnlockMutex(s->lock);
+	return ret;
+}
+
+void print_slot_stats(const effect_slots *s){
+	if(!s->created && !s->rejected)
+		return;
+
+	fprintf(stderr, "slots: %llu created, %llu evicted, %llu rejected\n",
+			(unsigned long long)s->created,
+			(unsigned long long)s->evicted,
+			(unsigned long long)s->rejected);
+}
@@ -0,0 +1,89 @@
+#ifndef SLOTS_H
+#define SLOTS_H
+
+#include <limits.h>
+#include <stdint.h>
+#include "effect.h"
+#include "device.h"
+
+// effects with this priority are never evicted, not even by each other
+#define SLOT_PRIORITY_MAX INT_MAX
+
+// Keeps track of which elems hold a device effect. Free elems sit on a
+// stack, effects can be looked up by device id or name without scanning,
+// and when the device is full a new effect takes the place of the lowest
+// priority, least recently played effect if that's of lower priority, or
+// else of a finished one, lowest priority and least recently played first.
+typedef struct {
+	haptic_device *haptic;
+	size_t num_elems;
+	haptic_elem *elems;
+
+	size_t *free;
+	size_t num_free;
+
+	// device effect id -> elem index + 1, 0 when unused
+	size_t *by_id;
+	size_t num_ids;
+
+	// chained hash of names, elem index + 1 with 0 ending a chain
+	size_t *buckets;
+	size_t *next;
+	size_t num_buckets;
+
+	// eviction candidates, a min-heap of elem indices
+	size_t *heap;
+	size_t *heap_pos;
+	size_t heap_len;
+	int *priority;
+	uint64_t *last_used;
+	uint64_t clock;
+	// heap positions still to look at and effects that might be finished
+	// while evicting
+	size_t *scratch;
+	size_t *candidates;
+
+	// when set, effects are played through it, see scheduler.h
+	struct play_scheduler *sched;
+
+	uint64_t created;
+	uint64_t evicted;
+	uint64_t rejected;
+
+	// held while effects come and go, so other threads can take a
+	// consistent look with list_slots()
+	SDL_mutex *lock;
+} effect_slots;
+
+int init_slots(effect_slots *s, haptic_device *haptic, size_t num_elems);
+void free_slots(effect_slots *s);
+
+// Uploads effect into a free elem, evicting another effect if there are
+// none. Name can be NULL. Custom effects get a copy of their samples,
+// which the elem owns until it is destroyed.
+haptic_elem *create_slot_effect(effect_slots *s, const SDL_HapticEffect *effect,
+		const char *name, int priority);
+
+// destroys the device effect and frees its elem
+void destroy_slot_effect(effect_slots *s, haptic_elem *elem);
+
+haptic_elem *find_slot_by_id(effect_slots *s, int id);
+haptic_elem *find_slot_by_name(effect_slots *s, const char *name);
+
+// marks elem as the most recently played, so it's evicted last
+void touch_slot(effect_slots *s, haptic_elem *elem);
+
+// changes the priority elem is evicted by, as if it had been created with it
+void set_slot_priority(effect_slots *s, haptic_elem *elem, int priority);
+
+// Marks elem as played and starts it, through the scheduler if there is
+// one, which may preempt another effect or have this one wait for room.
+int play_slot_effect(effect_slots *s, haptic_elem *elem, uint32_t iterations);
+int stop_slot_effect(effect_slots *s, haptic_elem *elem);
+
+// copies the elem index and device id of every effect, returns how many
+size_t list_slots(effect_slots *s, size_t *elems, int *ids);
+
+void print_slot_stats(const effect_slots *s);
+
+#endif /* SLOTS_H */
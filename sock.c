@@ -0,0 +1,516 @@
+#include "sock.h"
+
+#ifdef _WIN32
+
+sock_server *start_sock(effect_slots *slots, effect_mask supported_effects, const char *path){
+	SDL_SetError("Unix sockets are not supported on this platform.");
+	return NULL;
+}
+
+void wait_sock(sock_server *s){}
+void request_stop_sock(sock_server *s){}
+void stop_sock(sock_server *s){}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "sockproto.h"
+#include "hist.h"
+#include "timing.h"
+#include "update.h"
+
+#define SOCK_MAX_CLIENTS 64
+
+// rounds served before going back to poll() for new connections
+#define SOCK_MAX_ROUNDS 64
+
+#define NUM_TYPES 16
+
+static const uint16_t sock_types[SOCK_NUM_TYPES] = {
+	SDL_HAPTIC_CONSTANT,
+	SDL_HAPTIC_SINE,
+	SDL_HAPTIC_TRIANGLE,
+	SDL_HAPTIC_SAWTOOTHUP,
+	SDL_HAPTIC_SAWTOOTHDOWN,
+	SDL_HAPTIC_RAMP,
+	SDL_HAPTIC_SPRING,
+	SDL_HAPTIC_DAMPER,
+	SDL_HAPTIC_INERTIA,
+	SDL_HAPTIC_FRICTION,
+};
+
+typedef struct {
+	int fd;
+	unsigned id;
+	haptic_elem *effects[SOCK_MAX_HANDLES];
+
+	uint64_t messages;
+	uint64_t ops;
+	uint64_t failed;
+} sock_client;
+
+struct sock_server {
+	effect_slots *slots;
+	haptic_device *haptic;
+	effect_mask supported_effects;
+
+	char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+	int fd;
+	// written to by request_stop_sock() to get the thread out of poll()
+	int wake[2];
+
+	SDL_Thread *thread;
+	atomic_bool stop;
+
+	sock_client *clients[SOCK_MAX_CLIENTS];
+	unsigned next_id;
+	size_t first;
+
+	// resolved once up front, indexed by field and the bit number of the
+	// effect type, see shm.c
+	const effect_field *fields[SHM_NUM_FIELDS][NUM_TYPES];
+
+	union {
+		sock_msg msg;
+		char buf[sizeof(sock_msg) + SOCK_MAX_OPS * sizeof(sock_op)];
+	} in;
+
+	uint64_t accepted;
+	uint64_t refused;
+	uint64_t messages;
+	uint64_t ops;
+	uint64_t failed;
+	uint64_t dropped_replies;
+	uint64_t first_op;
+	uint64_t last_op;
+	// how long applying each message took
+	hist latency;
+};
+
+static int type_index(uint16_t type){
+	for(int i = 0; i < NUM_TYPES; ++i){
+		if(type & (1 << i))
+			return i;
+	}
+
+	return 0;
+}
+
+static void resolve_fields(sock_server *s){
+	static const char *names[] = SHM_FIELD_NAMES;
+
+	for(int f = 0; f < SHM_NUM_FIELDS; ++f){
+		for(int t = 0; t < NUM_TYPES; ++t)
+			s->fields[f][t] = find_effect_field(1 << t, names[f]);
+	}
+}
+
+static int set_field(sock_server *s, haptic_elem *elem, const sock_op *op){
+	if(op->arg >= SHM_NUM_FIELDS)
+		return -1;
+
+	const effect_field *f = s->fields[op->arg][type_index(elem->effect.type)];
+	if(!f)
+		return -1;
+
+	// so -1 can stand for SDL_HAPTIC_INFINITY in lengths
+	long long v = f->kind == FIELD_U32 ? (long long)(uint32_t)op->value : op->value;
+	if(v < f->min)
+		v = f->min;
+
+	if(v > f->max)
+		v = f->max;
+
+	set_effect_field(&elem->effect, f, v);
+	return 0;
+}
+
+static int create_effect(sock_server *s, sock_client *c, const sock_op *op){
+	if(c->effects[op->handle] || op->arg >= SOCK_NUM_TYPES)
+		return -1;
+
+	uint16_t type = sock_types[op->arg];
+	if(!(type & s->supported_effects))
+		return -1;
+
+	SDL_HapticEffect effect;
+	init_effect(&effect, type);
+	mirror_condition_axes(&effect);
+
+	// never evicted, the handle would end up pointing at someone else's
+	c->effects[op->handle] = create_slot_effect(s->slots, &effect, NULL, SLOT_PRIORITY_MAX);
+	return c->effects[op->handle] ? 0 : -1;
+}
+
+// returns -1 if the op failed, 1 if the client asked us to quit
+static int apply_op(sock_server *s, sock_client *c, const sock_op *op){
+	if(op->op == SOCK_QUIT)
+		return 1;
+
+	if(op->op == SOCK_GAIN)
+		return haptic_set_gain(s->haptic, op->value < 0 ? 0 : op->value > 100 ? 100 : op->value) ? -1 : 0;
+
+	if(op->handle >= SOCK_MAX_HANDLES)
+		return -1;
+
+	if(op->op == SOCK_CREATE)
+		return create_effect(s, c, op);
+
+	haptic_elem *elem = c->effects[op->handle];
+	if(!elem)
+		return -1;
+
+	switch(op->op){
+	case SOCK_SET:
+		if(set_field(s, elem, op))
+			return -1;
+
+		queue_update(elem);
+		return 0;
+
+	case SOCK_RUN:
+		// make sure the effect starts with its latest parameters
+		flush_effect(s->haptic, elem);
+		return play_slot_effect(s->slots, elem, (uint32_t)op->value) ? -1 : 0;
+
+	case SOCK_STOP:
+		return stop_slot_effect(s->slots, elem) ? -1 : 0;
+
+	case SOCK_DESTROY:
+		destroy_slot_effect(s->slots, elem);
+		c->effects[op->handle] = NULL;
+		return 0;
+	}
+
+	return -1;
+}
+
+static void drop_client(sock_server *s, size_t i){
+	sock_client *c = s->clients[i];
+
+	for(size_t h = 0; h < SOCK_MAX_HANDLES; ++h){
+		if(c->effects[h])
+			destroy_slot_effect(s->slots, c->effects[h]);
+	}
+
+	fprintf(stderr, "sock: client %u left, %llu messages, %llu ops, %llu failed\n",
+			c->id, (unsigned long long)c->messages, (unsigned long long)c->ops,
+			(unsigned long long)c->failed);
+
+	close(c->fd);
+	free(c);
+	s->clients[i] = NULL;
+}
+
+static void accept_clients(sock_server *s){
+	for(;;){
+		int fd = accept(s->fd, NULL, NULL);
+		if(fd < 0)
+			return;
+
+		fcntl(fd, F_SETFL, O_NONBLOCK);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+		size_t i = 0;
+		while(i < SOCK_MAX_CLIENTS && s->clients[i])
+			++i;
+
+		sock_client *c = i < SOCK_MAX_CLIENTS ? calloc(1, sizeof(*c)) : NULL;
+		if(!c){
+			s->refused++;
+			close(fd);
+			continue;
+		}
+
+		sock_hello hello = {
+			.magic = SOCK_MAGIC,
+			.version = SOCK_VERSION,
+			.op_size = sizeof(sock_op),
+			.max_ops = SOCK_MAX_OPS,
+			.max_handles = SOCK_MAX_HANDLES,
+		};
+
+		if(send(fd, &hello, sizeof(hello), MSG_DONTWAIT | MSG_NOSIGNAL) != sizeof(hello)){
+			s->refused++;
+			close(fd);
+			free(c);
+			continue;
+		}
+
+		c->fd = fd;
+		c->id = s->next_id++;
+		s->clients[i] = c;
+		s->accepted++;
+	}
+}
+
+// Applies the next message of client i if it has one. Returns 0 if it
+// didn't, 1 if it did and -1 if it asked us to quit.
+static int serve_client(sock_server *s, size_t i){
+	sock_client *c = s->clients[i];
+
+	ssize_t len = recv(c->fd, s->in.buf, sizeof(s->in.buf), MSG_DONTWAIT | MSG_TRUNC);
+	if(len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return 0;
+
+	// gone, or not speaking the protocol, which gets the same treatment
+	const sock_msg *msg = &s->in.msg;
+	if(len < (ssize_t)sizeof(*msg) || msg->count > SOCK_MAX_OPS
+			|| (size_t)len != sizeof(*msg) + msg->count * sizeof(sock_op)){
+		drop_client(s, i);
+		return 0;
+	}
+
+	uint64_t start = now_ns();
+	if(!s->first_op)
+		s->first_op = start;
+
+	const sock_op *ops = (const sock_op *)(msg + 1);
+	sock_reply reply = {.seq = msg->seq};
+	int quit = 0;
+
+	// the menu of -i changes effects too, neither should see the other's
+	// half done
+	SDL_LockMutex(s->slots->lock);
+	for(uint16_t k = 0; k < msg->count && !quit; ++k){
+		int ret = apply_op(s, c, &ops[k]);
+		if(ret > 0)
+			quit = 1;
+		else if(ret < 0)
+			reply.failed++;
+		else
+			reply.applied++;
+	}
+
+	SDL_UnlockMutex(s->slots->lock);
+
+	c->messages++;
+	c->ops += msg->count;
+	c->failed += reply.failed;
+	s->messages++;
+	s->ops += msg->count;
+	s->failed += reply.failed;
+	s->last_op = now_ns();
+	hist_add(&s->latency, s->last_op - start);
+
+	if((msg->flags & SOCK_ACK)
+			&& send(c->fd, &reply, sizeof(reply), MSG_DONTWAIT | MSG_NOSIGNAL) != sizeof(reply))
+		s->dropped_replies++;
+
+	return quit ? -1 : 1;
+}
+
+// Every client gets at most one message per round, so one that floods the
+// socket can't starve the rest, and changes made in a round are uploaded
+// together at its end. Returns true if a client asked us to quit.
+static bool serve_rounds(sock_server *s, uint64_t *due){
+	for(int round = 0; round < SOCK_MAX_ROUNDS; ++round){
+		bool busy = false;
+
+		for(size_t k = 0; k < SOCK_MAX_CLIENTS; ++k){
+			size_t i = (s->first + k) % SOCK_MAX_CLIENTS;
+			if(!s->clients[i])
+				continue;
+
+			int ret = serve_client(s, i);
+			if(ret < 0)
+				return true;
+
+			busy |= ret > 0;
+		}
+
+		s->first = (s->first + 1) % SOCK_MAX_CLIENTS;
+
+		SDL_LockMutex(s->slots->lock);
+		uint64_t next = flush_updates(s->haptic, s->slots->num_elems, s->slots->elems);
+		SDL_UnlockMutex(s->slots->lock);
+		*due = next ? now_ns() + next : 0;
+
+		if(!busy)
+			break;
+	}
+
+	return false;
+}
+
+static int sock_thread(void *data){
+	sock_server *s = data;
+
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+
+	struct pollfd fds[SOCK_MAX_CLIENTS + 2];
+	uint64_t due = 0;
+
+	while(!atomic_load_explicit(&s->stop, memory_order_relaxed)){
+		size_t n = 0;
+		fds[n++] = (struct pollfd){.fd = s->fd, .events = POLLIN};
+		fds[n++] = (struct pollfd){.fd = s->wake[0], .events = POLLIN};
+		for(size_t i = 0; i < SOCK_MAX_CLIENTS; ++i){
+			if(s->clients[i])
+				fds[n++] = (struct pollfd){.fd = s->clients[i]->fd, .events = POLLIN};
+		}
+
+		int timeout = -1;
+		if(due){
+			uint64_t now = now_ns();
+			timeout = due > now ? (due - now + 999999) / 1000000 : 0;
+		}
+
+		if(poll(fds, n, timeout) < 0 && errno != EINTR){
+			fprintf(stderr, "sock: poll: %s\n", strerror(errno));
+			break;
+		}
+
+		if(fds[0].revents & POLLIN)
+			accept_clients(s);
+
+		if(serve_rounds(s, &due))
+			break;
+	}
+
+	return 0;
+}
+
+static int listen_on(const char *path){
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	if(strlen(path) >= sizeof(addr.sun_path))
+		return SDL_SetError("Socket path '%s' is too long.", path);
+
+	strcpy(addr.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(fd < 0)
+		return SDL_SetError("socket: %s", strerror(errno));
+
+	// a socket left behind by a crashed run would otherwise make us fail,
+	// but one that's still accepting belongs to another ffbsdl
+	int probe = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if(probe < 0){
+		SDL_SetError("socket: %s", strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	int err = connect(probe, (struct sockaddr *)&addr, sizeof(addr)) ? errno : 0;
+	close(probe);
+	if(err != ECONNREFUSED && err != ENOENT){
+		if(err)
+			SDL_SetError("Couldn't check %s: %s", path, strerror(err));
+		else
+			SDL_SetError("%s is already in use.", path);
+
+		close(fd);
+		return -1;
+	}
+
+	if(err == ECONNREFUSED)
+		unlink(path);
+
+	// only the user running us gets to touch the wheel
+	mode_t mask = umask(077);
+	int ret = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+
+	if(ret || listen(fd, SOCK_MAX_CLIENTS)){
+		SDL_SetError("Couldn't listen on %s: %s", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+sock_server *start_sock(effect_slots *slots, effect_mask supported_effects, const char *path){
+	sock_server *s = calloc(1, sizeof(*s));
+	if(!s){
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	s->slots = slots;
+	s->haptic = slots->haptic;
+	s->supported_effects = supported_effects;
+	atomic_init(&s->stop, false);
+	hist_init(&s->latency);
+	resolve_fields(s);
+
+	s->fd = listen_on(path);
+	if(s->fd < 0){
+		free(s);
+		return NULL;
+	}
+
+	strcpy(s->path, path);
+
+	if(pipe(s->wake)){
+		SDL_SetError("pipe: %s", strerror(errno));
+		goto err;
+	}
+
+	fcntl(s->wake[1], F_SETFL, O_NONBLOCK);
+
+	s->thread = SDL_CreateThread(sock_thread, "sock", s);
+	if(!s->thread){
+		close(s->wake[0]);
+		close(s->wake[1]);
+		goto err;
+	}
+
+	return s;
+
+err:
+	close(s->fd);
+	unlink(path);
+	free(s);
+	return NULL;
+}
+
+void wait_sock(sock_server *s){
+	SDL_WaitThread(s->thread, NULL);
+	s->thread = NULL;
+}
+
+void request_stop_sock(sock_server *s){
+	atomic_store_explicit(&s->stop, true, memory_order_relaxed);
+
+	// the result doesn't matter, a full pipe wakes the thread just as well
+	char c = 0;
+	if(write(s->wake[1], &c, 1)){}
+}
+
+void stop_sock(sock_server *s){
+	request_stop_sock(s);
+	if(s->thread)
+		SDL_WaitThread(s->thread, NULL);
+
+	for(size_t i = 0; i < SOCK_MAX_CLIENTS; ++i){
+		if(s->clients[i])
+			drop_client(s, i);
+	}
+
+	double elapsed = (s->last_op - s->first_op) / 1e9;
+	fprintf(stderr, "sock: %llu clients, %llu refused, %llu messages, %llu ops (%.0f/s), "
+			"%llu failed, %llu replies dropped\n",
+			(unsigned long long)s->accepted, (unsigned long long)s->refused,
+			(unsigned long long)s->messages, (unsigned long long)s->ops,
+			elapsed > 0 ? s->ops / elapsed : 0.0,
+			(unsigned long long)s->failed, (unsigned long long)s->dropped_replies);
+	hist_print(stderr, "sock message", &s->latency);
+
+	close(s->fd);
+	close(s->wake[0]);
+	close(s->wake[1]);
+	unlink(s->path);
+	free(s);
+}
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef SOCK_H
+#define SOCK_H
+
+#include "effect.h"
+#include "slots.h"
+
+typedef struct sock_server sock_server;
+
+// Listens on a Unix socket at path and serves clients speaking the
+// protocol in sockproto.h from a thread of its own. Client effects are
+// created in slots with SLOT_PRIORITY_MAX, which is never evicted, so a
+// handle stays with the effect it was created as until its client
+// destroys it or goes away. Creating fails instead once every slot is
+// taken by clients. Returns NULL with the error set on failure.
+sock_server *start_sock(effect_slots *slots, effect_mask supported_effects, const char *path);
+
+// blocks until a client sends SOCK_QUIT or request_stop_sock() is called
+void wait_sock(sock_server *s);
+
+// safe to call from a signal handler
+void request_stop_sock(sock_server *s);
+
+// disconnects every client, prints statistics and removes the socket
+void stop_sock(sock_server *s);
+
+#endif /* SOCK_H */
@@ -0,0 +1,288 @@
+// Load generator for the -U socket. Starts a number of clients that each
+// create a few effects and then keep a window of batched updates to them
+// in flight for a while, and prints the ops per second every client got
+// through and the round trip times they saw.
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "sockproto.h"
+#include "hist.h"
+
+#define MAX_CLIENTS 64
+#define MAX_WINDOW 64
+
+typedef struct {
+	const char *path;
+	unsigned effects;
+	unsigned batch;
+	unsigned window;
+	uint64_t duration;
+} load_options;
+
+typedef struct {
+	pthread_t thread;
+	unsigned index;
+	const load_options *opts;
+
+	bool ok;
+	uint64_t ops;
+	uint64_t failed;
+	uint64_t ns;
+	hist rtt;
+} load_client;
+
+void usage(const char *prog){
+	fprintf(stderr, "usage: %s [-s socket] [-c clients] [-e effects] [-b batch] [-w window] [-d seconds] [-q]\n", prog);
+	fputs("  -s socket   where ffbsdl -U listens (default " SOCK_DEFAULT_PATH ")\n", stderr);
+	fputs("  -c clients  clients connecting at once (default 4)\n", stderr);
+	fputs("  -e effects  effects each client creates and updates (default 4)\n", stderr);
+	fputs("  -b batch    ops per message (default 64)\n", stderr);
+	fputs("  -w window   messages in flight per client (default 4)\n", stderr);
+	fputs("  -d seconds  how long to keep sending (default 5)\n", stderr);
+	fputs("  -q          tell ffbsdl to quit once done\n", stderr);
+}
+
+static uint64_t timestamp(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int connect_to(const char *path){
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	if(strlen(path) >= sizeof(addr.sun_path)){
+		fprintf(stderr, "Socket path '%s' is too long.\n", path);
+		return -1;
+	}
+
+	strcpy(addr.sun_path, path);
+
+	// ffbsdl might still be starting up, give it a few seconds
+	for(int i = 0; i < 500; ++i){
+		int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+		if(fd < 0)
+			break;
+
+		if(!connect(fd, (struct sockaddr *)&addr, sizeof(addr))){
+			sock_hello hello;
+			if(recv(fd, &hello, sizeof(hello), 0) == sizeof(hello)
+					&& hello.magic == SOCK_MAGIC && hello.version == SOCK_VERSION
+					&& hello.op_size == sizeof(sock_op))
+				return fd;
+
+			fprintf(stderr, "%s doesn't speak our protocol.\n", path);
+			close(fd);
+			return -1;
+		}
+
+		close(fd);
+		usleep(10000);
+	}
+
+	fprintf(stderr, "connect %s: %s\n", path, strerror(errno));
+	return -1;
+}
+
+static int send_msg(int fd, uint32_t seq, uint16_t flags, const sock_op *ops, uint16_t count){
+	char buf[sizeof(sock_msg) + SOCK_MAX_OPS * sizeof(sock_op)];
+	sock_msg msg = {.seq = seq, .count = count, .flags = flags};
+	memcpy(buf, &msg, sizeof(msg));
+	memcpy(buf + sizeof(msg), ops, count * sizeof(*ops));
+
+	size_t len = sizeof(msg) + count * sizeof(*ops);
+	return send(fd, buf, len, MSG_NOSIGNAL) == (ssize_t)len ? 0 : -1;
+}
+
+static int recv_reply(int fd, sock_reply *reply){
+	return recv(fd, reply, sizeof(*reply), 0) == sizeof(*reply) ? 0 : -1;
+}
+
+static void *client_thread(void *data){
+	load_client *c = data;
+	const load_options *opts = c->opts;
+	hist_init(&c->rtt);
+
+	int fd = connect_to(opts->path);
+	if(fd < 0)
+		return NULL;
+
+	// infinite constant effects, all playing
+	sock_op ops[SOCK_MAX_OPS];
+	unsigned n = 0;
+	for(unsigned e = 0; e < opts->effects; ++e){
+		ops[n++] = (sock_op){.op = SOCK_CREATE, .handle = e, .arg = SOCK_CONSTANT};
+		ops[n++] = (sock_op){.op = SOCK_SET, .handle = e, .arg = SHM_LENGTH, .value = -1};
+		ops[n++] = (sock_op){.op = SOCK_SET, .handle = e, .arg = SHM_LEVEL, .value = 0};
+		ops[n++] = (sock_op){.op = SOCK_RUN, .handle = e, .value = 1};
+	}
+
+	sock_reply reply;
+	if(send_msg(fd, 0, SOCK_ACK, ops, n) || recv_reply(fd, &reply)){
+		fprintf(stderr, "client %u: setting up failed: %s\n", c->index, strerror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	if(reply.failed){
+		fprintf(stderr, "client %u: %u of %u setup ops failed, is the device full?\n",
+				c->index, reply.failed, n);
+		close(fd);
+		return NULL;
+	}
+
+	uint64_t sent_at[MAX_WINDOW];
+	uint32_t seq = 1, acked = 1;
+	uint64_t start = timestamp(), end = start + opts->duration;
+	uint64_t now = start;
+	unsigned phase = 0;
+
+	while(now < end || acked != seq){
+		if(now < end && seq - acked < opts->window){
+			for(unsigned i = 0; i < opts->batch; ++i, ++phase){
+				ops[i] = (sock_op){
+					.op = SOCK_SET,
+					.handle = phase % opts->effects,
+					.arg = SHM_LEVEL,
+					.value = 16000 * sin(phase / 100.0),
+				};
+			}
+
+			sent_at[seq % MAX_WINDOW] = timestamp();
+			if(send_msg(fd, seq, SOCK_ACK, ops, opts->batch))
+				break;
+
+			seq++;
+		} else {
+			if(recv_reply(fd, &reply) || reply.seq != acked)
+				break;
+
+			hist_add(&c->rtt, timestamp() - sent_at[acked % MAX_WINDOW]);
+			c->ops += reply.applied + reply.failed;
+			c->failed += reply.failed;
+			acked++;
+		}
+
+		now = timestamp();
+	}
+
+	c->ns = timestamp() - start;
+	c->ok = acked == seq;
+	if(!c->ok)
+		fprintf(stderr, "client %u: lost the server\n", c->index);
+
+	// disconnecting is enough for ffbsdl to clean up after us
+	close(fd);
+	return NULL;
+}
+
+int main(int argc, char **argv){
+	load_options opts = {
+		.path = SOCK_DEFAULT_PATH,
+		.effects = 4,
+		.batch = 64,
+		.window = 4,
+		.duration = 5000000000ULL,
+	};
+
+	unsigned clients = 4;
+	bool quit = false;
+
+	for(int i = 1; i < argc; ++i){
+		if(!strcmp(argv[i], "-s") && i + 1 < argc)
+			opts.path = argv[++i];
+		else if(!strcmp(argv[i], "-c") && i + 1 < argc)
+			clients = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-e") && i + 1 < argc)
+			opts.effects = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-b") && i + 1 < argc)
+			opts.batch = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-w") && i + 1 < argc)
+			opts.window = strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-d") && i + 1 < argc)
+			opts.duration = strtod(argv[++i], NULL) * 1e9;
+		else if(!strcmp(argv[i], "-q"))
+			quit = true;
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(!clients || clients > MAX_CLIENTS || !opts.effects || opts.effects > SOCK_MAX_HANDLES
+			|| opts.effects * 4 > SOCK_MAX_OPS || !opts.batch || opts.batch > SOCK_MAX_OPS
+			|| !opts.window || opts.window > MAX_WINDOW){
+		fprintf(stderr, "Need 1-%i clients, 1-%i effects, a batch of 1-%i and a window of 1-%i.\n",
+				MAX_CLIENTS, SOCK_MAX_OPS / 4, SOCK_MAX_OPS, MAX_WINDOW);
+		return 1;
+	}
+
+	load_client *c = calloc(clients, sizeof(*c));
+	if(!c){
+		perror("calloc");
+		return 1;
+	}
+
+	for(unsigned i = 0; i < clients; ++i){
+		c[i].index = i;
+		c[i].opts = &opts;
+		if(pthread_create(&c[i].thread, NULL, client_thread, &c[i])){
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	hist rtt;
+	hist_init(&rtt);
+	uint64_t ops = 0, failed = 0;
+	double slowest = 0, fastest = 0;
+	int ret = 0;
+
+	for(unsigned i = 0; i < clients; ++i){
+		pthread_join(c[i].thread, NULL);
+		if(!c[i].ok){
+			ret = 1;
+			continue;
+		}
+
+		double rate = c[i].ns ? c[i].ops * 1e9 / c[i].ns : 0;
+		printf("client %u: %llu ops, %.0f/s, %llu failed\n", i,
+				(unsigned long long)c[i].ops, rate, (unsigned long long)c[i].failed);
+
+		if(!slowest || rate < slowest)
+			slowest = rate;
+
+		if(rate > fastest)
+			fastest = rate;
+
+		ops += c[i].ops;
+		failed += c[i].failed;
+		hist_merge(&rtt, &c[i].rtt);
+	}
+
+	printf("total: %llu ops, %.0f/s, %llu failed, slowest client got %.0f%% of the fastest\n",
+			(unsigned long long)ops, ops * 1e9 / opts.duration, (unsigned long long)failed,
+			fastest ? slowest * 100 / fastest : 0.0);
+	hist_print(stdout, "round trip", &rtt);
+
+	if(quit){
+		int fd = connect_to(opts.path);
+		sock_op op = {.op = SOCK_QUIT};
+		if(fd < 0 || send_msg(fd, 0, 0, &op, 1))
+			ret = 1;
+
+		if(fd >= 0)
+			close(fd);
+	}
+
+	free(c);
+	return ret;
+}
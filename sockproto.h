@@ -0,0 +1,95 @@
+#ifndef SOCKPROTO_H
+#define SOCKPROTO_H
+
+// Protocol spoken over the Unix socket of -U, shared with clients and like
+// shmring.h free of SDL. The socket is SOCK_SEQPACKET, so every send() is
+// one message and there is no framing to do. Everything is in host byte
+// order, clients are on the same machine.
+//
+// Once connected the server sends a sock_hello. After that each message
+// from the client is a sock_msg followed by count sock_ops, applied in
+// order, and if the message asks for it the server answers with a
+// sock_reply once every op has been applied.
+//
+// Effects are addressed by handles the client picks itself, from 0 to
+// SOCK_MAX_HANDLES - 1. Handles are private to the connection, and every
+// effect a client created is destroyed when it disconnects. Nothing else
+// takes a client's effects away, so SOCK_CREATE fails when the device has
+// no room left.
+
+#include <stdint.h>
+#include "shmring.h"
+
+#define SOCK_DEFAULT_PATH "/tmp/ffbsdl.sock"
+#define SOCK_MAGIC 0x44424646 // "FFBD"
+#define SOCK_VERSION 1
+
+#define SOCK_MAX_OPS 1024
+#define SOCK_MAX_HANDLES 256
+
+typedef enum {
+	// create handle as an effect of type arg, see sock_type, with the
+	// defaults of the interactive prompts
+	SOCK_CREATE,
+	// set field arg of handle to value, see shm_field, out of range values
+	// are clamped and a length of -1 is infinite. Changes are uploaded
+	// before the next run of the effect and otherwise at the latest once
+	// the message is done.
+	SOCK_SET,
+	// run handle, value is the number of iterations, -1 for infinity
+	SOCK_RUN,
+	SOCK_STOP,
+	SOCK_DESTROY,
+	// set the device's gain to value
+	SOCK_GAIN,
+	// ask the server to exit
+	SOCK_QUIT,
+} sock_op_code;
+
+typedef enum {
+	SOCK_CONSTANT,
+	SOCK_SINE,
+	SOCK_TRIANGLE,
+	SOCK_SAWTOOTHUP,
+	SOCK_SAWTOOTHDOWN,
+	SOCK_RAMP,
+	SOCK_SPRING,
+	SOCK_DAMPER,
+	SOCK_INERTIA,
+	SOCK_FRICTION,
+	SOCK_NUM_TYPES,
+} sock_type;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t op_size;
+	uint32_t max_ops;
+	uint32_t max_handles;
+} sock_hello;
+
+// ask for a sock_reply
+#define SOCK_ACK 1
+
+typedef struct {
+	uint32_t seq;
+	uint16_t count;
+	uint16_t flags;
+} sock_msg;
+
+typedef struct {
+	int32_t value;
+	uint16_t handle;
+	uint8_t op;
+	// field or type depending on op
+	uint8_t arg;
+} sock_op;
+
+typedef struct {
+	uint32_t seq;
+	uint16_t applied;
+	// ops that were invalid or that the device refused
+	uint16_t failed;
+} sock_reply;
+
+#endif /* SOCKPROTO_H */
@@ -0,0 +1,194 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "stream.h"
+#include "update.h"
+
+typedef struct {
+	effect_slots *slots;
+	haptic_device *haptic;
+	haptic_elem *elem;
+
+	SDL_mutex *lock;
+	SDL_cond *cond;
+
+	Sint16 queue[STREAM_MAX_DEPTH];
+	size_t depth;
+	size_t head;
+	size_t len;
+	bool done;
+
+	stream_stats *stats;
+} stream;
+
+static int stream_thread(void *data){
+	stream *s = data;
+	uint64_t next = 0;
+
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL);
+
+	for(;;){
+		SDL_LockMutex(s->lock);
+		if(!s->len && !s->done){
+			// with a rate limit the last level might still be waiting
+			// for its turn, newer samples can replace it meanwhile
+			if(next)
+				SDL_CondWaitTimeout(s->cond, s->lock, (next + 999999) / 1000000);
+			else while(!s->len && !s->done)
+				SDL_CondWait(s->cond, s->lock);
+		}
+
+		bool have = s->len != 0;
+		Sint16 level = 0;
+		if(have){
+			level = s->queue[s->head];
+			s->head = (s->head + 1) % s->depth;
+			s->len--;
+		}
+
+		bool done = s->done && !s->len;
+
+		// the reader only ever touches the queue, the effect is guarded
+		// by slots->lock like every other
+		SDL_UnlockMutex(s->lock);
+
+		if(!have && done && next){
+			// let the last level through before finishing
+			SDL_Delay((next + 999999) / 1000000);
+		}
+
+		SDL_LockMutex(s->slots->lock);
+		if(have){
+			s->elem->effect.constant.level = level;
+			queue_update(s->elem);
+		}
+
+		bool pending = s->elem->pending;
+		next = flush_updates(s->haptic, 1, s->elem);
+
+		// flushed, and the device has it unless the upload failed
+		if(pending && !s->elem->pending){
+			if(memcmp(&s->elem->effect, &s->elem->uploaded, sizeof(s->elem->effect)))
+				s->stats->failed++;
+			else
+				s->stats->applied++;
+		}
+
+		SDL_UnlockMutex(s->slots->lock);
+
+		if(done && !next)
+			break;
+	}
+
+	return 0;
+}
+
+static void push_samples(stream *s, const Sint16 *samples, size_t n){
+	SDL_LockMutex(s->lock);
+
+	for(size_t i = 0; i < n; ++i){
+		if(s->len == s->depth){
+			s->head = (s->head + 1) % s->depth;
+			s->len--;
+			s->stats->dropped++;
+		}
+
+		s->queue[(s->head + s->len) % s->depth] = samples[i];
+		s->len++;
+	}
+
+	s->stats->received += n;
+
+	SDL_CondSignal(s->cond);
+	SDL_UnlockMutex(s->lock);
+}
+
+static void read_samples(stream *s, int fd){
+	Sint16 buf[256];
+	size_t partial = 0;
+
+	for(;;){
+		ssize_t n = read(fd, (char *)buf + partial, sizeof(buf) - partial);
+		if(n < 0 && errno == EINTR)
+			continue;
+
+		if(n <= 0)
+			break;
+
+		n += partial;
+		push_samples(s, buf, n / sizeof(buf[0]));
+
+		// keep the odd byte around until the rest of its sample arrives
+		partial = n % sizeof(buf[0]);
+		memmove(buf, (char *)buf + n - partial, partial);
+	}
+}
+
+haptic_elem *create_stream_effect(effect_slots *slots, const char *name){
+	SDL_HapticEffect effect;
+	init_effect(&effect, SDL_HAPTIC_CONSTANT);
+	effect.constant.length = SDL_HAPTIC_INFINITY;
+	effect.constant.level = 0;
+
+	// nothing else should ever push the streamed effect off the device
+	haptic_elem *elem = create_slot_effect(slots, &effect, name, SLOT_PRIORITY_MAX);
+	if(!elem)
+		return NULL;
+
+	if(play_slot_effect(slots, elem, 1)){
+		destroy_slot_effect(slots, elem);
+		return NULL;
+	}
+
+	return elem;
+}
+
+int run_stream(effect_slots *slots, int fd, size_t depth, stream_stats *stats){
+	if(depth < 1 || depth > STREAM_MAX_DEPTH)
+		return SDL_SetError("Stream queue depth must be 1 - %i.", STREAM_MAX_DEPTH);
+
+	memset(stats, 0, sizeof(*stats));
+
+	stream s;
+	memset(&s, 0, sizeof(s));
+	s.slots = slots;
+	s.haptic = slots->haptic;
+	s.depth = depth;
+	s.stats = stats;
+
+	s.elem = create_stream_effect(slots, "stream");
+	if(!s.elem)
+		return -1;
+
+	s.lock = SDL_CreateMutex();
+	s.cond = SDL_CreateCond();
+
+	SDL_Thread *thread = SDL_CreateThread(stream_thread, "stream", &s);
+	if(!thread){
+		SDL_DestroyCond(s.cond);
+		SDL_DestroyMutex(s.lock);
+		return -1;
+	}
+
+	read_samples(&s, fd);
+
+	SDL_LockMutex(s.lock);
+	s.done = true;
+	SDL_CondSignal(s.cond);
+	SDL_UnlockMutex(s.lock);
+
+	SDL_WaitThread(thread, NULL);
+
+	SDL_DestroyCond(s.cond);
+	SDL_DestroyMutex(s.lock);
+	return 0;
+}
+
+void print_stream_stats(const stream_stats *stats){
+	fprintf(stderr, "stream: %llu received, %llu applied, %llu dropped, %llu failed\n",
+			(unsigned long long)stats->received,
+			(unsigned long long)stats->applied,
+			(unsigned long long)stats->dropped,
+			(unsigned long long)stats->failed);
+}
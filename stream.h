@@ -0,0 +1,32 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdint.h>
+#include "effect.h"
+#include "device.h"
+#include "slots.h"
+
+#define STREAM_MAX_DEPTH 1024
+#define STREAM_DEFAULT_DEPTH 4
+
+typedef struct {
+	uint64_t received;
+	// uploads the device took, samples the update layer coalesced into a
+	// later one aren't counted
+	uint64_t applied;
+	uint64_t dropped;
+	uint64_t failed;
+} stream_stats;
+
+// Streams native endian Sint16 samples from fd into the level of a single
+// infinite constant effect, until fd hits EOF. At most depth samples are
+// kept queued, older ones are dropped so the wheel never lags behind.
+int run_stream(effect_slots *slots, int fd, size_t depth, stream_stats *stats);
+
+// creates and starts the infinite constant effect that levels are streamed
+// into, it's never evicted for other effects
+haptic_elem *create_stream_effect(effect_slots *slots, const char *name);
+
+void print_stream_stats(const stream_stats *stats);
+
+#endif /* STREAM_H */
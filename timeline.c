@@ -0,0 +1,250 @@
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "timeline.h"
+#include "timing.h"
+
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+// gives the thread time to get going before the first event is due
+#define TIMELINE_LEAD_NS 2000000
+
+#define TIMELINE_MISS_NS 1000000
+
+typedef struct {
+	uint64_t at;
+	size_t line;
+
+	int argc;
+	char *argv[BATCH_MAX_ARGS];
+	char *text;
+	// argv[0] and argv[1] as they were before running, for the csv
+	const char *command;
+	const char *target;
+
+	// mono_ns() relative to the start of the timeline
+	uint64_t woke;
+	uint64_t done;
+	int ret;
+} timeline_event;
+
+struct timeline {
+	timeline_event *events;
+	size_t count;
+	size_t cap;
+
+	const char *file;
+};
+
+void free_timeline(timeline *t){
+	if(!t)
+		return;
+
+	for(size_t i = 0; i < t->count; ++i)
+		free(t->events[i].text);
+
+	free(t->events);
+	free(t);
+}
+
+static int add_event(timeline *t, const char *at, char *rest, size_t line){
+	char *end;
+	double ms = strtod(at, &end);
+	if(end == at || !isfinite(ms) || ms < 0)
+		return SDL_SetError("Bad time '@%s'.", at);
+
+	if(t->count == t->cap){
+		size_t cap = t->cap ? t->cap * 2 : 64;
+		timeline_event *events = realloc(t->events, cap * sizeof(*events));
+		if(!events)
+			return SDL_SetError("Out of memory.");
+
+		t->events = events;
+		t->cap = cap;
+	}
+
+	timeline_event *e = &t->events[t->count];
+	memset(e, 0, sizeof(*e));
+	e->at = llround(ms * 1000000);
+	e->line = line;
+
+	e->text = strdup(rest);
+	if(!e->text)
+		return SDL_SetError("Out of memory.");
+
+	e->argc = split_args(e->text, e->argv);
+	if(e->argc <= 0 || check_batch_args(e->argc, e->argv)){
+		if(e->argc == 0)
+			SDL_SetError("Nothing to do at @%s.", at);
+
+		free(e->text);
+		return -1;
+	}
+
+	e->command = e->argv[0];
+	e->target = e->argc > 1 ? e->argv[1] : "";
+	t->count++;
+	return 0;
+}
+
+static int compare_events(const void *a, const void *b){
+	const timeline_event *x = a, *y = b;
+	if(x->at != y->at)
+		return x->at < y->at ? -1 : 1;
+
+	return x->line < y->line ? -1 : x->line > y->line;
+}
+
+timeline *load_timeline(batch *b, FILE *f, const char *file){
+	timeline *t = calloc(1, sizeof(*t));
+	if(!t){
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	t->file = file;
+	b->file = file;
+	b->line = 0;
+
+	char line[1024];
+	while(fgets(line, sizeof(line), f)){
+		b->line++;
+
+		if(!strchr(line, '\n') && !feof(f)){
+			SDL_SetError("%s:%zu: Line too long.", file, b->line);
+			goto err;
+		}
+
+		char *p = line + strspn(line, " \t");
+		if(*p != '@'){
+			// setup failing means the timeline won't make sense either
+			if(run_batch_line(b, line)){
+				SDL_SetError("%s:%zu: Setup failed.", file, b->line);
+				goto err;
+			}
+
+			continue;
+		}
+
+		char *at = ++p;
+		p += strcspn(p, " \t\r\n");
+		if(*p)
+			*p++ = '\0';
+
+		if(add_event(t, at, p, b->line)){
+			char err[256];
+			snprintf(err, sizeof(err), "%s", SDL_GetError());
+			SDL_SetError("%s:%zu: %s", file, b->line, err);
+			goto err;
+		}
+	}
+
+	qsort(t->events, t->count, sizeof(*t->events), compare_events);
+	return t;
+
+err:
+	free_timeline(t);
+	return NULL;
+}
+
+typedef struct {
+	timeline *t;
+	batch *b;
+	uint64_t spin_ns;
+} timeline_run;
+
+static int timeline_thread(void *data){
+	timeline_run *r = data;
+	timeline *t = r->t;
+
+	SDL_SetThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL);
+#ifdef __linux__
+	// the default 50us of slack is most of the error otherwise
+	prctl(PR_SET_TIMERSLACK, 1UL);
+#endif
+
+	uint64_t start = mono_ns() + TIMELINE_LEAD_NS;
+
+	for(size_t i = 0; i < t->count; ++i){
+		timeline_event *e = &t->events[i];
+		uint64_t deadline = start + e->at;
+
+		if(deadline > r->spin_ns)
+			sleep_until_mono(deadline - r->spin_ns);
+
+		uint64_t woke;
+		while((woke = mono_ns()) < deadline);
+
+		r->b->line = e->line;
+		e->ret = run_batch_args(r->b, e->argc, e->argv);
+		e->done = mono_ns() - start;
+		e->woke = woke - start;
+	}
+
+	return 0;
+}
+
+int run_timeline(timeline *t, batch *b, uint64_t spin_ns, timeline_stats *stats){
+	timeline_run r = {t, b, spin_ns};
+
+	memset(stats, 0, sizeof(*stats));
+	hist_init(&stats->late);
+	hist_init(&stats->call);
+
+	b->file = t->file;
+	SDL_Thread *thread = SDL_CreateThread(timeline_thread, "timeline", &r);
+	if(!thread)
+		return -1;
+
+	SDL_WaitThread(thread, NULL);
+
+	for(size_t i = 0; i < t->count; ++i){
+		timeline_event *e = &t->events[i];
+		uint64_t late = e->woke - e->at;
+
+		stats->events++;
+		if(e->ret < 0)
+			stats->errors++;
+
+		if(late > TIMELINE_MISS_NS)
+			stats->missed++;
+
+		hist_add(&stats->late, late);
+		hist_add(&stats->call, e->done - e->woke);
+	}
+
+	return stats->errors ? -1 : 0;
+}
+
+void print_timeline_stats(FILE *f, const timeline_stats *stats){
+	fprintf(f, "timeline: %zu events, %zu failed, %zu over 1ms late\n",
+			stats->events, stats->errors, stats->missed);
+	hist_print(f, "timeline late", &stats->late);
+	hist_print(f, "timeline call", &stats->call);
+}
+
+int write_timeline_csv(timeline *t, const char *file){
+	FILE *f = fopen(file, "w");
+	if(!f)
+		return SDL_SetError("Couldn't open %s: %s", file, strerror(errno));
+
+	fputs("line,command,effect,scheduled_ns,actual_ns,late_ns,call_ns,ok\n", f);
+	for(size_t i = 0; i < t->count; ++i){
+		timeline_event *e = &t->events[i];
+		fprintf(f, "%zu,%s,%s,%llu,%llu,%llu,%llu,%d\n",
+				e->line, e->command, e->target,
+				(unsigned long long)e->at,
+				(unsigned long long)e->woke,
+				(unsigned long long)(e->woke - e->at),
+				(unsigned long long)(e->done - e->woke),
+				e->ret >= 0);
+	}
+
+	if(fclose(f))
+		return SDL_SetError("Couldn't write %s: %s", file, strerror(errno));
+
+	return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "batch.h"
+#include "hist.h"
+
+// A timeline is a script where lines starting with @ms run at that many
+// milliseconds after the timeline starts:
+//
+//	create A constant level=8000
+//	@0 play A
+//	@120 modify A level=-8000
+//	@500.5 stop A
+//
+// Lines without a time are run in order before the timeline starts, so
+// effects can be created up front. Timed lines can be in any order, lines
+// at the same time run in file order.
+
+typedef struct timeline timeline;
+
+// runs the untimed lines through b and keeps the timed ones for later
+timeline *load_timeline(batch *b, FILE *f, const char *file);
+void free_timeline(timeline *t);
+
+typedef struct {
+	size_t events;
+	size_t errors;
+	// events that started more than a millisecond late
+	size_t missed;
+
+	// how late each event started and how long running it took
+	hist late;
+	hist call;
+} timeline_stats;
+
+// Runs the timed lines on a time critical thread and waits for it to
+// finish. spin_ns before each deadline the thread stops sleeping and
+// busy waits instead, trading CPU for accuracy.
+int run_timeline(timeline *t, batch *b, uint64_t spin_ns, timeline_stats *stats);
+
+void print_timeline_stats(FILE *f, const timeline_stats *stats);
+
+// one line per event with when it was meant to run and when it did
+int write_timeline_csv(timeline *t, const char *file);
+
+#endif /* TIMELINE_H */
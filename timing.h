@@ -0,0 +1,61 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <time.h>
+#endif
+
+// monotonic nanoseconds, only meaningful relative to other now_ns() values
+static inline uint64_t now_ns(){
+	static uint64_t freq = 0;
+	if(!freq)
+		freq = SDL_GetPerformanceFrequency();
+
+	uint64_t c = SDL_GetPerformanceCounter();
+	return c / freq * 1000000000 + c % freq * 1000000000 / freq;
+}
+
+// sleeps until now_ns() reaches deadline, give or take the scheduler
+static inline void sleep_until_ns(uint64_t deadline){
+	uint64_t now = now_ns();
+	if(deadline <= now)
+		return;
+
+#ifdef _WIN32
+	SDL_Delay((deadline - now) / 1000000);
+#else
+	uint64_t ns = deadline - now;
+	struct timespec ts = {ns / 1000000000, ns % 1000000000};
+	nanosleep(&ts, NULL);
+#endif
+}
+
+// CLOCK_MONOTONIC nanoseconds. now_ns() may be on a different clock, so
+// deadlines for sleep_until_mono() have to come from here.
+static inline uint64_t mono_ns(){
+#ifdef _WIN32
+	return now_ns();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// Sleeps until mono_ns() reaches deadline. The deadline is absolute, so
+// being woken early by a signal or scheduled late doesn't push later
+// deadlines back like a relative sleep would.
+static inline void sleep_until_mono(uint64_t deadline){
+#ifdef _WIN32
+	sleep_until_ns(deadline);
+#else
+	struct timespec ts = {deadline / 1000000000, deadline % 1000000000};
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+#endif
+}
+
+#endif /* TIMING_H */
@@ -0,0 +1,363 @@
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+#include "timing.h"
+
+// must be a power of two
+#define TRACE_RING_LEN 4096
+
+// how long the writer sleeps when there's nothing to write
+#define TRACE_IDLE_MS 5
+
+typedef struct {
+	trace_record r;
+	SDL_HapticEffect effect;
+	// custom effect data, copied as the caller's may be gone by the time
+	// it's written, freed by the writer thread
+	Uint16 *data;
+} trace_entry;
+
+struct trace_writer {
+	FILE *f;
+	const char *path;
+	uint64_t start;
+
+	SDL_Thread *thread;
+	atomic_bool stop;
+
+	// only written by the writer thread
+	uint64_t written;
+	bool failed;
+
+	// only written by callers, which the device lock serializes
+	uint64_t dropped;
+
+	// same scheme as shmring.h, callers push at head and the writer
+	// thread pops at tail
+	_Alignas(64) _Atomic uint32_t head;
+	_Alignas(64) _Atomic uint32_t tail;
+
+	_Alignas(64) trace_entry ring[TRACE_RING_LEN];
+};
+
+static size_t custom_len(const SDL_HapticEffect *effect){
+	if(effect->type != SDL_HAPTIC_CUSTOM)
+		return 0;
+
+	return (size_t)effect->custom.channels * effect->custom.samples;
+}
+
+void trace_call(trace_writer *w, haptic_call call, uint64_t now, int id, int arg,
+		const SDL_HapticEffect *effect, int ret){
+	uint32_t head = atomic_load_explicit(&w->head, memory_order_relaxed);
+	uint32_t tail = atomic_load_explicit(&w->tail, memory_order_acquire);
+
+	if(head - tail == TRACE_RING_LEN){
+		w->dropped++;
+		return;
+	}
+
+	trace_entry *e = &w->ring[head & (TRACE_RING_LEN - 1)];
+	e->data = NULL;
+	if(effect && custom_len(effect) && effect->custom.data){
+		size_t size = custom_len(effect) * sizeof(*e->data);
+		e->data = malloc(size);
+		if(!e->data){
+			w->dropped++;
+			return;
+		}
+
+		memcpy(e->data, effect->custom.data, size);
+	}
+
+	e->r.time = now - w->start;
+	e->r.id = id;
+	e->r.arg = arg;
+	e->r.ret = ret;
+	e->r.call = call;
+	e->r.has_effect = effect != NULL;
+	e->r.reserved = 0;
+	if(effect){
+		e->effect = *effect;
+		// nothing to write, the effect is all there is
+		if(!e->data && e->effect.type == SDL_HAPTIC_CUSTOM)
+			e->effect.custom.samples = 0;
+	}
+
+	atomic_store_explicit(&w->head, head + 1, memory_order_release);
+}
+
+static void write_entry(trace_writer *w, trace_entry *e){
+	size_t len = e->r.has_effect ? custom_len(&e->effect) : 0;
+	Uint16 *data = e->data;
+	e->data = NULL;
+
+	if(w->failed){
+		free(data);
+		return;
+	}
+
+	if(fwrite(&e->r, sizeof(e->r), 1, w->f) != 1
+			|| (e->r.has_effect && fwrite(&e->effect, sizeof(e->effect), 1, w->f) != 1)
+			|| (len && fwrite(data, sizeof(*data), len, w->f) != len)){
+		fprintf(stderr, "Couldn't write %s: %s\n", w->path, strerror(errno));
+		w->failed = true;
+		free(data);
+		return;
+	}
+
+	free(data);
+	w->written++;
+}
+
+static int trace_thread(void *data){
+	trace_writer *w = data;
+
+	for(;;){
+		// read stop first, so everything pushed before it was set is
+		// written before the thread exits
+		bool stop = atomic_load(&w->stop);
+		uint32_t tail = atomic_load_explicit(&w->tail, memory_order_relaxed);
+		uint32_t head = atomic_load_explicit(&w->head, memory_order_acquire);
+
+		if(head == tail){
+			if(stop)
+				break;
+
+			SDL_Delay(TRACE_IDLE_MS);
+			continue;
+		}
+
+		for(; tail != head; ++tail)
+			write_entry(w, &w->ring[tail & (TRACE_RING_LEN - 1)]);
+
+		atomic_store_explicit(&w->tail, tail, memory_order_release);
+	}
+
+	return 0;
+}
+
+trace_writer *start_trace(const char *path, const char *device){
+	trace_writer *w = calloc(1, sizeof(*w));
+	if(!w){
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	w->path = path;
+	w->f = fopen(path, "wb");
+	if(!w->f){
+		SDL_SetError("Couldn't open %s: %s", path, strerror(errno));
+		free(w);
+		return NULL;
+	}
+
+	// records are small, let stdio gather lots of them per write()
+	setvbuf(w->f, NULL, _IOFBF, 1 << 16);
+
+	trace_header h = {
+		.magic = TRACE_MAGIC,
+		.version = TRACE_VERSION,
+		.record_size = sizeof(trace_record),
+		.effect_size = sizeof(SDL_HapticEffect),
+	};
+	strncpy(h.device, device, sizeof(h.device) - 1);
+
+	if(fwrite(&h, sizeof(h), 1, w->f) != 1){
+		SDL_SetError("Couldn't write %s: %s", path, strerror(errno));
+		fclose(w->f);
+		free(w);
+		return NULL;
+	}
+
+	w->start = now_ns();
+	atomic_init(&w->stop, false);
+	atomic_init(&w->head, 0);
+	atomic_init(&w->tail, 0);
+
+	w->thread = SDL_CreateThread(trace_thread, "trace", w);
+	if(!w->thread){
+		fclose(w->f);
+		free(w);
+		return NULL;
+	}
+
+	return w;
+}
+
+void stop_trace(trace_writer *w){
+	if(!w)
+		return;
+
+	atomic_store(&w->stop, true);
+	SDL_WaitThread(w->thread, NULL);
+
+	if(fclose(w->f) && !w->failed)
+		fprintf(stderr, "Couldn't write %s: %s\n", w->path, strerror(errno));
+
+	fprintf(stderr, "trace: %llu calls written to %s, %llu dropped\n",
+			(unsigned long long)w->written, w->path,
+			(unsigned long long)w->dropped);
+	free(w);
+}
+
+// recorded effect ids to the ones the replay got for the same effects
+typedef struct {
+	int *ids;
+	size_t len;
+} id_map;
+
+static int map_id(id_map *m, int id){
+	return id >= 0 && (size_t)id < m->len ? m->ids[id] : -1;
+}
+
+static int set_id(id_map *m, int id, int to){
+	if((size_t)id >= m->len){
+		size_t len = m->len ? m->len : 64;
+		while(len <= (size_t)id)
+			len *= 2;
+
+		int *ids = realloc(m->ids, len * sizeof(*ids));
+		if(!ids)
+			return SDL_SetError("Out of memory.");
+
+		for(size_t i = m->len; i < len; ++i)
+			ids[i] = -1;
+
+		m->ids = ids;
+		m->len = len;
+	}
+
+	m->ids[id] = to;
+	return 0;
+}
+
+static int replay_record(haptic_device *haptic, id_map *m, const trace_record *r,
+		SDL_HapticEffect *effect){
+	int id = map_id(m, r->id);
+
+	switch(r->call){
+	case HCALL_NEW_EFFECT:
+		id = haptic_new_effect(haptic, effect);
+		if(id >= 0 && r->ret >= 0 && set_id(m, r->ret, id)){
+			haptic_destroy_effect(haptic, id);
+			return -1;
+		}
+
+		return id;
+
+	case HCALL_UPDATE_EFFECT:
+		return haptic_update_effect(haptic, id, effect);
+
+	case HCALL_RUN_EFFECT:
+		return haptic_run_effect(haptic, id, r->arg);
+
+	case HCALL_STOP_EFFECT:
+		return haptic_stop_effect(haptic, id);
+
+	case HCALL_DESTROY_EFFECT:
+		if(id < 0)
+			return -1;
+
+		haptic_destroy_effect(haptic, id);
+		set_id(m, r->id, -1);
+		return 0;
+
+	case HCALL_EFFECT_STATUS:
+		return haptic_effect_status(haptic, id);
+
+	case HCALL_SET_GAIN:
+		return haptic_set_gain(haptic, r->arg);
+
+	case HCALL_SET_AUTOCENTER:
+		return haptic_set_autocenter(haptic, r->arg);
+	}
+
+	return SDL_SetError("Unknown call %d in trace.", r->call);
+}
+
+int replay_trace(haptic_device *haptic, const char *path, double speed){
+	FILE *f = fopen(path, "rb");
+	if(!f)
+		return SDL_SetError("Couldn't open %s: %s", path, strerror(errno));
+
+	setvbuf(f, NULL, _IOFBF, 1 << 16);
+
+	trace_header h;
+	if(fread(&h, sizeof(h), 1, f) != 1 || h.magic != TRACE_MAGIC){
+		fclose(f);
+		return SDL_SetError("%s is not a trace.", path);
+	}
+
+	if(h.version != TRACE_VERSION || h.record_size != sizeof(trace_record)
+			|| h.effect_size != sizeof(SDL_HapticEffect)){
+		fclose(f);
+		return SDL_SetError("%s was recorded by an incompatible build.", path);
+	}
+
+	h.device[sizeof(h.device) - 1] = '\0';
+	fprintf(stderr, "Replaying %s, recorded on %s\n", path, h.device);
+
+	id_map m = {0};
+	size_t calls = 0, failed = 0, differed = 0;
+	uint64_t start = now_ns();
+	int ret = 0;
+
+	trace_record r;
+	SDL_HapticEffect effect;
+	Uint16 *data = NULL;
+	size_t data_len = 0;
+	while(fread(&r, sizeof(r), 1, f) == 1){
+		if(r.has_effect && fread(&effect, sizeof(effect), 1, f) != 1)
+			break;
+
+		// the recorded pointer means nothing now, the samples follow
+		size_t len = r.has_effect ? custom_len(&effect) : 0;
+		if(len > data_len){
+			Uint16 *grown = realloc(data, len * sizeof(*data));
+			if(!grown){
+				ret = SDL_SetError("Out of memory.");
+				break;
+			}
+
+			data = grown;
+			data_len = len;
+		}
+
+		if(len && fread(data, sizeof(*data), len, f) != len)
+			break;
+
+		if(r.has_effect && effect.type == SDL_HAPTIC_CUSTOM)
+			effect.custom.data = len ? data : NULL;
+
+		if(speed > 0)
+			sleep_until_ns(start + (uint64_t)(r.time / speed));
+
+		int got = replay_record(haptic, &m, &r, &effect);
+
+		calls++;
+		if(got < 0)
+			failed++;
+
+		if((got < 0) != (r.ret < 0))
+			differed++;
+	}
+
+	if(ferror(f)){
+		SDL_SetError("Couldn't read %s: %s", path, strerror(errno));
+		ret = -1;
+	}
+
+	double ms = (now_ns() - start) / 1e6;
+	fprintf(stderr, "replay: %zu calls in %.1fms (%.0f/s), %zu failed, %zu differed from the recording\n",
+			calls, ms, ms > 0 ? calls / ms * 1000 : 0, failed, differed);
+
+	free(data);
+	free(m.ids);
+	fclose(f);
+	return ret;
+}
@@ -0,0 +1,57 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_haptic.h>
+#include "device.h"
+
+// Traces are every call made through the device wrappers, in the order they
+// were made, so a session can be replayed against another device or driver
+// later. The file is a trace_header followed by trace_records, each record
+// followed by the SDL_HapticEffect it passed if has_effect is set. Everything
+// is in host byte order and layout, traces aren't meant to cross machines.
+// Custom effects are followed by their channels * samples Uint16s of data.
+
+#define TRACE_MAGIC 0x54424646 // "FFBT"
+#define TRACE_VERSION 2
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t effect_size;
+	char device[128];
+} trace_header;
+
+typedef struct {
+	// nanoseconds since the trace started
+	uint64_t time;
+	int32_t id;
+	// iterations, gain or autocenter depending on the call
+	int32_t arg;
+	int32_t ret;
+	uint8_t call;
+	uint8_t has_effect;
+	uint16_t reserved;
+} trace_record;
+
+typedef struct trace_writer trace_writer;
+
+trace_writer *start_trace(const char *path, const char *device);
+
+// Queues a call for the writer thread. Never blocks, if the writer has
+// fallen too far behind, or custom effect data can't be copied, the call
+// is dropped and counted instead. Calls are
+// expected to be serialized, the device wrappers hold the device lock.
+void trace_call(trace_writer *w, haptic_call call, uint64_t now, int id, int arg,
+		const SDL_HapticEffect *effect, int ret);
+
+// writes out what's queued, closes the file and prints how it went
+void stop_trace(trace_writer *w);
+
+// Re-issues a trace on haptic with the original timing divided by speed,
+// or as fast as possible if speed is 0.
+int replay_trace(haptic_device *haptic, const char *path, double speed);
+
+#endif /* TRACE_H */
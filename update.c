@@ -0,0 +1,115 @@
+#include <stdatomic.h>
+#include <string.h>
+#include "update.h"
+#include "timing.h"
+
+static uint64_t min_interval = 0;
+
+static struct {
+	atomic_ullong requested;
+	atomic_ullong uploaded;
+	atomic_ullong identical;
+	atomic_ullong coalesced;
+	atomic_ullong failed;
+} stats;
+
+#define COUNT(x) atomic_fetch_add_explicit(&stats.x, 1, memory_order_relaxed)
+
+void set_update_rate(unsigned hz){
+	min_interval = hz ? 1000000000 / hz : 0;
+}
+
+void mark_uploaded(haptic_elem *elem){
+	elem->uploaded = elem->effect;
+	elem->uploaded_at = now_ns();
+	elem->pending = false;
+}
+
+static int upload(haptic_device *haptic, haptic_elem *elem, uint64_t now){
+	elem->pending = false;
+
+	if(!memcmp(&elem->effect, &elem->uploaded, sizeof(elem->effect))){
+		COUNT(identical);
+		return 0;
+	}
+
+	COUNT(uploaded);
+	if(haptic_update_effect(haptic, elem->id, &elem->effect)){
+		COUNT(failed);
+		return -1;
+	}
+
+	elem->uploaded = elem->effect;
+	elem->uploaded_at = now;
+	return 0;
+}
+
+int upload_effect(haptic_device *haptic, haptic_elem *elem){
+	COUNT(requested);
+	if(elem->pending)
+		COUNT(coalesced);
+
+	return upload(haptic, elem, now_ns());
+}
+
+void queue_update(haptic_elem *elem){
+	COUNT(requested);
+	if(elem->pending)
+		COUNT(coalesced);
+
+	elem->pending = true;
+}
+
+int flush_effect(haptic_device *haptic, haptic_elem *elem){
+	if(!elem->pending)
+		return 0;
+
+	return upload(haptic, elem, now_ns());
+}
+
+uint64_t flush_updates(haptic_device *haptic, size_t num_elems, haptic_elem elems[]){
+	uint64_t now = now_ns();
+	uint64_t next = 0;
+
+	for(size_t i = 0; i < num_elems; ++i){
+		haptic_elem *elem = &elems[i];
+		if(!elem->active || !elem->pending)
+			continue;
+
+		uint64_t due = elem->uploaded_at + min_interval;
+		if(now >= due){
+			upload(haptic, elem, now);
+			continue;
+		}
+
+		if(!next || due - now < next)
+			next = due - now;
+	}
+
+	return next;
+}
+
+void get_update_stats(update_stats *s){
+	s->requested = atomic_load(&stats.requested);
+	s->uploaded = atomic_load(&stats.uploaded);
+	s->identical = atomic_load(&stats.identical);
+	s->coalesced = atomic_load(&stats.coalesced);
+	s->failed = atomic_load(&stats.failed);
+}
+
+void print_update_stats(){
+	update_stats s;
+	get_update_stats(&s);
+
+	if(!s.requested)
+		return;
+
+	uint64_t saved = s.identical + s.coalesced;
+	fprintf(stderr, "updates: %llu requested, %llu uploaded, %llu identical, %llu coalesced, %llu failed (%.1f%% saved)\n",
+			(unsigned long long)s.requested,
+			(unsigned long long)s.uploaded,
+			(unsigned long long)s.identical,
+			(unsigned long long)s.coalesced,
+			(unsigned long long)s.failed,
+			100.0 * saved / s.requested);
+}
@@ -0,0 +1,46 @@
+#ifndef UPDATE_H
+#define UPDATE_H
+
+#include <stdint.h>
+#include "effect.h"
+#include "device.h"
+
+// Every SDL_HapticUpdateEffect() is an ioctl on Linux, so instead of
+// uploading each change right away, changes to elem->effect are queued and
+// flushed once per tick. Uploads that wouldn't change anything are skipped
+// and several queued changes to one effect end up as a single upload.
+
+typedef struct {
+	// changes queued with queue_update() or uploaded with upload_effect()
+	uint64_t requested;
+	// calls to haptic_update_effect() actually made
+	uint64_t uploaded;
+	// skipped because the effect was byte identical to what was uploaded
+	uint64_t identical;
+	// folded into a later upload of the same effect
+	uint64_t coalesced;
+	uint64_t failed;
+} update_stats;
+
+// upload each effect at most hz times per second, 0 for no limit
+void set_update_rate(unsigned hz);
+
+// call after haptic_new_effect() so we know what the device has
+void mark_uploaded(haptic_elem *elem);
+
+// uploads right away unless nothing changed, ignoring the rate limit
+int upload_effect(haptic_device *haptic, haptic_elem *elem);
+
+void queue_update(haptic_elem *elem);
+
+// uploads a queued change to elem right away, e.g. before running it
+int flush_effect(haptic_device *haptic, haptic_elem *elem);
+
+// Uploads queued changes that the rate limit allows. Returns nanoseconds
+// until the next queued change is due, or 0 when nothing is left queued.
+uint64_t flush_updates(haptic_device *haptic, size_t num_elems, haptic_elem elems[]);
+
+void get_update_stats(update_stats *stats);
+void print_update_stats();
+
+#endif /* UPDATE_H */
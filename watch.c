@@ -0,0 +1,372 @@
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "watch.h"
+#include "batch.h"
+#include "timing.h"
+#include "update.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+typedef struct {
+	char name[EFFECT_NAME_LEN];
+	int priority;
+	SDL_HapticEffect effect;
+} effect_def;
+
+struct effect_watch {
+	effect_slots *slots;
+	effect_mask supported_effects;
+	bool can_query;
+
+	const char *path;
+	const char *base;
+
+	// what the file defined last time it was applied, sorted by name
+	effect_def *defs;
+	size_t num_defs;
+
+	int fd;
+
+	SDL_Thread *thread;
+	atomic_bool stop;
+};
+
+static int compare_defs(const void *a, const void *b){
+	return strcmp(((const effect_def *)a)->name, ((const effect_def *)b)->name);
+}
+
+static const effect_def *find_def(const effect_def *defs, size_t n, const char *name){
+	effect_def key;
+	strcpy(key.name, name);
+	return bsearch(&key, defs, n, sizeof(*defs), compare_defs);
+}
+
+static int load_defs(const char *path, effect_def **out, size_t *out_len){
+	FILE *f = fopen(path, "r");
+	if(!f)
+		return SDL_SetError("Couldn't open %s: %s", path, strerror(errno));
+
+	effect_def *defs = NULL;
+	size_t n = 0, cap = 0, line_no = 0;
+
+	char line[1024];
+	while(fgets(line, sizeof(line), f)){
+		line_no++;
+
+		char *argv[BATCH_MAX_ARGS];
+		int argc = split_args(line, argv);
+		if(argc < 0)
+			goto err;
+
+		if(argc < 1 || strcmp(argv[0], "create"))
+			continue;
+
+		if(argc < 3){
+			SDL_SetError("Wrong number of arguments to create.");
+			goto err;
+		}
+
+		if(n == cap){
+			cap = cap ? cap * 2 : 64;
+			effect_def *d = realloc(defs, cap * sizeof(*d));
+			if(!d){
+				SDL_SetError("Out of memory.");
+				goto err;
+			}
+
+			defs = d;
+		}
+
+		if(parse_create_args(argc, argv, &defs[n].effect, &defs[n].priority))
+			goto err;
+
+		strcpy(defs[n++].name, argv[1]);
+	}
+
+	fclose(f);
+
+	qsort(defs, n, sizeof(*defs), compare_defs);
+	for(size_t i = 1; i < n; ++i){
+		if(!strcmp(defs[i - 1].name, defs[i].name)){
+			SDL_SetError("%s: '%s' is defined twice.", path, defs[i].name);
+			free(defs);
+			return -1;
+		}
+	}
+
+	*out = defs;
+	*out_len = n;
+	return 0;
+
+err:
+	{
+		char msg[256];
+		snprintf(msg, sizeof(msg), "%s", SDL_GetError());
+		SDL_SetError("%s:%zu: %s", path, line_no, msg);
+	}
+
+	fclose(f);
+	free(defs);
+	return -1;
+}
+
+static void def_failed(effect_watch *w, const effect_def *d, reload_stats *stats){
+	fprintf(stderr, "%s: %s: %s\n", w->path, d->name, SDL_GetError());
+	stats->failed++;
+}
+
+static void apply_def(effect_watch *w, const effect_def *d, reload_stats *stats){
+	effect_slots *slots = w->slots;
+	haptic_device *haptic = slots->haptic;
+
+	if(!(d->effect.type & w->supported_effects)){
+		SDL_SetError("%s is not supported by the device.",
+				get_haptic_type_name(d->effect.type));
+		def_failed(w, d, stats);
+		return;
+	}
+
+	haptic_elem *elem = find_slot_by_name(slots, d->name);
+	if(!elem){
+		if(create_slot_effect(slots, &d->effect, d->name, d->priority))
+			stats->created++;
+		else
+			def_failed(w, d, stats);
+
+		return;
+	}
+
+	if(elem->effect.type == d->effect.type){
+		bool same_priority = slots->priority[elem - slots->elems] == d->priority;
+		if(!memcmp(&elem->effect, &d->effect, sizeof(d->effect))){
+			if(same_priority){
+				stats->unchanged++;
+			} else {
+				set_slot_priority(slots, elem, d->priority);
+				stats->updated++;
+			}
+
+			return;
+		}
+
+		SDL_HapticEffect old = elem->effect;
+		elem->effect = d->effect;
+		if(upload_effect(haptic, elem)){
+			elem->effect = old;
+			def_failed(w, d, stats);
+			return;
+		}
+
+		set_slot_priority(slots, elem, d->priority);
+		stats->updated++;
+		return;
+	}
+
+	// a device effect can't change type, so this one has to go, but
+	// whoever was playing it shouldn't have to notice
+	bool playing = w->can_query && haptic_effect_status(haptic, elem->id) == 1;
+	destroy_slot_effect(slots, elem);
+
+	elem = create_slot_effect(slots, &d->effect, d->name, d->priority);
+	if(!elem){
+		def_failed(w, d, stats);
+		return;
+	}
+
+	if(playing)
+		play_slot_effect(slots, elem, 1);
+
+	stats->recreated++;
+}
+
+int reload_effects(effect_watch *w, reload_stats *stats){
+	uint64_t start = now_ns();
+	memset(stats, 0, sizeof(*stats));
+
+	effect_def *defs;
+	size_t n;
+	if(load_defs(w->path, &defs, &n))
+		return -1;
+
+	// applied in one go, so -m and -U never see half a reload
+	SDL_LockMutex(w->slots->lock);
+
+	// removed effects go first, so their slots are free for new ones
+	for(size_t i = 0; i < w->num_defs; ++i){
+		if(find_def(defs, n, w->defs[i].name))
+			continue;
+
+		haptic_elem *elem = find_slot_by_name(w->slots, w->defs[i].name);
+		if(elem){
+			destroy_slot_effect(w->slots, elem);
+			stats->destroyed++;
+		}
+	}
+
+	for(size_t i = 0; i < n; ++i)
+		apply_def(w, &defs[i], stats);
+
+	SDL_UnlockMutex(w->slots->lock);
+
+	free(w->defs);
+	w->defs = defs;
+	w->num_defs = n;
+
+	stats->ns = now_ns() - start;
+	return 0;
+}
+
+void print_reload_stats(const effect_watch *w, const reload_stats *stats){
+	fprintf(stderr, "Reloaded %s in %.2fms: %zu updated, %zu created, %zu recreated, "
+			"%zu destroyed, %zu unchanged, %zu failed\n",
+			w->path, stats->ns / 1e6, stats->updated, stats->created,
+			stats->recreated, stats->destroyed, stats->unchanged, stats->failed);
+}
+
+#ifdef __linux__
+static int add_watch(effect_watch *w){
+	// editors often save by writing a new file and renaming it over the
+	// old one, so watch the directory rather than the file itself
+	const char *slash = strrchr(w->path, '/');
+	w->base = slash ? slash + 1 : w->path;
+
+	char dir[4096] = ".";
+	if(slash){
+		size_t len = slash == w->path ? 1 : (size_t)(slash - w->path);
+		if(len >= sizeof(dir))
+			return SDL_SetError("%s: Path is too long.", w->path);
+
+		memcpy(dir, w->path, len);
+		dir[len] = '\0';
+	}
+
+	w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(w->fd < 0)
+		return SDL_SetError("inotify: %s", strerror(errno));
+
+	if(inotify_add_watch(w->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0){
+		SDL_SetError("Couldn't watch %s: %s", dir, strerror(errno));
+		close(w->fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+bool watch_changed(effect_watch *w){
+	bool changed = false;
+
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t len;
+	while((len = read(w->fd, buf, sizeof(buf))) > 0){
+		for(char *p = buf; p < buf + len;){
+			struct inotify_event *e = (struct inotify_event *)p;
+			if(e->len && !strcmp(e->name, w->base))
+				changed = true;
+
+			p += sizeof(*e) + e->len;
+		}
+	}
+
+	return changed;
+}
+
+static void remove_watch(effect_watch *w){
+	close(w->fd);
+}
+
+static int watch_thread(void *data){
+	effect_watch *w = data;
+
+	while(!atomic_load(&w->stop)){
+		// woken up now and then to see if we should stop
+		struct pollfd fd = {.fd = w->fd, .events = POLLIN};
+		if(poll(&fd, 1, 100) <= 0 || !watch_changed(w))
+			continue;
+
+		reload_stats stats;
+		if(reload_effects(w, &stats))
+			fprintf(stderr, "%s\n", SDL_GetError());
+		else
+			print_reload_stats(w, &stats);
+	}
+
+	return 0;
+}
+
+int start_watch_thread(effect_watch *w){
+	atomic_init(&w->stop, false);
+	w->thread = SDL_CreateThread(watch_thread, "watch", w);
+	return w->thread ? 0 : -1;
+}
+#else
+static int add_watch(effect_watch *w){
+	return SDL_SetError("Watching files needs inotify.");
+}
+
+bool watch_changed(effect_watch *w){
+	return false;
+}
+
+static void remove_watch(effect_watch *w){
+}
+
+int start_watch_thread(effect_watch *w){
+	return SDL_SetError("Watching files needs inotify.");
+}
+#endif
+
+effect_watch *start_watch(effect_slots *slots, effect_mask supported_effects,
+		const char *path){
+	effect_watch *w = calloc(1, sizeof(*w));
+	if(!w){
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	w->slots = slots;
+	w->supported_effects = supported_effects;
+	w->can_query = haptic_query(slots->haptic) & SDL_HAPTIC_STATUS;
+	w->path = path;
+	w->fd = -1;
+
+	if(add_watch(w)){
+		free(w);
+		return NULL;
+	}
+
+	reload_stats stats;
+	if(reload_effects(w, &stats)){
+		remove_watch(w);
+		free(w);
+		return NULL;
+	}
+
+	fprintf(stderr, "Watching %s, %zu effects created\n", path, stats.created);
+	return w;
+}
+
+void stop_watch(effect_watch *w){
+	if(!w)
+		return;
+
+	if(w->thread){
+		atomic_store(&w->stop, true);
+		SDL_WaitThread(w->thread, NULL);
+	}
+
+	remove_watch(w);
+	free(w->defs);
+	free(w);
+}
+
+int watch_fd(effect_watch *w){
+	return w->fd;
+}
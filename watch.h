@@ -0,0 +1,54 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "effect.h"
+#include "slots.h"
+
+// Keeps the effects on a device in sync with the create lines of a
+// definition file while it's being edited. Each reload compares the file
+// with what's on the device by name and only touches what changed:
+// effects that keep their type are updated in place and keep playing,
+// ones that changed type are recreated, and ones that were removed from
+// the file are destroyed. Effects that didn't come from the file are left
+// alone unless the file takes over their name.
+
+typedef struct {
+	size_t unchanged;
+	size_t updated;
+	size_t created;
+	// changed type, so had to be destroyed and created again
+	size_t recreated;
+	size_t destroyed;
+	size_t failed;
+	uint64_t ns;
+} reload_stats;
+
+typedef struct effect_watch effect_watch;
+
+// loads path once and starts watching it
+effect_watch *start_watch(effect_slots *slots, effect_mask supported_effects,
+		const char *path);
+
+// stops the thread too if there is one
+void stop_watch(effect_watch *w);
+
+// Reloads the file on a thread of its own each time it's saved, for when
+// there's no event loop looking at watch_fd(), like -U and -m without the
+// menu. Reloads hold slots->lock, so those can keep going meanwhile.
+int start_watch_thread(effect_watch *w);
+
+// readable when the file might have changed, -1 where files can't be watched
+int watch_fd(effect_watch *w);
+
+// drains watch_fd() and says whether the file was written since last time
+bool watch_changed(effect_watch *w);
+
+// A file that doesn't parse is not applied at all, so the device keeps
+// the last good definitions.
+int reload_effects(effect_watch *w, reload_stats *stats);
+
+void print_reload_stats(const effect_watch *w, const reload_stats *stats);
+
+#endif /* WATCH_H */
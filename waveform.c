@@ -0,0 +1,348 @@
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "waveform.h"
+
+#define MAX_CHANNELS 16
+#define MAX_LINE 4096
+
+static bool has_suffix(const char *s, const char *suffix){
+	size_t n = strlen(s), m = strlen(suffix);
+	return n >= m && !SDL_strcasecmp(s + n - m, suffix);
+}
+
+static int grow(waveform *w, size_t *cap, size_t frames){
+	if(frames <= *cap)
+		return 0;
+
+	size_t n = *cap ? *cap * 2 : 4096;
+	while(n < frames)
+		n *= 2;
+
+	float *data = realloc(w->data, n * w->channels * sizeof(*data));
+	if(!data)
+		return SDL_SetError("Out of memory.");
+
+	w->data = data;
+	*cap = n;
+	return 0;
+}
+
+static int load_csv(waveform *w, FILE *f, const char *path, double rate){
+	char line[MAX_LINE];
+	size_t cap = 0, lineno = 0;
+	double first = 0, last = 0;
+
+	while(fgets(line, sizeof(line), f)){
+		lineno++;
+
+		char *p = line, *end;
+		double t = strtod(p, &end);
+		// the header, blank lines and the like
+		if(end == p)
+			continue;
+
+		float v[MAX_CHANNELS];
+		unsigned n = 0;
+		for(p = end; *p == ','; p = end){
+			if(n == MAX_CHANNELS)
+				return SDL_SetError("%s:%zu: more than %i channels.", path, lineno, MAX_CHANNELS);
+
+			v[n++] = strtod(p + 1, &end);
+			if(end == p + 1)
+				return SDL_SetError("%s:%zu: expected a number.", path, lineno);
+		}
+
+		if(!n)
+			return SDL_SetError("%s:%zu: no channels after the time.", path, lineno);
+
+		if(!w->channels)
+			w->channels = n;
+		else if(n != w->channels)
+			return SDL_SetError("%s:%zu: %u channels, expected %u.", path, lineno, n, w->channels);
+
+		if(grow(w, &cap, w->frames + 1))
+			return -1;
+
+		memcpy(&w->data[w->frames * n], v, n * sizeof(*v));
+		if(!w->frames++)
+			first = t;
+
+		last = t;
+	}
+
+	if(!w->frames)
+		return SDL_SetError("%s has no samples.", path);
+
+	// the time column only says something once there are two rows
+	if(w->frames > 1){
+		if(last <= first)
+			return SDL_SetError("%s: time doesn't advance.", path);
+
+		// in milliseconds, as -R writes it
+		rate = 1000.0 * (w->frames - 1) / (last - first);
+	}
+
+	w->rate = rate;
+	return 0;
+}
+
+static int load_raw(waveform *w, FILE *f, const char *path, unsigned channels){
+	size_t cap = 0;
+	int16_t buf[4096];
+	size_t n, leftover = 0;
+
+	w->channels = channels;
+	while((n = fread(buf + leftover, sizeof(*buf), 4096 - leftover, f)) > 0){
+		n += leftover;
+		size_t frames = n / channels;
+		if(grow(w, &cap, w->frames + frames))
+			return -1;
+
+		float *out = &w->data[w->frames * channels];
+		for(size_t i = 0; i < frames * channels; ++i)
+			out[i] = buf[i] / 32767.0f;
+
+		w->frames += frames;
+		leftover = n - frames * channels;
+		memmove(buf, buf + frames * channels, leftover * sizeof(*buf));
+	}
+
+	if(ferror(f))
+		return SDL_SetError("Couldn't read %s: %s", path, strerror(errno));
+
+	if(!w->frames)
+		return SDL_SetError("%s has no samples.", path);
+
+	return 0;
+}
+
+int load_waveform(waveform *w, const char *path, double rate, unsigned channels){
+	memset(w, 0, sizeof(*w));
+
+	if(!(rate > 0))
+		return SDL_SetError("The sample rate has to be positive.");
+
+	if(!channels || channels > MAX_CHANNELS)
+		return SDL_SetError("Need 1-%i channels.", MAX_CHANNELS);
+
+	FILE *f = fopen(path, "rb");
+	if(!f)
+		return SDL_SetError("Couldn't open %s: %s", path, strerror(errno));
+
+	int ret;
+	if(has_suffix(path, ".csv")){
+		ret = load_csv(w, f, path, rate);
+	} else {
+		w->rate = rate;
+		ret = load_raw(w, f, path, channels);
+	}
+
+	fclose(f);
+	if(ret)
+		free_waveform(w);
+
+	return ret;
+}
+
+void free_waveform(waveform *w){
+	free(w->data);
+	memset(w, 0, sizeof(*w));
+}
+
+waveform_options default_waveform_options(){
+	return (waveform_options){
+		.axes = 1,
+		.bits = 16,
+		.dither = false,
+		.chunk = 4096,
+	};
+}
+
+// Running sums of every output axis over the source frames, after mapping
+// channels: the same channel for as many as there are, one channel copied
+// to all axes, or all of them averaged onto one axis.
+static double *integrate(const waveform *w, unsigned axes){
+	double *sum = malloc((w->frames + 1) * axes * sizeof(*sum));
+	if(!sum){
+		SDL_SetError("Out of memory.");
+		return NULL;
+	}
+
+	for(unsigned a = 0; a < axes; ++a)
+		sum[a] = 0;
+
+	for(size_t i = 0; i < w->frames; ++i){
+		const float *in = &w->data[i * w->channels];
+		double *prev = &sum[i * axes], *next = prev + axes;
+
+		for(unsigned a = 0; a < axes; ++a){
+			double v = 0;
+			if(w->channels == axes)
+				v = in[a];
+			else if(w->channels == 1)
+				v = in[0];
+			else if(axes == 1){
+				for(unsigned c = 0; c < w->channels; ++c)
+					v += in[c];
+				v /= w->channels;
+			} else if(a < w->channels)
+				v = in[a];
+
+			next[a] = prev[a] + v;
+		}
+	}
+
+	return sum;
+}
+
+// sum of axis a over source frames [0, x), frames being constant in between
+static double integral(const double *sum, size_t frames, unsigned axes, unsigned a, double x){
+	if(x <= 0)
+		return 0;
+
+	if(x >= frames)
+		return sum[frames * axes + a];
+
+	size_t i = x;
+	double lo = sum[i * axes + a], hi = sum[(i + 1) * axes + a];
+	return lo + (x - i) * (hi - lo);
+}
+
+// value of axis a at source frame x, linearly interpolated
+static double interpolate(const double *sum, size_t frames, unsigned axes, unsigned a, double x){
+	size_t i = x;
+	if(i >= frames - 1)
+		i = frames - 1;
+
+	double v0 = sum[(i + 1) * axes + a] - sum[i * axes + a];
+	if(i + 1 >= frames)
+		return v0;
+
+	double v1 = sum[(i + 2) * axes + a] - sum[(i + 1) * axes + a];
+	return v0 + (x - i) * (v1 - v0);
+}
+
+static uint32_t xorshift32(uint32_t *state){
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+int build_custom_effects(const waveform *w, const waveform_options *opts,
+		const SDL_HapticEffect *base, SDL_HapticEffect **effects){
+	const SDL_HapticCustom *b = &base->custom;
+
+	if(!b->period)
+		return SDL_SetError("The sample period has to be at least 1 ms.");
+
+	if(!opts->axes || opts->axes > 3)
+		return SDL_SetError("Need 1-3 axes.");
+
+	if(!opts->bits || opts->bits > 16)
+		return SDL_SetError("Need 1-16 bits.");
+
+	if(!opts->chunk)
+		return SDL_SetError("Chunks need at least one sample.");
+
+	// Source frames per device sample. Going down in rate, every sample is
+	// the average over the span it stands for, which is cheap with running
+	// sums and keeps what is too fast for the device from folding back
+	// into what isn't. Going up, linear interpolation does.
+	double step = w->rate * b->period / 1000.0;
+	size_t samples = ceil(w->frames / step);
+	if(!samples)
+		samples = 1;
+
+	size_t num = (samples + opts->chunk - 1) / opts->chunk;
+	if(b->delay + (uint64_t)(num - 1) * opts->chunk * b->period > USHRT_MAX)
+		return SDL_SetError("Waveform too long, chunks can't be delayed past %i ms.", USHRT_MAX);
+
+	unsigned axes = opts->axes;
+	double *sum = integrate(w, axes);
+	Uint16 *data = malloc(samples * axes * sizeof(*data));
+	SDL_HapticEffect *e = calloc(num, sizeof(*e));
+	if(!sum || !data || !e){
+		free(sum);
+		free(data);
+		free(e);
+		return SDL_SetError("Out of memory.");
+	}
+
+	double q = 1 << (16 - opts->bits);
+	uint32_t seed = 0x2545f491;
+	size_t clipped = 0;
+
+	for(size_t i = 0; i < samples; ++i){
+		double x = i * step;
+		for(unsigned a = 0; a < axes; ++a){
+			double v;
+			if(step > 1){
+				double lo = x - step / 2, hi = x + step / 2;
+				if(lo < 0)
+					lo = 0;
+				if(hi > w->frames)
+					hi = w->frames;
+
+				v = (integral(sum, w->frames, axes, a, hi)
+						- integral(sum, w->frames, axes, a, lo)) / (hi - lo);
+			} else {
+				v = interpolate(sum, w->frames, axes, a, x);
+			}
+
+			v *= 32767;
+			if(opts->dither){
+				double r1 = xorshift32(&seed) / 4294967296.0;
+				double r2 = xorshift32(&seed) / 4294967296.0;
+				v += (r1 - r2) * q;
+			}
+
+			long s = lround(v / q) * (long)q;
+			if(s > SHRT_MAX || s < SHRT_MIN){
+				s = s > 0 ? SHRT_MAX : SHRT_MIN;
+				clipped++;
+			}
+
+			data[i * axes + a] = (Uint16)(Sint16)s;
+		}
+	}
+
+	free(sum);
+
+	if(clipped)
+		fprintf(stderr, "%zu samples out of range were clipped.\n", clipped);
+
+	for(size_t i = 0; i < num; ++i){
+		size_t first = i * opts->chunk;
+		size_t n = samples - first < opts->chunk ? samples - first : opts->chunk;
+
+		e[i].custom = *b;
+		e[i].custom.type = SDL_HAPTIC_CUSTOM;
+		e[i].custom.channels = axes;
+		e[i].custom.samples = n;
+		e[i].custom.data = &data[first * axes];
+		e[i].custom.length = n * b->period;
+		e[i].custom.delay = b->delay + first * b->period;
+
+		// the envelope is for the waveform as a whole
+		if(i > 0)
+			e[i].custom.attack_length = 0;
+		if(i < num - 1)
+			e[i].custom.fade_length = 0;
+	}
+
+	*effects = e;
+	return num;
+}
+
+void free_custom_effects(SDL_HapticEffect *effects){
+	if(effects)
+		free(effects[0].custom.data);
+
+	free(effects);
+}
@@ -0,0 +1,49 @@
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include "effect.h"
+
+// a sampled force signal as loaded from a file, before it is fitted to a
+// device
+typedef struct {
+	// interleaved frames of forces from -1 to 1
+	float *data;
+	size_t frames;
+	unsigned channels;
+	// frames per second
+	double rate;
+} waveform;
+
+// Loads files ending in .csv in the format -R writes: a time column in
+// milliseconds followed by one column per channel, with an optional header.
+// Anything else is raw interleaved native endian int16 at rate and
+// channels, which CSVs bring along themselves.
+int load_waveform(waveform *w, const char *path, double rate, unsigned channels);
+void free_waveform(waveform *w);
+
+typedef struct {
+	// axes to give samples for, 1 plays the force along the direction
+	unsigned axes;
+	// resolution of the device, the samples are quantized to it
+	unsigned bits;
+	// adds triangular noise of one step before quantizing, so detail
+	// below the resolution survives as an average instead of vanishing
+	bool dither;
+	// most samples per effect
+	Uint16 chunk;
+} waveform_options;
+
+waveform_options default_waveform_options();
+
+// Resamples w to the sample period of base, maps its channels onto
+// opts->axes and quantizes it, then splits it into custom effects of at
+// most opts->chunk samples. Each effect is delayed to start where the one
+// before ends, so running all of them at once plays the whole waveform
+// without any more traffic to the device. Everything else is taken from
+// base. Returns the number of effects, which share one sample buffer and
+// are freed with free_custom_effects(), or -1 with the error set.
+int build_custom_effects(const waveform *w, const waveform_options *opts,
+		const SDL_HapticEffect *base, SDL_HapticEffect **effects);
+void free_custom_effects(SDL_HapticEffect *effects);
+
+#endif /* WAVEFORM_H */